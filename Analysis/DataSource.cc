@@ -1,9 +1,42 @@
 #include "DataSource.hh"
+#include "PathUtils.hh"
+#include <stdlib.h>
 
 ProcessedDataScanner* getDataSource(InputDataSource src, bool withCalibrators) {
 	if(src==INPUT_UNOFFICIAL)
 		return new PostAnalyzer(withCalibrators);
-	if(src==INPUT_OFFICIAL)
-		return new PostOfficialAnalyzer(withCalibrators);
+	if(src==INPUT_OFFICIAL) {
+		PostOfficialAnalyzer* P = new PostOfficialAnalyzer(withCalibrators);
+		if(atoi(getEnvSafe("UCNA_FLAT_INPUT","0").c_str())) {
+			P->setMappedInput();
+			P->setEventCache("");	// flat files are already memory-mapped columns
+		}
+		return P;
+	}
 	return NULL;
 }
+
+std::string reducedSimName(const std::string& g4files) {
+	std::string f = g4files.substr(0,g4files.rfind('.'));
+	for(size_t p = f.find('*'); p != std::string::npos; p = f.find('*',p))
+		f.replace(p,1,"all");
+	return f+".flat";
+}
+
+Sim2PMT* getSimSource(const std::string& g4files) {
+	if(atoi(getEnvSafe("UCNA_REDUCED_SIM","0").c_str())) {
+		std::string rf = reducedSimName(g4files);
+		if(fileExists(rf)) {
+			ReducedG4toPMT* R = new ReducedG4toPMT();
+			if(R->addFile(rf)) {
+				printf("Using reduced simulation '%s'\n",rf.c_str());
+				return R;
+			}
+			delete(R);
+		}
+		printf("No reduced simulation '%s'; reading '%s'\n",rf.c_str(),g4files.c_str());
+	}
+	G4toPMT* G = new G4toPMT();
+	G->addFile(g4files);
+	return G;
+}
@@ -14,7 +14,13 @@ enum InputDataSource {
 	INPUT_GEANT4		//< geant4 simulation data for a run
 };
 
-/// get a data source with the approriate specifications
+/// get a data source with the approriate specifications (official replay data from memory-mapped flat files if $UCNA_FLAT_INPUT is set)
 ProcessedDataScanner* getDataSource(InputDataSource src, bool withCalibrators);
 
+/// standard name for reduced simulation file made from Geant4 files matching g4files ('*' replaced by "all", extension ".flat")
+std::string reducedSimName(const std::string& g4files);
+/// get a Geant4 simulation source for files matching g4files: pre-reduced ReducedG4toPMT input if $UCNA_REDUCED_SIM is set
+/// and the file reducedSimName(g4files) exists, otherwise G4toPMT reading g4files directly
+Sim2PMT* getSimSource(const std::string& g4files);
+
 #endif
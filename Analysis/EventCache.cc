@@ -0,0 +1,172 @@
+#include "EventCache.hh"
+#include "PathUtils.hh"
+#include <cassert>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/// event cache file format identifier
+static const char eventCacheMagic[8] = {'U','C','N','A','E','V','C','1'};
+
+/// bytes in header for each column: name, size, offset
+static const unsigned int columnHeaderSize = EventCache::nameLength+sizeof(unsigned int)+sizeof(unsigned long long);
+
+EventCache::EventCache(const std::vector<EventCacheColumn>& c): cols(c), colsFromFile(false), nEvents(0), mapData(NULL), mapSize(0),
+fout(NULL), nBuffered(0), nWritten(0) {
+	for(unsigned int i=0; i<cols.size(); i++)
+		assert(cols[i].readout && cols[i].size && cols[i].name.size() < nameLength);
+}
+
+EventCache::EventCache(): colsFromFile(true), nEvents(0), mapData(NULL), mapSize(0), fout(NULL), nBuffered(0), nWritten(0) { }
+
+int EventCache::findColumn(const std::string& nm) const {
+	for(unsigned int c=0; c<cols.size(); c++)
+		if(cols[c].name == nm)
+			return c;
+	return -1;
+}
+
+unsigned int EventCache::headerSize() const {
+	unsigned int h = sizeof(eventCacheMagic)+2*sizeof(unsigned int)+cols.size()*columnHeaderSize;
+	return 8*((h+7)/8);
+}
+
+bool EventCache::open(const std::string& fname) {
+	close();
+	if(colsFromFile)
+		cols.clear();
+	int fd = ::open(fname.c_str(),O_RDONLY);
+	if(fd < 0)
+		return false;
+	struct stat st;
+	if(fstat(fd,&st) || (size_t)st.st_size < sizeof(eventCacheMagic)+2*sizeof(unsigned int)) {
+		::close(fd);
+		return false;
+	}
+	mapSize = st.st_size;
+	void* m = mmap(NULL,mapSize,PROT_READ,MAP_SHARED,fd,0);
+	::close(fd);
+	if(m == MAP_FAILED) {
+		mapSize = 0;
+		return false;
+	}
+	mapData = (char*)m;
+	madvise(mapData,mapSize,MADV_SEQUENTIAL);
+	
+	// check header against columns
+	const char* p = mapData;
+	unsigned int nc;
+	bool ok = !memcmp(p,eventCacheMagic,sizeof(eventCacheMagic));
+	p += sizeof(eventCacheMagic);
+	memcpy(&nEvents,p,sizeof(nEvents));
+	p += sizeof(nEvents);
+	memcpy(&nc,p,sizeof(nc));
+	p += sizeof(nc);
+	if(colsFromFile) {
+		ok &= (unsigned long long)nc*columnHeaderSize+(p-mapData) <= mapSize;
+		for(unsigned int c=0; ok && c<nc; c++)
+			cols.push_back(EventCacheColumn(std::string(p+c*columnHeaderSize,strnlen(p+c*columnHeaderSize,nameLength))));
+	}
+	ok &= nc == cols.size() && headerSize() <= mapSize;
+	for(unsigned int c=0; ok && c<cols.size(); c++) {
+		unsigned int sz;
+		unsigned long long offset;
+		ok &= !strncmp(p,cols[c].name.c_str(),nameLength);
+		if(colsFromFile)
+			memcpy(&cols[c].size,p+nameLength,sizeof(cols[c].size));
+		memcpy(&sz,p+nameLength,sizeof(sz));
+		memcpy(&offset,p+nameLength+sizeof(sz),sizeof(offset));
+		p += columnHeaderSize;
+		ok &= sz == cols[c].size && offset+(unsigned long long)nEvents*sz <= mapSize;
+		colData.push_back(mapData+offset);
+	}
+	if(!ok) {
+		printf("*** Event cache '%s' does not match expected columns.\n",fname.c_str());
+		close();
+	}
+	return ok;
+}
+
+bool EventCache::create(const std::string& fname, unsigned int n) {
+	close();
+	makePath(fname,true);
+	foutName = fname;
+	fout = fopen((foutName+".tmp").c_str(),"wb");
+	if(!fout) {
+		printf("*** Unable to write event cache '%s'!\n",fname.c_str());
+		return false;
+	}
+	nEvents = n;
+	unsigned int nc = cols.size();
+	std::vector<char> hdr(headerSize());
+	char* p = &hdr[0];
+	memcpy(p,eventCacheMagic,sizeof(eventCacheMagic));
+	p += sizeof(eventCacheMagic);
+	memcpy(p,&nEvents,sizeof(nEvents));
+	p += sizeof(nEvents);
+	memcpy(p,&nc,sizeof(nc));
+	p += sizeof(nc);
+	unsigned long long offset = hdr.size();
+	for(unsigned int c=0; c<nc; c++) {
+		offset = 8*((offset+7)/8);	// aligned for direct access to mapped data
+		strncpy(p,cols[c].name.c_str(),nameLength);
+		memcpy(p+nameLength,&cols[c].size,sizeof(cols[c].size));
+		memcpy(p+nameLength+sizeof(cols[c].size),&offset,sizeof(offset));
+		p += columnHeaderSize;
+		colOffset.push_back(offset);
+		offset += (unsigned long long)nEvents*cols[c].size;
+		buf.push_back(std::vector<char>(fillBlockSize*cols[c].size));
+	}
+	fwrite(&hdr[0],1,hdr.size(),fout);
+	nBuffered = nWritten = 0;
+	return !ferror(fout);
+}
+
+void EventCache::fill() {
+	assert(fout && nWritten+nBuffered < nEvents);
+	for(unsigned int c=0; c<cols.size(); c++)
+		memcpy(&buf[c][nBuffered*cols[c].size],cols[c].readout,cols[c].size);
+	if(++nBuffered == fillBlockSize)
+		flushBlock();
+}
+
+bool EventCache::flushBlock() {
+	for(unsigned int c=0; c<cols.size() && nBuffered; c++) {
+		fseeko(fout,colOffset[c]+(off_t)nWritten*cols[c].size,SEEK_SET);
+		fwrite(&buf[c][0],cols[c].size,nBuffered,fout);
+	}
+	nWritten += nBuffered;
+	nBuffered = 0;
+	return !ferror(fout);
+}
+
+void EventCache::prefetch() const {
+	if(mapData)
+		madvise(mapData,mapSize,MADV_WILLNEED);
+}
+
+bool EventCache::close() {
+	bool ok = true;
+	if(fout) {
+		ok = flushBlock() && nWritten == nEvents;
+		ok &= !fclose(fout);
+		fout = NULL;
+		// only complete files are moved into place
+		if(ok)
+			ok = !rename((foutName+".tmp").c_str(),foutName.c_str());
+		else
+			printf("*** Incomplete event cache '%s' discarded.\n",foutName.c_str());
+		if(!ok)
+			unlink((foutName+".tmp").c_str());
+		buf.clear();
+		colOffset.clear();
+	}
+	if(mapData) {
+		munmap(mapData,mapSize);
+		mapData = NULL;
+		mapSize = 0;
+	}
+	colData.clear();
+	return ok;
+}
@@ -0,0 +1,79 @@
+#ifndef EVENTCACHE_HH
+#define EVENTCACHE_HH 1
+
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+
+/// one fixed-size per-event data column, copied to/from a readout location
+struct EventCacheColumn {
+	/// constructor
+	EventCacheColumn(const std::string& nm = "", void* p = NULL, unsigned int sz = 0): name(nm), readout((char*)p), size(sz) {}
+	std::string name;		//< column name
+	char* readout;			//< readout location for current event
+	unsigned int size;		//< bytes per event
+};
+
+/// on-disk columnar event cache: each column stored as a flat array, memory-mapped for reading
+class EventCache {
+public:
+	/// constructor, with columns to read/write
+	EventCache(const std::vector<EventCacheColumn>& cols);
+	/// constructor for reading, with columns (without readout locations) taken from file
+	EventCache();
+	/// destructor
+	~EventCache() { close(); }
+
+	/// memory-map existing cache file; return false if missing, damaged, or with non-matching columns (if specified)
+	bool open(const std::string& fname);
+	/// start writing new cache file for n events (moved into place when complete)
+	bool create(const std::string& fname, unsigned int n);
+	/// append current readout contents when writing
+	void fill();
+	/// finish writing or unmap file
+	bool close();
+
+	/// load event i into readout locations
+	inline void load(unsigned int i) {
+		for(unsigned int c=0; c<cols.size(); c++)
+			if(cols[c].readout)
+				memcpy(cols[c].readout, colData[c]+i*cols[c].size, cols[c].size);
+	}
+	/// ask OS to start reading mapped file into memory in background
+	void prefetch() const;
+	/// number of events in cache
+	unsigned int size() const { return nEvents; }
+	/// find column by name; -1 if not present
+	int findColumn(const std::string& nm) const;
+	/// get start of data for column c in mapped file
+	const char* getColumnData(unsigned int c) const { return colData[c]; }
+	/// get bytes per event for column c
+	unsigned int getColumnSize(unsigned int c) const { return cols[c].size; }
+
+	static const unsigned int nameLength = 32;		//< column name bytes in file header
+	static const unsigned int fillBlockSize = 16384;	//< number of events buffered per write
+
+protected:
+	/// header bytes for current column list
+	unsigned int headerSize() const;
+	/// write buffered events to file
+	bool flushBlock();
+
+	std::vector<EventCacheColumn> cols;		//< columns
+	bool colsFromFile;						//< whether columns are read from file header
+	unsigned int nEvents;					//< number of events
+
+	char* mapData;							//< memory-mapped file contents
+	size_t mapSize;							//< size of mapped region
+	std::vector<const char*> colData;		//< mapped start of each column
+
+	FILE* fout;								//< output file when writing
+	std::string foutName;					//< output file name
+	std::vector< std::vector<char> > buf;	//< write buffer for each column
+	unsigned int nBuffered;					//< number of events in write buffer
+	unsigned int nWritten;					//< number of events written to file
+	std::vector<size_t> colOffset;			//< file offset of each column
+};
+
+#endif
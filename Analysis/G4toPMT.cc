@@ -2,12 +2,16 @@
 #include "PathUtils.hh"
 #include "BetaSpectrum.hh"
 #include <cassert>
+#include <algorithm>
 #include <cmath>
 
 TRandom3 mc_rnd_source;	
 
+unsigned int Sim2PMT::nInstances = 0;
+
 Sim2PMT::Sim2PMT(const std::string& treeName): ProcessedDataScanner(treeName,false),
-reSimulate(true), afp(AFP_OTHER) {
+reSimulate(true), simKernelTol(1e-3), afp(AFP_OTHER), seqKey(0), seqStart(0), seqEvent(0),
+instanceNum(nInstances++), nScans(0), simKernel(NULL) {
 	for(Side s = EAST; s <= WEST; ++s) {
 		PGen[s].setSide(s);
 		PGen[s].larmorField = 0;
@@ -22,19 +26,60 @@ void Sim2PMT::calcReweight() {
 		physicsWeight *= 1.0+correctedAsymmetry(ePrim,costheta*(afp==AFP_OFF?1:-1));
 }
 
+Sim2PMT::~Sim2PMT() {
+	if(simKernel) delete(simKernel);
+}
+
 void Sim2PMT::setCalibrator(PMTCalibrator& PCal) {
 	for(Side s = EAST; s <= WEST; ++s)
 		PGen[s].setCalibrator(&PCal);
 	ActiveCal = &PCal;
+	if(simKernel) delete(simKernel);
+	simKernel = simKernelTol > 0 ? new SimResponseKernel(PCal,simKernelTol) : NULL;
+	setKernel(simKernel);
+}
+
+void Sim2PMT::setKernel(const SimResponseKernel* K) {
+	for(Side s = EAST; s <= WEST; ++s)
+		PGen[s].setKernel(K);
 }
 
 bool Sim2PMT::nextPoint() {
 	bool np = ProcessedDataScanner::nextPoint();
+	setStreams(seqEvent++);
 	reverseCalibrate();
 	calcReweight();
 	return np;
 }
 
+void Sim2PMT::startScan(unsigned int startRandom) {
+	ProcessedDataScanner::startScan(startRandom);
+	const unsigned long long k = CounterRNG::makeKey(CounterRNG::makeKey(PMTGenerator::getSeed(),ActiveCal?ActiveCal->myRun:0),afp);
+	seqKey = CounterRNG::makeKey(k,CounterRNG::makeKey(instanceNum,nScans++));
+	seqEvent = 0;
+}
+
+void Sim2PMT::startSimSequence() {
+	seqKey = CounterRNG::makeKey(CounterRNG::makeKey(PMTGenerator::getSeed(),ActiveCal?ActiveCal->myRun:0),afp);
+	seqStart = nEvents ? CounterRNG::mix(seqKey)%nEvents : 0;
+	seqEvent = 0;
+}
+
+void Sim2PMT::simulateEvent(unsigned long long i) {
+	assert(nEvents);
+	currentEvent = (seqStart+i)%nEvents;
+	speedload(currentEvent);
+	setStreams(i);
+	reverseCalibrate();
+	calcReweight();
+}
+
+void Sim2PMT::setStreams(unsigned long long i) {
+	const unsigned long long k = CounterRNG::makeKey(seqKey,i);
+	for(Side s = EAST; s <= WEST; ++s)
+		PGen[s].setStream(CounterRNG::makeKey(k,s));
+}
+
 void Sim2PMT::reverseCalibrate() {
 	
 	doUnits();
@@ -85,40 +130,40 @@ float Sim2PMT::getEtrue() {
 
 
 void G4toPMT::setReadpoints() {
-	Tch->SetBranchAddress("EdepQ",eQ);
-	Tch->SetBranchAddress("Edep",eDep);
-	Tch->SetBranchAddress("MWPCEnergy",eW);
-	Tch->SetBranchAddress("ScintPos",scintPos);
-	Tch->SetBranchAddress("MWPCPos",mwpcPos);
-	Tch->SetBranchAddress("time",time);
-	Tch->SetBranchAddress("primTheta",&costheta);
-	Tch->SetBranchAddress("primKE",&ePrim);
-	if(Tch->GetBranch("primPos"))
-		Tch->SetBranchAddress("primPos",primPos);
+	SetBranchAddress("EdepQ",eQ,sizeof(eQ));
+	SetBranchAddress("Edep",eDep,sizeof(eDep));
+	SetBranchAddress("MWPCEnergy",eW,sizeof(eW));
+	SetBranchAddress("ScintPos",scintPos,sizeof(scintPos));
+	SetBranchAddress("MWPCPos",mwpcPos,sizeof(mwpcPos));
+	SetBranchAddress("time",time,sizeof(time));
+	SetBranchAddress("primTheta",&costheta,sizeof(costheta));
+	SetBranchAddress("primKE",&ePrim,sizeof(ePrim));
+	if(hasBranch("primPos"))
+		SetBranchAddress("primPos",primPos,sizeof(primPos));
 	else
 		primPos[0] = primPos[1] = primPos[2] = primPos[3] = 0;
 }
 
 void PenelopeToPMT::setReadpoints() {
-	Tch->SetBranchAddress("Epe",&fEdep[EAST]);
-	Tch->SetBranchAddress("Epw",&fEdep[WEST]);
-	Tch->SetBranchAddress("Egea",&fEW[EAST]);
-	Tch->SetBranchAddress("Egwa",&fEW[WEST]);
+	SetBranchAddress("Epe",&fEdep[EAST],sizeof(fEdep[EAST]));
+	SetBranchAddress("Epw",&fEdep[WEST],sizeof(fEdep[WEST]));
+	SetBranchAddress("Egea",&fEW[EAST],sizeof(fEW[EAST]));
+	SetBranchAddress("Egwa",&fEW[WEST],sizeof(fEW[WEST]));
 	
-	Tch->SetBranchAddress("eposx",&fMWPCpos[EAST][X_DIRECTION]);
-	Tch->SetBranchAddress("eposy",&fMWPCpos[EAST][Y_DIRECTION]);
-	Tch->SetBranchAddress("wposx",&fMWPCpos[WEST][X_DIRECTION]);
-	Tch->SetBranchAddress("wposy",&fMWPCpos[WEST][Y_DIRECTION]);
+	SetBranchAddress("eposx",&fMWPCpos[EAST][X_DIRECTION],sizeof(fMWPCpos[EAST][X_DIRECTION]));
+	SetBranchAddress("eposy",&fMWPCpos[EAST][Y_DIRECTION],sizeof(fMWPCpos[EAST][Y_DIRECTION]));
+	SetBranchAddress("wposx",&fMWPCpos[WEST][X_DIRECTION],sizeof(fMWPCpos[WEST][X_DIRECTION]));
+	SetBranchAddress("wposy",&fMWPCpos[WEST][Y_DIRECTION],sizeof(fMWPCpos[WEST][Y_DIRECTION]));
 	
-	Tch->SetBranchAddress("te",&fTime[EAST]);
-	Tch->SetBranchAddress("tw",&fTime[WEST]);
+	SetBranchAddress("te",&fTime[EAST],sizeof(fTime[EAST]));
+	SetBranchAddress("tw",&fTime[WEST],sizeof(fTime[WEST]));
 	
-	Tch->SetBranchAddress("X",&fPrimPos[X_DIRECTION]);
-	Tch->SetBranchAddress("Y",&fPrimPos[Y_DIRECTION]);
-	Tch->SetBranchAddress("Z",&fPrimPos[Z_DIRECTION]);
+	SetBranchAddress("X",&fPrimPos[X_DIRECTION],sizeof(fPrimPos[X_DIRECTION]));
+	SetBranchAddress("Y",&fPrimPos[Y_DIRECTION],sizeof(fPrimPos[Y_DIRECTION]));
+	SetBranchAddress("Z",&fPrimPos[Z_DIRECTION],sizeof(fPrimPos[Z_DIRECTION]));
 	
-	Tch->SetBranchAddress("E",&fEprim);
-	Tch->SetBranchAddress("W",&fCostheta);
+	SetBranchAddress("E",&fEprim,sizeof(fEprim));
+	SetBranchAddress("W",&fCostheta,sizeof(fCostheta));
 }
 
 void G4toPMT::doUnits() {
@@ -139,6 +184,73 @@ void G4toPMT::doUnits() {
 	costheta=cos(costheta);
 }
 
+ReducedG4toPMT::ReducedG4toPMT(): Sim2PMT("anaTree"), pEQ(fEQ), pEW(fEW), pScintPos(fScintPos[0]), pMWPCpos(fMWPCpos[0]),
+pTime(fTime), pCostheta(&fCostheta), pEprim(&fEprim) {
+	setMappedInput();
+	for(Side s = EAST; s <= WEST; ++s)
+		eDep[s] = scintPos[s][Z_DIRECTION] = mwpcPos[s][Z_DIRECTION] = 0;
+	primPos[0] = primPos[1] = primPos[2] = primPos[3] = 0;
+}
+
+void ReducedG4toPMT::setReadpoints() {
+	// read in place from mapped file; float fields are the write buffers for convert()
+	bindPointer("EdepQ",(const void**)&pEQ,fEQ,sizeof(fEQ));
+	bindPointer("MWPCEnergy",(const void**)&pEW,fEW,sizeof(fEW));
+	bindPointer("ScintPos",(const void**)&pScintPos,fScintPos,sizeof(fScintPos));
+	bindPointer("MWPCPos",(const void**)&pMWPCpos,fMWPCpos,sizeof(fMWPCpos));
+	bindPointer("time",(const void**)&pTime,fTime,sizeof(fTime));
+	bindPointer("costheta",(const void**)&pCostheta,&fCostheta,sizeof(fCostheta));
+	bindPointer("primKE",(const void**)&pEprim,&fEprim,sizeof(fEprim));
+}
+
+void ReducedG4toPMT::doUnits() {
+	for(Side s = EAST; s <= WEST; ++s) {
+		eQ[s] = pEQ[s];
+		eW[s] = pEW[s];
+		time[s] = pTime[s];
+		for(unsigned int i=0; i<2; i++) {
+			scintPos[s][i] = pScintPos[2*s+i];
+			mwpcPos[s][i] = pMWPCpos[2*s+i];
+			wires[s][i].center = mwpcs[s].pos[i] = mwpcPos[s][i];
+		}
+	}
+	costheta = *pCostheta;
+	ePrim = *pEprim;
+}
+
+void ReducedG4toPMT::reduce(const Sim2PMT& S) {
+	for(Side s = EAST; s <= WEST; ++s) {
+		fEQ[s] = S.eQ[s];
+		fEW[s] = S.eW[s];
+		fTime[s] = S.time[s];
+		for(unsigned int i=0; i<2; i++) {
+			fScintPos[s][i] = S.scintPos[s][i];
+			fMWPCpos[s][i] = S.mwpcPos[s][i];
+		}
+	}
+	fCostheta = S.costheta;
+	fEprim = S.ePrim;
+}
+
+bool ReducedG4toPMT::convert(G4toPMT& G, const std::string& fname) {
+	if(!G.nEvents)
+		return false;
+	ReducedG4toPMT R;
+	R.setReadpoints();
+	EventCache C(R.bindings);
+	if(!C.create(fname,G.nEvents))
+		return false;
+	printf("Reducing %i simulated events to '%s'...\n",G.nEvents,fname.c_str());
+	for(unsigned int e=0; e<G.nEvents; e++) {
+		G.speedload(e);
+		G.doUnits();
+		R.reduce(G);
+		C.fill();
+	}
+	G.startScan();
+	return C.close();
+}
+
 void PenelopeToPMT::doUnits() {
 	const double wcPosConversion = 10.0;
 	for(unsigned int i=0; i<3; i++)
@@ -164,71 +276,114 @@ void PenelopeToPMT::doUnits() {
 void MixSim::startScan(unsigned int startRandom) {
 	for(std::vector<Sim2PMT*>::iterator it = subSims.begin(); it != subSims.end(); it++)
 		(*it)->startScan(startRandom);
+	// sub-simulations restart, so read-ahead events are not part of the new scan (same sequence as event-by-event)
+	discardBuffers();
+}
+
+void MixSim::discardBuffers() {
+	for(unsigned int i=0; i<eventBuffers.size(); i++) {
+		eventBuffers[i].clear();
+		bufferPos[i] = 0;
+	}
+}
+
+void MixSim::buildAliasTable() {
+	const unsigned int n = subSims.size();
+	std::vector<double> p(n);
+	double total = 0;
+	for(unsigned int i=0; i<n; i++)
+		total += p[i] = getStrength(i);
+	assert(total > 0);
+	
+	// Vose's method: pair each under-full column with an over-full one
+	aliasProb.assign(n,1.0);
+	aliasIdx.resize(n);
+	std::vector<unsigned int> lo, hi;
+	for(unsigned int i=0; i<n; i++) {
+		aliasIdx[i] = i;
+		p[i] *= n/total;
+		if(p[i] < 1) lo.push_back(i);
+		else hi.push_back(i);
+	}
+	while(lo.size() && hi.size()) {
+		const unsigned int l = lo.back();
+		const unsigned int h = hi.back();
+		lo.pop_back();
+		aliasProb[l] = p[l];
+		aliasIdx[l] = h;
+		p[h] -= 1.0-p[l];
+		if(p[h] < 1) {
+			hi.pop_back();
+			lo.push_back(h);
+		}
+	}
+	aliasValid = true;
 }
 
 bool MixSim::nextPoint() {
-	assert(cumStrength.size());
-	std::vector<double>::iterator sline = std::lower_bound(cumStrength.begin(),cumStrength.end(),mc_rnd_source.Uniform(0,cumStrength.back()));
-	unsigned int i = sline-cumStrength.begin();
-	assert(i<subSims.size());
+	assert(subSims.size());
+	if(!aliasValid)
+		buildAliasTable();
+	
+	// select sub-simulation from alias table
+	const double u = mc_rnd_source.Rndm()*subSims.size();
+	unsigned int i = std::min((unsigned int)u,(unsigned int)subSims.size()-1);
+	if(u-i >= aliasProb[i])
+		i = aliasIdx[i];
 	currentSim = subSims[i];
-	currentSim->nextPoint();
 	
-	// copy over simulation info
-	for(Side s = EAST; s <= WEST; ++s) {
-		eQ[s]=currentSim->eQ[s];
-		eDep[s]=currentSim->eDep[s];
-		eW[s]=currentSim->eW[s];
-		time[s]=currentSim->time[s];
-		for(unsigned int a=0; a<3; a++) {
-			scintPos[s][a]=currentSim->scintPos[s][a];
-			mwpcPos[s][a]=currentSim->mwpcPos[s][a];
-		}
+	if(!bufferSize) {
+		currentSim->nextPoint();
+		copySimEvent(*currentSim,*this);
+		return true;
 	}
-	for(unsigned int a=0; a<4; a++)
-		primPos[a] = currentSim->primPos[a];
-	costheta = currentSim->costheta;
-	ePrim = currentSim->ePrim;
-	physicsWeight = currentSim->physicsWeight;
 	
-	// copy over data info
-	for(Side s = EAST; s <= WEST; ++s) {
-		scints[s] = currentSim->scints[s];
-		led_pd[s] = currentSim->led_pd[s];
-		mwpcs[s] = currentSim->mwpcs[s];
-		mwpcEnergy[s] = currentSim->mwpcEnergy[s];
-		for(unsigned int d = X_DIRECTION; d <= Y_DIRECTION; d++)
-			wires[s][d] = currentSim->wires[s][d];
+	// refill sub-simulation's buffer in one sequential pass through its input
+	std::vector<SimEventRecord>& B = eventBuffers[i];
+	if(bufferPos[i] >= B.size()) {
+		B.resize(bufferSize);
+		for(unsigned int n=0; n<bufferSize; n++) {
+			currentSim->nextPoint();
+			copySimEvent(*currentSim,B[n]);
+		}
+		bufferPos[i] = 0;
 	}
-	runClock = currentSim->runClock;
-	fPID = currentSim->fPID;
-	fType = currentSim->fType;
-	fSide = currentSim->fSide;
+	copySimEvent(B[bufferPos[i]++],*this);
 	
 	return true;
 }
 
 void MixSim::addSim(Sim2PMT* S, double r0, double thalf) {
 	subSims.push_back(S);
+	S->simKernelTol = 0;	// sub-simulations share mixture's response tables
 	initStrength.push_back(r0);
 	halflife.push_back(thalf);
-	cumStrength.push_back((cumStrength.size()?cumStrength.back():0)+exp((t0-t1)*log(2)/thalf)*r0);
+	eventBuffers.push_back(std::vector<SimEventRecord>());
+	bufferPos.push_back(0);
+	aliasValid = false;
 }
 
 void MixSim::setTime(double t) {
-	for(unsigned int i=0; i<halflife.size(); i++)
-		cumStrength[i] = (i?cumStrength[i-1]:0)+exp((t0-t1)*log(2)/halflife[i])*initStrength[i];
+	if(t == t1)
+		return;
+	t1 = t;
+	aliasValid = false;
+	discardBuffers();
 }
 
 void MixSim::setAFP(AFPState a) {
 	for(std::vector<Sim2PMT*>::iterator it = subSims.begin(); it != subSims.end(); it++)
 		(*it)->setAFP(a);
 	Sim2PMT::setAFP(a);
+	discardBuffers();
 }
 
 void MixSim::setCalibrator(PMTCalibrator& PCal) {
-	for(std::vector<Sim2PMT*>::iterator it = subSims.begin(); it != subSims.end(); it++)
+	Sim2PMT::setCalibrator(PCal);
+	for(std::vector<Sim2PMT*>::iterator it = subSims.begin(); it != subSims.end(); it++) {
 		(*it)->setCalibrator(PCal);
-	Sim2PMT::setCalibrator(PCal);	
+		(*it)->setKernel(simKernel);
+	}
+	discardBuffers();
 }
 
@@ -12,14 +12,24 @@ class Sim2PMT: public ProcessedDataScanner {
 public:
 	/// constructor
 	Sim2PMT(const std::string& treeName);
+	/// destructor
+	virtual ~Sim2PMT();
 	
-	/// set calibrator to use for simulations
+	/// set calibrator to use for simulations (tabulating its response if simKernelTol > 0)
 	virtual void setCalibrator(PMTCalibrator& PCal);
+	/// use shared tabulated response for simulations (built from current calibrator)
+	void setKernel(const SimResponseKernel* K);
 	
 	/// this does nothing for processed data
 	virtual void recalibrateEnergy() {}
 	/// overrides ProcessedDataScanner::nextPoint to insert reverse-calibrations
 	virtual bool nextPoint();
+	/// start scan, keying nextPoint random streams on seed, calibration run, AFP state, and this instance's scan count
+	virtual void startScan(unsigned int startRandom = 0);
+	/// start reproducible simulation sequence, keyed on seed, calibration run, and AFP state
+	void startSimSequence();
+	/// load and simulate i^th event of sequence, with random numbers depending only on sequence key and i
+	void simulateEvent(unsigned long long i);
 	
 	/// get true energy
 	virtual float getEtrue();
@@ -44,8 +54,12 @@ public:
 	double costheta;			//< primary event cos pitch angle
 	double ePrim;				//< primary event energy
 	double physicsWeight;		//< event spectrum re-weighting factor
+	float simKernelTol;			//< tolerance for tabulated detector response (0 to use PMTCalibrator directly)
 	
 protected:
+	/// key detector response random number streams for sequence event i
+	void setStreams(unsigned long long i);
+
 	/// perform unit conversions, etc.
 	virtual void doUnits() { assert(false); }
 	/// "reverse calibration" from simulated data
@@ -54,6 +68,13 @@ protected:
 	virtual void calcReweight();
 	
 	AFPState afp;				//< AFP state for data
+	unsigned long long seqKey;	//< random stream key for simulation sequence
+	unsigned int seqStart;		//< first input event of simulation sequence
+	unsigned long long seqEvent;	//< number of events simulated by nextPoint
+	const unsigned int instanceNum;	//< distinguishes random streams of separate instances
+	unsigned int nScans;			//< number of startScan calls, distinguishing streams of successive scans
+	static unsigned int nInstances;	//< number of Sim2PMT instances constructed
+	SimResponseKernel* simKernel;	//< tabulated response for current calibrator, if built here
 };
 
 
@@ -72,6 +93,40 @@ protected:
 };
 
 
+/// reads pre-reduced Geant4 simulation: unit-converted single-precision columns (memory-mapped EventCache format) of only the fields used for detector response
+class ReducedG4toPMT: public Sim2PMT {
+public:
+	/// constructor
+	ReducedG4toPMT();
+	/// copy unit-converted fields from reduced file
+	virtual void doUnits();
+	
+	/// write reduced file of all events loaded in G (including its unit conversions)
+	static bool convert(G4toPMT& G, const std::string& fname);
+	
+	float fEQ[2];			//< float version of scintillator quenched energy
+	float fEW[2];			//< float version of wirechamber energy
+	float fScintPos[2][2];	//< float version of scintillator transverse position
+	float fMWPCpos[2][2];	//< float version of MWPC transverse position
+	float fTime[2];			//< float version of time
+	float fCostheta;		//< float version of cos theta
+	float fEprim;			//< float version of primary energy
+	
+protected:
+	virtual void setReadpoints();
+	
+	const float* pEQ;			//< scintillator quenched energy [side], in mapped input
+	const float* pEW;			//< wirechamber energy [side], in mapped input
+	const float* pScintPos;		//< scintillator transverse position [side][direction], in mapped input
+	const float* pMWPCpos;		//< MWPC transverse position [side][direction], in mapped input
+	const float* pTime;			//< time [side], in mapped input
+	const float* pCostheta;		//< cos theta, in mapped input
+	const float* pEprim;		//< primary energy, in mapped input
+	/// copy current unit-converted event from S into float fields
+	void reduce(const Sim2PMT& S);
+};
+
+
 /// converts Robbie's Penelope data to PMT spectra
 class PenelopeToPMT: public Sim2PMT {
 public:
@@ -93,11 +148,64 @@ protected:
 };
 
 
+/// simulated event output fields, for buffering sub-simulation event streams
+struct SimEventRecord {
+	double eQ[2];				//< Scintillator quenched energy
+	double eDep[2];				//< Scintillator deposited energy
+	double eW[2];				//< Wirechamber deposited energy
+	double scintPos[2][3];		//< hit position in scintillator
+	double mwpcPos[2][3];		//< hit position in MWPC
+	double primPos[4];			//< primary event vertex position
+	double time[2];				//< hit time in each scintillator
+	double costheta;			//< primary event cos pitch angle
+	double ePrim;				//< primary event energy
+	double physicsWeight;		//< event spectrum re-weighting factor
+	ScintEvent scints[2];		//< scintillator data
+	Float_t led_pd[2];			//< reference photodiode
+	wireHit wires[2][2];		//< wirechamber data [side][plane]
+	MWPCevent mwpcs[2];			//< mwpc data
+	Float_t mwpcEnergy[2];		//< wirechamber energy deposition
+	BlindTime runClock;			//< time of event since run start
+	PID fPID;					//< analysis particle ID
+	EventType fType;			//< analysis event type
+	Side fSide;					//< analysis event side
+};
+
+/// copy simulated event output fields between Sim2PMT and/or SimEventRecord
+template<class From, class To>
+void copySimEvent(const From& S, To& D) {
+	for(Side s = EAST; s <= WEST; ++s) {
+		D.eQ[s] = S.eQ[s];
+		D.eDep[s] = S.eDep[s];
+		D.eW[s] = S.eW[s];
+		D.time[s] = S.time[s];
+		for(unsigned int a=0; a<3; a++) {
+			D.scintPos[s][a] = S.scintPos[s][a];
+			D.mwpcPos[s][a] = S.mwpcPos[s][a];
+		}
+		D.scints[s] = S.scints[s];
+		D.led_pd[s] = S.led_pd[s];
+		D.mwpcs[s] = S.mwpcs[s];
+		D.mwpcEnergy[s] = S.mwpcEnergy[s];
+		for(unsigned int d = X_DIRECTION; d <= Y_DIRECTION; d++)
+			D.wires[s][d] = S.wires[s][d];
+	}
+	for(unsigned int a=0; a<4; a++)
+		D.primPos[a] = S.primPos[a];
+	D.costheta = S.costheta;
+	D.ePrim = S.ePrim;
+	D.physicsWeight = S.physicsWeight;
+	D.runClock = S.runClock;
+	D.fPID = S.fPID;
+	D.fType = S.fType;
+	D.fSide = S.fSide;
+}
+
 /// mixes several simulations
 class MixSim: public Sim2PMT {
 public:
 	/// constructor
-	MixSim(double tinit=0): Sim2PMT(""), currentSim(NULL), t0(tinit), t1(tinit) {}
+	MixSim(double tinit=0): Sim2PMT(""), bufferSize(1024), currentSim(NULL), t0(tinit), t1(tinit), aliasValid(false) {}
 	
 	/// start scan
 	virtual void startScan(unsigned int startRandom = 0);
@@ -108,24 +216,39 @@ public:
 	void addSim(Sim2PMT* S, double r0, double thalf);
 	/// set simulation time (determines different line strengths)
 	void setTime(double t);
+	/// relative strength of sub-simulation i at current time
+	double getStrength(unsigned int i) const { return exp((t0-t1)*log(2)/halflife[i])*initStrength[i]; }
 	
 	/// set desired AFP state for simulation data
 	virtual void setAFP(AFPState a);
 	/// set calibrator to use for simulations
 	virtual void setCalibrator(PMTCalibrator& PCal);
 	
+	/// number of events simulated together from each sub-simulation (0 for event-by-event).
+	/// Buffered events are discarded by setTime, setAFP, and setCalibrator, which then skip the discarded events' inputs
+	/// (so differ from the event-by-event sequence), and by startScan, which restarts sub-simulations anyway.
+	unsigned int bufferSize;
+	
 protected:
 	
 	virtual void doUnits() { }
+	/// build alias table for sub-simulation selection from current strengths
+	void buildAliasTable();
+	/// drop buffered sub-simulation events (made with previous settings)
+	void discardBuffers();
 	
 	std::vector<Sim2PMT*> subSims;
 	std::vector<double> initStrength;
 	std::vector<double> halflife;
-	std::vector<double> cumStrength;
 	Sim2PMT* currentSim;
 	double t0;	//< initial time
 	double t1;	//< current time
 	
+	std::vector<double> aliasProb;		//< probability of keeping each alias table column's own sub-simulation
+	std::vector<unsigned int> aliasIdx;	//< alternate sub-simulation for each alias table column
+	bool aliasValid;					//< whether alias table is up-to-date with current time
+	std::vector< std::vector<SimEventRecord> > eventBuffers;	//< buffered simulated events from each sub-simulation
+	std::vector<unsigned int> bufferPos;	//< next unused event in each buffer
 };
 
 #endif
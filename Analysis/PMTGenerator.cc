@@ -2,19 +2,49 @@
 #include "QFile.hh"
 #include "strutils.hh"
 #include "PathUtils.hh"
-#include <TRandom3.h>
 #include <algorithm>
 #include <Math/DistFunc.h>
+#include <time.h>
+#include <unistd.h>
 
-TRandom3 sim_rnd_source;		
+unsigned int PMTGenerator::simSeed = 4357;
+unsigned long long PMTGenerator::nGenerators = 0;
 
 PMTGenerator::PMTGenerator(Side s, float xx, float yy): calcADC(true),
 x(xx), y(yy), dsx(0), dsy(0), dwx(0), dwy(0),
-presmear(0), larmorField(0), SNL(NULL), mySide(s) { }
+presmear(0), larmorField(0), normalPEMean(100), currentCal(NULL), kernel(NULL), SNL(NULL), mySide(s), resValid(false),
+rnd(CounterRNG::makeKey(simSeed,nGenerators++)) {
+	draws.fill(rnd);
+}
+
+void PMTGenerator::setSeed(unsigned int s) {
+	simSeed = s ? s : (unsigned int)CounterRNG::mix(time(NULL)^((unsigned long long)getpid()<<32));
+}
 
 void PMTGenerator::setCalibrator(PMTCalibrator* P) { 
 	assert(P);
 	currentCal = P;
+	kernel = NULL;
+	resValid = false;
+}
+
+void PMTGenerator::setKernel(const SimResponseKernel* K) {
+	assert(!K || &K->PCal == currentCal);
+	kernel = K;
+	resValid = false;
+}
+
+void PMTGenerator::calcResolution() {
+	assert(mySide == EAST || mySide == WEST);
+	resTot = 0;
+	for(unsigned int t=0; t<nBetaTubes; t++) {
+		if(kernel)
+			pmtRes[t] = kernel->nPEperKeV(mySide, t, x+dsx, y+dsy);
+		else
+			pmtRes[t] = currentCal->nPE(mySide, t, 300.0, x+dsx, y+dsy, 0)/300.0;
+		resTot += pmtRes[t];
+	}
+	resValid = true;
 }
 
 void PMTGenerator::setOffsets(float xxs, float yys, float xxw, float yyw) {
@@ -26,19 +56,14 @@ void PMTGenerator::setOffsets(float xxs, float yys, float xxw, float yyw) {
 	if(!(dsy==dsy)) dsy = -100;
 	if(!(dwx==dwx)) dwx = -100;
 	if(!(dwy==dwy)) dwy = -100;
-	for(Side s = EAST; s <= WEST; ++s) {
-		resTot[s] = 0;
-		for(unsigned int t=0; t<nBetaTubes; t++) {
-			pmtRes[s][t] = currentCal->nPE(s, t, 300.0, x+dsx, y+dsy, 0)/300.0;
-			resTot[s] += pmtRes[s][t];
-		}
-	}
+	resValid = false;	// recalculated when needed
 }
 
 ScintEvent PMTGenerator::generate(float en) {
 	float nPEtot = 0;
 	float restot = 0;
 	float tubeRes;
+	draws.fill(rnd);
 	if(en<=0) {
 		for(unsigned int t=0; t<nBetaTubes; t++)
 			sevt.tuben[t]=sevt.adc[t]=0;
@@ -46,23 +71,29 @@ ScintEvent PMTGenerator::generate(float en) {
 		return sevt;
 	}
 	if(larmorField) {
-		float pz = sim_rnd_source.Uniform(0.0,en);
+		float pz = rnd.Uniform(0.0,en);
 		float pxy = sqrt(en*en-pz*pz);
 		float rg = pxy/(300.0*larmorField);
-		float theta0 = sim_rnd_source.Uniform(0.0,2*PI);
-		float theta1 = sim_rnd_source.Uniform(0.0,2*PI);
-		float theta2 = sim_rnd_source.Uniform(0.0,2*PI);
+		float theta0 = rnd.Uniform(0.0,2*PI);
+		float theta1 = rnd.Uniform(0.0,2*PI);
+		float theta2 = rnd.Uniform(0.0,2*PI);
 		setOffsets(rg*(sin(theta0)+sin(theta1)), rg*(sin(theta0)+sin(theta1)), rg*(cos(theta2)-cos(theta1)), rg*(sin(theta2)-sin(theta1)));
 	}
-	//double correrr = sim_rnd_source.Gaus(0.0,1.0);
+	if(currentCal->scaleNoiseWithL && !resValid)
+		calcResolution();
+	//double correrr = rnd.Gaus(0.0,1.0);
 	for(unsigned int t=0; t<nBetaTubes; t++) {
+		// tabulated position response, shared by resolution and ADC calculations
+		const float eta = kernel ? kernel->eta(mySide,t,x+dsx,y+dsy) : 0;
 		float ent = en;
 		if(SNL) {
-			float eta = currentCal->eta(mySide,t,x+dsx,y+dsy);
-			ent = SNL->delinearize(mySide,t,en*eta)/eta;
+			float eta0 = kernel ? eta : currentCal->eta(mySide,t,x+dsx,y+dsy);
+			ent = SNL->delinearize(mySide,t,en*eta0)/eta0;
 		}
 		if(currentCal->scaleNoiseWithL)
-			tubeRes = pmtRes[mySide][t]*en;
+			tubeRes = pmtRes[t]*en;
+		else if(kernel)
+			tubeRes = kernel->nPE(mySide,t,en*eta);
 		else
 			tubeRes = currentCal->nPE(mySide,t,en,x+dsx,y+dsy,0);
 		if(presmear) {
@@ -72,20 +103,25 @@ ScintEvent PMTGenerator::generate(float en) {
 				tubeRes = 1.0/(1.0/tubeRes-1.0/(tubeRes+0.1));
 		}
 		restot += tubeRes;
-		float nPE = sim_rnd_source.PoissonD(tubeRes)*ent/en;
-		nPE += sim_rnd_source.Gaus(0.0,0.7); // analog smoothing by PMT
+		float nPE = CounterRNG::poissonFromVariates(tubeRes,draws.u[t],draws.g[t],normalPEMean)*ent/en;
+		nPE += 0.7*draws.g[nBetaTubes+t]; // analog smoothing by PMT
 		nPEtot += nPE;
 		sevt.tuben[t] = nPE/tubeRes*en;
 		
-		if(calcADC) { // ADC + pedestal noise
+		if(calcADC && kernel) {
+			sevt.adc[t] = kernel->invertLinearity(mySide,t,sevt.tuben[t].x*eta);
+			sevt.adc[t] += kernel->getPedwidth(mySide,t)*draws.g[2*nBetaTubes+t];
+		} else if(calcADC) { // ADC + pedestal noise
 			sevt.adc[t] = currentCal->invertCorrections(mySide,t,sevt.tuben[t].x,x+dsx,y+dsy,0); 
 			float pedw = currentCal->getPedwidth(currentCal->sensorNames[mySide][t],0.0);
-			sevt.adc[t] += sim_rnd_source.Gaus(0.0,pedw);
-			//sevt.adc[t] += sim_rnd_source.Gaus(0.0,25);
-			//sevt.adc[t] += (correrr*0.7+sim_rnd_source.Gaus(0.0,0.7))*20.0;
+			sevt.adc[t] += pedw*draws.g[2*nBetaTubes+t];
+			//sevt.adc[t] += rnd.Gaus(0.0,25);
+			//sevt.adc[t] += (correrr*0.7+rnd.Gaus(0.0,0.7))*20.0;
 		}
 	}
-	if(calcADC)
+	if(calcADC && kernel)
+		kernel->calibrateEnergy(mySide, x+dwx, y+dwy, sevt);
+	else if(calcADC)
 		currentCal->calibrateEnergy(mySide, x+dwx, y+dwy, sevt, 0);
 	else
 		sevt.energy = nPEtot/restot*en;
@@ -99,7 +135,7 @@ unsigned int PMTGenerator::triggers() {
 		nTrigs = 0;
 		unsigned int nZero = 0;
 		for(unsigned int t=0; t<nBetaTubes; t++) {
-			pmtTriggered[t] = sim_rnd_source.Uniform(0.0,1.0) < currentCal->trigEff(mySide,t,sevt.adc[t]);
+			pmtTriggered[t] = draws.u[nBetaTubes+t] < currentCal->trigEff(mySide,t,sevt.adc[t]);
 			if(sevt.adc[t] == 0) nZero++;
 			if(pmtTriggered[t]) nTrigs++;
 		}
@@ -116,11 +152,5 @@ unsigned int PMTGenerator::triggers() {
 void PMTGenerator::setPosition(float xx, float yy) {
 	x = xx;
 	y = yy;
-	for(Side s = EAST; s <= WEST; ++s) {
-		resTot[s] = 0;
-		for(unsigned int t=0; t<nBetaTubes; t++) {
-			pmtRes[s][t] = currentCal->nPE(s, t, 300.0, x, y, 0)/300.0;
-			resTot[s] += pmtRes[s][t];
-		}
-	}
+	resValid = false;
 }
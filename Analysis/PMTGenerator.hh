@@ -2,9 +2,11 @@
 #define SIMCALIBRATIONS_HH 1
 
 #include "EnergyCalibrator.hh"
+#include "CompiledCalibrator.hh"
 #include "SimNonlinearity.hh"
 #include "Types.hh"
 #include "EfficCurve.hh"
+#include "CounterRNG.hh"
 #include <vector>
 
 /// Class for generating PMT signals with energy resolution, efficiency considerations
@@ -17,6 +19,8 @@ public:
 	
 	/// load a PMTCalibrator for event generation
 	void setCalibrator(PMTCalibrator* P);
+	/// use tabulated response (built from current calibrator) for event generation; NULL to use calibrator directly
+	void setKernel(const SimResponseKernel* K);
 	
 	/// generate an event for a given quenched energy
 	ScintEvent generate(float en);
@@ -31,12 +35,20 @@ public:
 	/// set scint/wirechamber offsets
 	void setOffsets(float xxs, float yys, float xxw, float yyw);
 	/// set event side
-	void setSide(Side s) { mySide = s; }
+	void setSide(Side s) { mySide = s; resValid = false; }
 	/// set nonlinearity
 	void setNonlinearity(SimNonlinearizer* snl) { SNL = snl; }
 	
 	/// get current calibrator
 	const PMTCalibrator* getCalibrator() const { return currentCal; }
+	/// get current tabulated response
+	const SimResponseKernel* getKernel() const { return kernel; }
+	/// start random number stream for next generated event, so results depend only on the stream key
+	void setStream(unsigned long long k) { rnd.setKey(k); }
+	/// set base seed for simulation random number streams (0 for unique seed)
+	static void setSeed(unsigned int s);
+	/// get base seed for simulation random number streams
+	static unsigned int getSeed() { return simSeed; }
 	
 	bool calcADC;					//< whether to calculate PMT ADCs and trigger efficiency
 	
@@ -45,19 +57,30 @@ public:
 	float dwx,dwy;					//< wirechamber hit offset from source position
 	float presmear;					//< nPE/keV already smeared in input spectrum
 	float larmorField;				//< optional field spreading out hit positions (0 for no effect, and use ds*, dw* for offsets)
+	float normalPEMean;				//< mean nPE above which photoelectron counts are drawn from normal approximation
 	
 	unsigned int nTrigs;			//< number of individual PMTs triggered
 	bool pmtTriggered[nBetaTubes];	//< whether each PMT triggered above threshold
 	
 protected:
 
+	/// nPE per keV for each tube on current side at current scintillator position
+	void calcResolution();
+	
 	PMTCalibrator* currentCal;		//< current PMT Calibrator in use
+	const SimResponseKernel* kernel;	//< optional tabulated response for currentCal
 	SimNonlinearizer* SNL;			//< nonlinearization
 	
 	Side mySide;					//< side to simulate
-	float pmtRes[2][nBetaTubes];	//< individual PMT nPE per keV
-	float resTot[2];				//< total resolution nPE per keV for all 4 tubes
+	bool resValid;					//< whether pmtRes, resTot are calculated for current side and position
+	float pmtRes[nBetaTubes];		//< individual PMT nPE per keV on current side
+	float resTot;					//< total resolution nPE per keV for all 4 tubes
 	ScintEvent sevt;				//< current generated event
+	CounterRNG rnd;					//< random number stream
+	VariateBlock<2*nBetaTubes,3*nBetaTubes> draws;	//< random variates for current event: uniform [PE, trigger], gaussian [PE, smoothing, pedestal]
+	
+	static unsigned int simSeed;				//< base seed for random number streams
+	static unsigned long long nGenerators;		//< number of generators created, for default stream keys
 };
 
 #endif
@@ -32,16 +32,16 @@ void PostAnalyzer::setReadpoints() {
 		
 		for(int p=0; p<2; p++) {
 			sprintf(tmp,"Wires_%c%c",sideNames(s),pl[p]);
-			Tch->SetBranchAddress(tmp,&wires[s][p]);
+			SetBranchAddress(tmp,&wires[s][p],sizeof(wires[s][p]));
 		}
 		
 		sprintf(tmp,"MWPC_%c",sideNames(s));
-		Tch->SetBranchAddress(tmp,&mwpcs[s]);
+		SetBranchAddress(tmp,&mwpcs[s],sizeof(mwpcs[s]));
 		
 		sprintf(tmp,"BetaSc%c",sideNames(s));
-		Tch->SetBranchAddress(tmp,&scints[s]);
+		SetBranchAddress(tmp,&scints[s],sizeof(scints[s]));
 		sprintf(tmp,"BetaSc%c_led_pd",sideNames(s));
-		Tch->SetBranchAddress(tmp,&led_pd[s]);
+		SetBranchAddress(tmp,&led_pd[s],sizeof(led_pd[s]));
 	}
-	Tch->SetBranchAddress("Trigger",&trig);	
+	SetBranchAddress("Trigger",&trig,sizeof(trig));	
 }
@@ -7,7 +7,7 @@
 class PostAnalyzer: public ProcessedDataScanner {
 public:
 	/// constructor
-	PostAnalyzer(bool withCalibrators = false): ProcessedDataScanner("OutTree",withCalibrators) {}
+	PostAnalyzer(bool withCalibrators = false): ProcessedDataScanner("OutTree",withCalibrators) { addCacheColumn("trig",&trig,sizeof(trig)); }
 	
 	/// add run to chain
 	virtual unsigned int addRun(RunNum r);
@@ -1,8 +1,16 @@
 #include "PostOfficialAnalyzer.hh"
 #include "PathUtils.hh"
-#include "CalDBSQL.hh"
 #include <utility>
 
+PostOfficialAnalyzer::PostOfficialAnalyzer(bool withCalibrators): ProcessedDataScanner("phys",withCalibrators) {
+	addCacheColumn("Etrue",&Etrue,sizeof(Etrue));
+	addCacheColumn("cathodes",fCathodes,sizeof(fCathodes));
+	for(Side s=EAST; s<=WEST; ++s)
+		for(int p=X_DIRECTION; p<=Y_DIRECTION; p++)
+			cathodes[s][p] = fCathodes[s][p];
+	addCacheColumn("mwpcEnergy",mwpcEnergy,sizeof(mwpcEnergy));
+}
+
 std::string PostOfficialAnalyzer::locateRun(RunNum r) {
 	std::vector<std::string> fpaths;
 	fpaths.push_back(getEnvSafe("UCNAOUTPUTDIR")+"/hists/spec_"+itos(r)+".root");
@@ -13,13 +21,27 @@ std::string PostOfficialAnalyzer::locateRun(RunNum r) {
 	return "";
 }
 
-unsigned int PostOfficialAnalyzer::addRun(RunNum r) {
+std::string PostOfficialAnalyzer::locateFlatFile(RunNum r) {
 	std::string f = locateRun(r);
+	if(!f.size())
+		return f;
+	std::string ff = f.substr(0,f.rfind('.'))+".flat";
+	if(!fileExists(ff) || fileAge(ff) > fileAge(f)) {
+		PostOfficialAnalyzer P;
+		P.setEventCache("");
+		if(!P.addFile(f) || !P.writeFlatFile(ff))
+			return "";
+	}
+	return ff;
+}
+
+unsigned int PostOfficialAnalyzer::addRun(RunNum r) {
+	std::string f = Tch ? locateRun(r) : locateFlatFile(r);
 	if(f.size() && addFile(f)) {
 		ProcessedDataScanner::addRun(r);
 		if(withCals)
 			PCals.insert(std::make_pair(r,new PMTCalibrator(r,CDB)));
-		BlindTime b = CalDBSQL::getCDB()->fiducialTime(r);
+		BlindTime b = CDB->fiducialTime(r);
 		if(!b.t[BOTH])
 			printf("**** WARNING: Run %i has zero fiducial time!\n",r);
 		totalTime += b;
@@ -33,30 +55,30 @@ unsigned int PostOfficialAnalyzer::addRun(RunNum r) {
 void PostOfficialAnalyzer::setReadpoints() {
 	
 	// reconstructed energy
-	Tch->SetBranchAddress("Etrue",&Etrue);
+	SetBranchAddress("Etrue",&Etrue,sizeof(Etrue));
 	// event ID
-	Tch->SetBranchAddress("PID",&fPID);
-	Tch->SetBranchAddress("Side",&fSide);
-	Tch->SetBranchAddress("Type",&fType);
+	SetBranchAddress("PID",&fPID,sizeof(fPID));
+	SetBranchAddress("Side",&fSide,sizeof(fSide));
+	SetBranchAddress("Type",&fType,sizeof(fType));
 	// clock
-	Tch->SetBranchAddress("TimeE",&runClock.t[EAST]);
-	Tch->SetBranchAddress("TimeW",&runClock.t[WEST]);
+	SetBranchAddress("TimeE",&runClock.t[EAST],sizeof(runClock.t[EAST]));
+	SetBranchAddress("TimeW",&runClock.t[WEST],sizeof(runClock.t[WEST]));
 	runClock.t[BOTH]=runClock.t[NONE]=0.0;
 	
 	for(Side s=EAST; s<=WEST; ++s) {
 		
 		// wirechamber planes
 		for(int p=X_DIRECTION; p<=Y_DIRECTION; p++) {
-			Tch->SetBranchAddress((std::string(p==X_DIRECTION?"x":"y")+sideSubst("%cmpm",s)).c_str(),&wires[s][p]);
-			Tch->SetBranchAddress((sideSubst("Cathodes_%c",s)+(p==X_DIRECTION?"x":"y")).c_str(),cathodes[s][p]);
+			SetBranchAddress((std::string(p==X_DIRECTION?"x":"y")+sideSubst("%cmpm",s)).c_str(),&wires[s][p],sizeof(wires[s][p]));
+			bindPointer((sideSubst("Cathodes_%c",s)+(p==X_DIRECTION?"x":"y")),(const void**)&cathodes[s][p],fCathodes[s][p],sizeof(fCathodes[s][p]));
 		}
 		
 		// beta scintillators
-		Tch->SetBranchAddress(sideSubst("Scint%c",s).c_str(),&scints[s]);
+		SetBranchAddress(sideSubst("Scint%c",s),&scints[s],sizeof(scints[s]));
 		
 		// MWPC totals
-		Tch->SetBranchAddress(sideSubst("Anode%c",s).c_str(),&mwpcs[s].anode);
-		Tch->SetBranchAddress(sideSubst("CathSum%c",s).c_str(),&mwpcs[s].cathodeSum);
-		Tch->SetBranchAddress(sideSubst("EMWPC_%c",s).c_str(),&mwpcEnergy[s]);
+		SetBranchAddress(sideSubst("Anode%c",s),&mwpcs[s].anode,sizeof(mwpcs[s].anode));
+		SetBranchAddress(sideSubst("CathSum%c",s),&mwpcs[s].cathodeSum,sizeof(mwpcs[s].cathodeSum));
+		SetBranchAddress(sideSubst("EMWPC_%c",s),&mwpcEnergy[s],sizeof(mwpcEnergy[s]));
 	}
 }
@@ -7,16 +7,19 @@
 class PostOfficialAnalyzer: public ProcessedDataScanner {
 public:
 	/// constructor
-	PostOfficialAnalyzer(bool withCalibrators = false): ProcessedDataScanner("phys",withCalibrators) {}
+	PostOfficialAnalyzer(bool withCalibrators = false);
 	
 	/// add run file
 	virtual unsigned int addRun(RunNum r);
 	
 	/// find path to processed run .root file
 	static std::string locateRun(RunNum r);	
+	/// find path to flat file for memory-mapped input, converting from .root file if needed
+	static std::string locateFlatFile(RunNum r);
 	
 	float Etrue;				//< reconstructed "true" energy
-	float cathodes[2][2][16];	//< pedestal-subtracted cathode values
+	const float* cathodes[2][2];	//< pedestal-subtracted cathode values for each [side][plane], pointing into mapped input when available
+	float fCathodes[2][2][16];		//< readout buffer for cathode values (TChain or event cache input)
 	
 protected:
 	/// set TChain branch data readpoints
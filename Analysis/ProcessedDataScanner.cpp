@@ -2,14 +2,52 @@
 #include "PathUtils.hh"
 #include "CalDBSQL.hh"
 #include "CalDBFake.hh"
+#include "CalDBSnapshot.hh"
 #include <cassert>
+#include <algorithm>
 #include <stdio.h>
 #include <stdlib.h>
 
+const float EventSkim::radiusBin = 5.0;
+
+EventSkim::EventSkim(PID p, unsigned int typeMask, float rmax): maxRadius(rmax) {
+	for(unsigned int i=0; i<=PID_PULSER; i++)
+		pids[i] = (i==p);
+	for(unsigned int i=0; i<=TYPE_IV_EVENT; i++)
+		types[i] = typeMask & (1<<i);
+	for(unsigned int i=0; i<=BADSIDE; i++)
+		sides[i] = true;
+}
+
+unsigned int EventSkim::makeKey(PID p, EventType tp, Side s, float r) {
+	unsigned int rb = nRadiusBins-1;
+	if(r >= 0 && r < radiusBin*(nRadiusBins-1))
+		rb = (unsigned int)(r/radiusBin);
+	return (((unsigned int)p*8+(unsigned int)tp)*8+(unsigned int)s)*nRadiusBins+rb;
+}
+
+bool EventSkim::select(unsigned int key) const {
+	const unsigned int rb = key%nRadiusBins;
+	key /= nRadiusBins;
+	const unsigned int s = key%8;
+	key /= 8;
+	const unsigned int tp = key%8;
+	const unsigned int p = key/8;
+	if(p > PID_PULSER || tp > TYPE_IV_EVENT || s > BADSIDE)
+		return false;
+	return pids[p] && types[tp] && sides[s] && (!maxRadius || rb*radiusBin < maxRadius);
+}
+
+//-----------------------------------------------------
+
 ProcessedDataScanner::ProcessedDataScanner(const std::string& treeName, bool withCalibrators):
 TChainScanner(treeName), ActiveCal(NULL), totalTime(0),
-anChoice(ANCHOICE_A), fiducialRadius(50.0), withCals(withCalibrators) {
-	CDB = CalDBSQL::getCDB();
+anChoice(ANCHOICE_A), fiducialRadius(50.0), loadedEvent(0), recalBlockSize(0),
+recalCompiledTol(0), recalEventSize(0), withCals(withCalibrators),
+cacheDir(getEnvSafe("UCNA_EVENT_CACHE","")), activeCache(NULL) {
+	if(TChainBackend* TB = dynamic_cast<TChainBackend*>(backend))
+		TB->preloadBaskets = true;
+	CDB = CalDBSnapshot::getActiveCDB();
 	if(!CDB->isValid(15926)) {
 		printf("\n**** WARNING: Fake Calibrations in use!!! ****\n\n");
 		assert(IGNORE_DEAD_DB);
@@ -17,14 +55,34 @@ anChoice(ANCHOICE_A), fiducialRadius(50.0), withCals(withCalibrators) {
 	}
 	runClock = 0;
 	nAFP[0]=nAFP[1]=0;
+	
+	// readout fields for event caches
+	for(Side s = EAST; s <= WEST; ++s) {
+		addCacheColumn(sideSubst("scints_%c",s),&scints[s],sizeof(scints[s]));
+		addCacheColumn(sideSubst("led_pd_%c",s),&led_pd[s],sizeof(led_pd[s]));
+		for(unsigned int d = X_DIRECTION; d <= Y_DIRECTION; d++)
+			addCacheColumn(sideSubst("wires_%c",s)+(d==X_DIRECTION?"x":"y"),&wires[s][d],sizeof(wires[s][d]));
+		addCacheColumn(sideSubst("mwpcs_%c",s),&mwpcs[s],sizeof(mwpcs[s]));
+	}
+	addCacheColumn("runClock",&runClock,sizeof(runClock));
+	addCacheColumn("PID",&fPID,sizeof(fPID));
+	addCacheColumn("Type",&fType,sizeof(fType));
+	addCacheColumn("Side",&fSide,sizeof(fSide));
 }
 
 ProcessedDataScanner::~ProcessedDataScanner() { 
+	for(std::map<RunNum,CompiledCalibrator*>::iterator it=CCals.begin(); it !=CCals.end(); it++)
+		delete it->second;
 	for(std::map<RunNum,PMTCalibrator*>::iterator it=PCals.begin(); it !=PCals.end(); it++)
 		delete it->second;
+	for(std::vector<EventCache*>::iterator it = evtCaches.begin(); it != evtCaches.end(); it++)
+		delete *it;
 }
 
 unsigned int ProcessedDataScanner::addRuns(const std::vector<RunNum>& rns) {
+	CalDBSQL* CDBSQL = dynamic_cast<CalDBSQL*>(CDB);
+	if(CDBSQL)
+		CDBSQL->prefetch(rns);
 	printf("\n------------------- Assembling %i runs into TChain... ",(int)rns.size()); fflush(stdout);
 	unsigned int n = 0;
 	for(std::vector<RunNum>::const_iterator it = rns.begin(); it != rns.end(); it++) {
@@ -39,7 +97,7 @@ void ProcessedDataScanner::display() {
 	printf("ProcessedDataScanner: %i runs, %i events [%i Off, %i On]\n",getnFiles(),nEvents,nAFP[0],nAFP[1]);
 	if(runlist.size()>=getnFiles()) {
 		for(unsigned int i=0; i<getnFiles(); i++) {
-			RunInfo R = CalDBSQL::getCDB()->getRunInfo(runlist[i]);
+			RunInfo R = CDB->getRunInfo(runlist[i]);
 			printf("\tRun %i: %i events\t",runlist[i],nnEvents[i]);
 			R.display();
 		}
@@ -51,15 +109,127 @@ void ProcessedDataScanner::writeCalInfo(QFile& qout, std::string tag) {
 		qout.insert(tag,it->second->calSummary());
 }
 
+void ProcessedDataScanner::setRecalibrationBlock(unsigned int n, float compiledTol) {
+	recalBlockSize = n;
+	recalCompiledTol = compiledTol;
+	recalBlockEvents.clear();
+}
+
+void ProcessedDataScanner::saveBlockEvent(unsigned int i) {
+	char* p = &recalEvents[i*recalEventSize];
+	for(std::vector<EventCacheColumn>::const_iterator it = cacheCols.begin(); it != cacheCols.end(); it++) {
+		memcpy(p,it->readout,it->size);
+		p += it->size;
+	}
+}
+
+void ProcessedDataScanner::loadBlockEvent(unsigned int i) {
+	const char* p = &recalEvents[i*recalEventSize];
+	for(std::vector<EventCacheColumn>::const_iterator it = cacheCols.begin(); it != cacheCols.end(); it++) {
+		memcpy(it->readout,p,it->size);
+		p += it->size;
+	}
+}
+
+void ProcessedDataScanner::fillRecalibrationBlock() {
+	const unsigned int e0 = loadedEvent;
+	const RunNum r0 = evtRun;
+	PMTCalibrator* PCal = ActiveCal;
+	
+	// block stays within current run's file and scan range
+	unsigned int e1 = rangeEnd && rangeEnd < nEvents ? rangeEnd : nEvents;
+	if(nLocalEvents && noffset+nLocalEvents < e1)
+		e1 = noffset+nLocalEvents;
+	
+	// block events: e0, then the following events to be scanned (only selected events, when skimming)
+	std::vector<unsigned int> evts(1,e0);
+	if(selector) {
+		for(std::vector<unsigned int>::const_iterator it = std::upper_bound(selected.begin(),selected.end(),e0);
+			it != selected.end() && *it < e1 && evts.size() < recalBlockSize; it++)
+			evts.push_back(*it);
+	} else {
+		for(unsigned int e = e0+1; e < e1 && evts.size() < recalBlockSize; e++)
+			evts.push_back(e);
+	}
+	const unsigned int n = evts.size();
+	
+	// gather inputs and readout fields in one forward pass, starting from already-loaded e0
+	recalEventSize = 0;
+	for(std::vector<EventCacheColumn>::const_iterator it = cacheCols.begin(); it != cacheCols.end(); it++)
+		recalEventSize += it->size;
+	if(Tch)
+		recalEvents.resize(n*recalEventSize);
+	recalBlockEvents.clear();	// read gathered events from input
+	for(Side s = EAST; s<=WEST; ++s)
+		recalBlock[s].resize(n);
+	for(unsigned int i = 0; i < n; i++) {
+		if(i)
+			speedload(evts[i]);
+		if(Tch)
+			saveBlockEvent(i);
+		for(Side s = EAST; s<=WEST; ++s)
+			recalBlock[s].setEvent(i, scints[s], wires[s][X_DIRECTION].center, wires[s][Y_DIRECTION].center, runClock.t[BOTH]);
+	}
+	if(Tch)
+		loadBlockEvent(0);
+	else
+		backend->speedload(e0);
+	loadedEvent = e0;
+	recalBlockEvents.swap(evts);
+	
+	// calibrate block
+	CompiledCalibrator* CCal = NULL;
+	if(recalCompiledTol > 0) {
+		std::map<RunNum,CompiledCalibrator*>::iterator it = CCals.find(r0);
+		if(it == CCals.end()) {
+			float tmax = CDB->totalTime(r0);
+			CCal = new CompiledCalibrator(*PCal,tmax>0?1.1*tmax+60.0:4000.0,recalCompiledTol);
+			if(CCal->validate() > recalCompiledTol) {
+				printf("*** Compiled calibration tables for run %i exceed tolerance %g; using direct calibration.\n",r0,recalCompiledTol);
+				delete CCal;
+				CCal = NULL;	// remembered, so tables are not rebuilt for each block
+			}
+			it = CCals.insert(std::make_pair(r0,CCal)).first;
+		}
+		CCal = it->second;
+	}
+	for(Side s = EAST; s<=WEST; ++s) {
+		if(CCal)
+			CCal->calibrateEnergy(s,recalBlock[s]);
+		else
+			PCal->calibrateEnergy(s,recalBlock[s]);
+	}
+}
+
+int ProcessedDataScanner::recalBlockSlot(unsigned int e) const {
+	if(!recalBlockEvents.size() || e < recalBlockEvents.front() || e > recalBlockEvents.back())
+		return -1;
+	std::vector<unsigned int>::const_iterator it = std::lower_bound(recalBlockEvents.begin(),recalBlockEvents.end(),e);
+	return *it == e ? it-recalBlockEvents.begin() : -1;
+}
+
 void ProcessedDataScanner::recalibrateEnergy() {
 	assert(ActiveCal);
+	int slot = recalBlockSize > 1 ? recalBlockSlot(loadedEvent) : -1;
+	if(recalBlockSize > 1 && slot < 0) {
+		fillRecalibrationBlock();
+		slot = 0;
+	}
 	for(Side s = EAST; s<=WEST; ++s) {
-		ActiveCal->calibrateEnergy(s, wires[s][X_DIRECTION].center, wires[s][Y_DIRECTION].center, scints[s], runClock.t[BOTH]);
+		if(recalBlockSize > 1)
+			recalBlock[s].getEvent(slot, scints[s]);
+		else
+			ActiveCal->calibrateEnergy(s, wires[s][X_DIRECTION].center, wires[s][Y_DIRECTION].center, scints[s], runClock.t[BOTH]);
 		mwpcEnergy[s] = ActiveCal->calibrateAnode(mwpcs[s].anode,s,wires[s][X_DIRECTION].center, wires[s][Y_DIRECTION].center, runClock.t[BOTH]);
 	}
 	calcEventFlags();
 }
 
+unsigned int ProcessedDataScanner::skimKey() {
+	// events without single side are never removed by radius selection
+	return EventSkim::makeKey(fPID,fType,fSide,(fSide==EAST||fSide==WEST)?radius(fSide):0);
+}
+
 bool ProcessedDataScanner::passesPositionCut(Side s) { return radius(s)<fiducialRadius; }
 
 float ProcessedDataScanner::getEtrue() {
@@ -68,15 +238,49 @@ float ProcessedDataScanner::getEtrue() {
 }
 
 void ProcessedDataScanner::speedload(unsigned int e) {
-	if(e < noffset || e-noffset >= nLocalEvents) {
-		Tch->LoadTree(e);
-		Tch->GetTree()->LoadBaskets();
-		nLocalEvents = Tch->GetTree()->GetEntries();
-		noffset = Tch->GetChainOffset();
-		if((int)runlist.size()>Tch->GetTreeNumber())
-			evtRun = runlist[Tch->GetTreeNumber()];
+	const bool newFile = e < noffset || e-noffset >= nLocalEvents;
+	const int slot = newFile ? -1 : recalBlockSlot(e);
+	if(slot >= 0) {
+		// already read into re-calibration block (from this run's file); memory-mapped input re-loaded in place, re-pointing pointer bindings
+		if(Tch)
+			loadBlockEvent(slot);
 		else
-			evtRun = Tch->GetTreeNumber();
+			backend->speedload(e);
+		loadedEvent = e;
+		return;
+	}
+	int fileNum = 0;
+	if(newFile)
+		activeCache = NULL;
+	if(newFile && evtCaches.size()) {
+		// locate file from event counts, for cached files
+		noffset = 0;
+		while(fileNum+1 < (int)nnEvents.size() && e >= noffset+nnEvents[fileNum])
+			noffset += nnEvents[fileNum++];
+		nLocalEvents = nnEvents[fileNum];
+		activeCache = fileNum < (int)evtCaches.size() ? evtCaches[fileNum] : NULL;
+		if(activeCache && backend->prefetchNext) {
+			if(fileNum+1 < (int)evtCaches.size() && evtCaches[fileNum+1])
+				evtCaches[fileNum+1]->prefetch();
+			else
+				backend->prefetchFile(fileNum+1);
+		}
+	}
+	if(activeCache) {
+		activeCache->load(e-noffset);
+	} else {
+		backend->speedload(e);
+		if(newFile) {
+			fileNum = backend->getFileNumber();
+			noffset = backend->getFileOffset();
+			nLocalEvents = backend->getFileEntries();
+		}
+	}
+	if(newFile) {
+		if((int)runlist.size()>fileNum)
+			evtRun = runlist[fileNum];
+		else
+			evtRun = fileNum;
 		if(withCals) {
 			std::map<RunNum,PMTCalibrator*>::iterator it = PCals.find(evtRun);
 			if(it == PCals.end()) {
@@ -86,12 +290,37 @@ void ProcessedDataScanner::speedload(unsigned int e) {
 			ActiveCal = it->second;
 		}
 	}
-	Tch->GetTree()->GetEvent(e-noffset);
+	loadedEvent = e;
+}
+
+EventCache* ProcessedDataScanner::openEventCache(RunNum rn) {
+	const std::string& src = fileNames.back();
+	std::string fname = cacheDir+"/"+src.substr(src.rfind('/')+1)+".evc";
+	EventCache* C = new EventCache(cacheCols);
+	if(fileExists(fname) && fileAge(fname) < fileAge(src) && C->open(fname) && C->size() == nnEvents.back())
+		return C;
+	
+	// (re)build cache from TChain
+	printf("\nBuilding event cache '%s' for run %i (%i events)...\n",fname.c_str(),rn,nnEvents.back());
+	if(C->create(fname,nnEvents.back())) {
+		for(unsigned int e = nEvents-nnEvents.back(); e < nEvents; e++) {
+			getEvent(e);
+			C->fill();
+		}
+		if(C->close() && C->open(fname))
+			return C;
+	}
+	delete C;
+	return NULL;
 }
 
 unsigned int ProcessedDataScanner::addRun(RunNum rn) {
 	runlist.push_back(rn);
-	RunInfo R = CalDBSQL::getCDB()->getRunInfo(rn);
+	if(cacheDir.size() && nnEvents.size()) {
+		evtCaches.resize(nnEvents.size(),NULL);
+		evtCaches.back() = openEventCache(rn);
+	}
+	RunInfo R = CDB->getRunInfo(rn);
 	if(R.afpState == AFP_OFF) nAFP[0] += nnEvents.back();
 	else if(R.afpState == AFP_ON) nAFP[1] += nnEvents.back();
 	return 1;
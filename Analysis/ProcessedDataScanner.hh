@@ -6,15 +6,36 @@
 
 #include "TChainScanner.hh"
 #include "EnergyCalibrator.hh"
+#include "CompiledCalibrator.hh"
 #include "WirechamberReconstruction.hh"
 
 #include "QFile.hh"
 #include "PMTGenerator.hh"
 #include "CalDBSQL.hh"
 #include "TagCounter.hh"
+#include "EventCache.hh"
 
 #include <map>
 
+/// skim selection on event particle ID, type, side, and radius (radius on event side, rounded up to skim bins)
+class EventSkim: public ScanSelector {
+public:
+	/// constructor, selecting events of given particle ID and types (bit mask) within radius rmax (0 for any radius)
+	EventSkim(PID p = PID_BETA, unsigned int typeMask = 1<<TYPE_0_EVENT, float rmax = 0);
+	/// whether events with given skim key are selected
+	virtual bool select(unsigned int key) const;
+	
+	bool pids[PID_PULSER+1];			//< selected particle IDs
+	bool types[TYPE_IV_EVENT+1];		//< selected event types
+	bool sides[BADSIDE+1];				//< selected event sides
+	float maxRadius;					//< maximum radius on event side (0 for any radius)
+	
+	static const float radiusBin;		//< radius bin width in skim key [mm]
+	static const unsigned int nRadiusBins = 16;	//< number of radius bins (last includes all larger radii)
+	/// make skim key from event classification
+	static unsigned int makeKey(PID p, EventType tp, Side s, float r);
+};
+
 /// Generic class for processed data TChains
 class ProcessedDataScanner: public TChainScanner {
 public:
@@ -38,6 +59,12 @@ public:
 	virtual float getEtrue();
 	/// re-calibrate tube energy of currently loaded event
 	virtual void recalibrateEnergy();
+	/// set directory for columnar event caches of subsequently added runs ("" to disable; default $UCNA_EVENT_CACHE)
+	void setEventCache(const std::string& dir) { cacheDir = dir; }
+	/// set number of events re-calibrated together in blocks (<=1 for event-by-event), optionally with lookup-table calibrators
+	void setRecalibrationBlock(unsigned int n, float compiledTol = 0);
+	/// whether energy re-calibrators are loaded
+	bool hasCalibrators() const { return withCals; }
 	/// speedload, keeping track of currently loaded run number
 	virtual void speedload(unsigned int e);
 	/// get run number of current event
@@ -79,11 +106,39 @@ protected:
 	
 	/// generate event classification flags
 	virtual void calcEventFlags() {}
+	/// skim index key from event classification and radius
+	virtual unsigned int skimKey();
+	/// load (once, in order) and re-calibrate block of events (selected events, if selection active) in current run starting at currently loaded event
+	void fillRecalibrationBlock();
+	/// slot of event e in current re-calibration block; -1 if not in block
+	int recalBlockSlot(unsigned int e) const;
+	/// save readout fields of currently loaded event to re-calibration block slot i
+	void saveBlockEvent(unsigned int i);
+	/// restore readout fields of event in re-calibration block slot i
+	void loadBlockEvent(unsigned int i);
+	/// add readout field to columnar event cache
+	void addCacheColumn(const std::string& nm, void* p, unsigned int sz) { cacheCols.push_back(EventCacheColumn(nm,p,sz)); }
+	/// open (or build from TChain) event cache for most recently added file, belonging to run rn
+	EventCache* openEventCache(RunNum rn);
+	
+	unsigned int loadedEvent;				//< event number most recently loaded by speedload
+	unsigned int recalBlockSize;			//< number of events to re-calibrate together
+	std::vector<unsigned int> recalBlockEvents;	//< (ascending) event numbers in current re-calibration block
+	float recalCompiledTol;					//< tolerance for lookup-table calibrators (0 to use PMTCalibrator)
+	ScintBlock recalBlock[2];				//< re-calibration block for each side
+	std::vector<char> recalEvents;			//< readout fields (cacheCols) of events in re-calibration block (TChain input; mapped input is re-loaded in place)
+	unsigned int recalEventSize;			//< bytes of readout fields per event
+	std::map<RunNum,CompiledCalibrator*> CCals;	//< lookup-table calibrators for each run (NULL if failed validation)
 	
 	bool withCals;							//< whether to use energy recalibrators
 	CalDB* CDB;								//< calibrations DB
 	std::vector<RunNum> runlist;			//< list of loaded runs
 	std::map<RunNum,PMTCalibrator*> PCals;	//< calibrators for each run
+	
+	std::string cacheDir;					//< directory for columnar event caches; "" for no caching
+	std::vector<EventCacheColumn> cacheCols;	//< fields stored in event caches
+	std::vector<EventCache*> evtCaches;		//< event cache for each loaded file (NULL if not cached)
+	EventCache* activeCache;				//< event cache for currently loaded file
 };
 
 #endif
@@ -6,7 +6,7 @@
 #include "G4toPMT.hh"
 #include "PathUtils.hh"
 #include "SourceDBSQL.hh"
-#include "CalDBSQL.hh"
+#include "CalDBSnapshot.hh"
 #include <TSpectrum.h>
 #include <TSpectrum2.h>
 #include <utility>
@@ -214,8 +214,8 @@ void reSource(RunNum rn) {
 	
 	// set up output paths
 	std::string outPath = "../PostPlots/LivermoreSources/";
-	PMTCalibrator PCal(rn,CalDBSQL::getCDB());
-	RunInfo RI = CalDBSQL::getCDB()->getRunInfo(rn);
+	PMTCalibrator PCal(rn,CalDBSnapshot::getActiveCDB());
+	RunInfo RI = CalDBSnapshot::getActiveCDB()->getRunInfo(rn);
 	OutputManager TM("Run_"+itos(RI.runNum), outPath);
 	TM.dataPath = outPath+"/RunData/";
 	TM.plotPath = TM.basePath = outPath+"/Plots/"+replace(RI.groupName,' ','_')+"/"+itos(rn)+"_"+RI.roleName+"/";
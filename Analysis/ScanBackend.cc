@@ -0,0 +1,99 @@
+#include "ScanBackend.hh"
+#include <cassert>
+
+TChainBackend::TChainBackend(const std::string& treeName): Tch(new TChain(treeName.c_str())), preloadBaskets(false),
+noffset(0), nLocalEvents(0) {
+	Tch->SetMaxVirtualSize(100000000);
+}
+
+TChainBackend::~TChainBackend() {
+	delete(Tch);
+}
+
+std::string TChainBackend::getFileName(unsigned int n) const {
+	TObjArray* L = Tch->GetListOfFiles();
+	if(!L || (int)n >= L->GetEntriesFast())
+		return "";
+	return L->At(n)->GetTitle();
+}
+
+void TChainBackend::speedload(unsigned int e) {
+	if(e < noffset || e-noffset >= nLocalEvents) {
+		Tch->LoadTree(e);
+		// next file read ahead while this tree's baskets are decompressed and scanned
+		if(preloadBaskets)
+			Tch->GetTree()->LoadBaskets(prefetcher.budget);
+		else
+			Tch->GetTree()->SetMaxVirtualSize(10000000);
+		if(prefetchNext)
+			prefetchFile(Tch->GetTreeNumber()+1);
+		nLocalEvents = Tch->GetTree()->GetEntries();
+		noffset = Tch->GetChainOffset();
+	}
+	Tch->GetTree()->GetEvent(e-noffset);
+}
+
+//-----------------------------------------------------
+
+MappedBackend::~MappedBackend() {
+	for(std::vector<EventCache*>::iterator it = files.begin(); it != files.end(); it++)
+		delete *it;
+}
+
+int MappedBackend::addFile(const std::string& fname) {
+	EventCache* C = new EventCache();
+	if(!C->open(fname)) {
+		delete C;
+		return 0;
+	}
+	files.push_back(C);
+	fileNames.push_back(fname);
+	offsets.push_back(nEntries);
+	nEntries += C->size();
+	return 1;
+}
+
+void MappedBackend::setBranchAddress(const std::string& bname, void* bdata, unsigned int sz) {
+	assert(bdata);
+	Binding b;
+	b.name = bname;
+	b.readout = (char*)bdata;
+	b.ptr = NULL;
+	b.data = NULL;
+	b.size = sz;
+	bindings.push_back(b);
+	currentFile = -1;
+}
+
+void MappedBackend::bindPointer(const std::string& bname, const void** p, void* bdata, unsigned int sz) {
+	assert(p);
+	setBranchAddress(bname,bdata,sz);
+	bindings.back().ptr = p;
+	*p = bdata;
+}
+
+void MappedBackend::selectFile(unsigned int e) {
+	assert(e < nEntries);
+	currentFile = files.size()-1;
+	while(offsets[currentFile] > e)
+		currentFile--;
+	const EventCache* C = files[currentFile];
+	active.clear();
+	for(std::vector<Binding>::const_iterator it = bindings.begin(); it != bindings.end(); it++) {
+		if(it->ptr)
+			*it->ptr = it->readout;	// not left pointing into another file
+		int c = C->findColumn(it->name);
+		if(c < 0) {
+			printf("*** Warning: no column '%s' in mapped file %i!\n",it->name.c_str(),currentFile);
+			continue;
+		}
+		if(it->size != C->getColumnSize(c)) {
+			printf("*** Mapped column '%s' size does not match readout (%i != %i bytes); not loaded!\n",it->name.c_str(),C->getColumnSize(c),it->size);
+			continue;
+		}
+		active.push_back(*it);
+		active.back().data = C->getColumnData(c);
+	}
+	if(prefetchNext)
+		prefetchFile(currentFile+1);
+}
@@ -0,0 +1,152 @@
+#ifndef SCANBACKEND_HH
+#define SCANBACKEND_HH 1
+
+#include "EventCache.hh"
+#include "FilePrefetcher.hh"
+#include <TChain.h>
+#include <string>
+#include <vector>
+
+/// abstract source of per-event data for TChainScanner
+class ScanBackend {
+public:
+	/// constructor
+	ScanBackend(): prefetchNext(true) {}
+	/// destructor
+	virtual ~ScanBackend() {}
+
+	/// add input file (or pattern); return number of files added
+	virtual int addFile(const std::string& fname) = 0;
+	/// total number of events
+	virtual unsigned int getEntries() = 0;
+	/// check whether named field is available
+	virtual bool hasBranch(const std::string& bname) = 0;
+	/// bind named field to readout location of sz bytes (0 if unknown), filled on each load
+	virtual void setBranchAddress(const std::string& bname, void* bdata, unsigned int sz) = 0;
+	/// bind named field by pointer *p to each loaded event's sz bytes; bdata is readout buffer for backends that copy
+	virtual void bindPointer(const std::string& bname, const void** p, void* bdata, unsigned int sz) = 0;
+
+	/// load event e (random access)
+	virtual void getEvent(unsigned int e) = 0;
+	/// load event e (optimized for sequential access)
+	virtual void speedload(unsigned int e) = 0;
+	/// number of file containing last loaded event
+	virtual int getFileNumber() const = 0;
+	/// event number offset of file containing last loaded event
+	virtual unsigned int getFileOffset() const = 0;
+	/// number of events in file containing last loaded event
+	virtual unsigned int getFileEntries() const = 0;
+	/// name of input file n; "" if none
+	virtual std::string getFileName(unsigned int n) const = 0;
+	
+	/// start reading input file n into OS cache in background
+	void prefetchFile(unsigned int n) { prefetcher.request(getFileName(n)); }
+	
+	bool prefetchNext;				//< whether to read ahead next file on switching files
+	FilePrefetcher prefetcher;		//< background reader for upcoming input file
+};
+
+/// ROOT TChain data source
+class TChainBackend: public ScanBackend {
+public:
+	/// constructor
+	TChainBackend(const std::string& treeName);
+	/// destructor
+	virtual ~TChainBackend();
+
+	/// add input file (or pattern); return number of files added
+	virtual int addFile(const std::string& fname) { return Tch->Add(fname.c_str()); }
+	/// total number of events
+	virtual unsigned int getEntries() { return Tch->GetEntries(); }
+	/// check whether named branch is available
+	virtual bool hasBranch(const std::string& bname) { return Tch->GetBranch(bname.c_str()); }
+	/// bind named branch to readout location
+	virtual void setBranchAddress(const std::string& bname, void* bdata, unsigned int) { Tch->SetBranchAddress(bname.c_str(),bdata); }
+	/// bind named branch by pointer, to fixed readout buffer bdata
+	virtual void bindPointer(const std::string& bname, const void** p, void* bdata, unsigned int sz) { setBranchAddress(bname,bdata,sz); *p = bdata; }
+
+	/// load event e (random access)
+	virtual void getEvent(unsigned int e) { Tch->GetEvent(e); noffset = nLocalEvents = 0; }
+	/// load event e, from current tree if possible
+	virtual void speedload(unsigned int e);
+	/// number of tree containing last loaded event
+	virtual int getFileNumber() const { return Tch->GetTreeNumber(); }
+	/// event number offset of tree containing last loaded event
+	virtual unsigned int getFileOffset() const { return noffset; }
+	/// number of events in tree containing last loaded event
+	virtual unsigned int getFileEntries() const { return nLocalEvents; }
+	/// name of file for tree n
+	virtual std::string getFileName(unsigned int n) const;
+
+	TChain* Tch;					//< TChain of input files
+	bool preloadBaskets;			//< whether to read tree baskets (up to prefetcher.budget bytes) into memory on switching trees
+
+protected:
+	unsigned int noffset;			//< offset of currently loaded tree
+	unsigned int nLocalEvents;		//< number of events in currently loaded tree
+};
+
+/// memory-mapped flat file (EventCache format) data source; pointer bindings point directly into mapped pages
+class MappedBackend: public ScanBackend {
+public:
+	/// constructor
+	MappedBackend(): nEntries(0), currentFile(-1) {}
+	/// destructor
+	virtual ~MappedBackend();
+
+	/// add input flat file; return number of files added
+	virtual int addFile(const std::string& fname);
+	/// total number of events
+	virtual unsigned int getEntries() { return nEntries; }
+	/// check whether named column is available
+	virtual bool hasBranch(const std::string& bname) { return files.size() && files[0]->findColumn(bname) >= 0; }
+	/// bind named column to readout location of sz bytes, copied on each load; columns of different size are rejected
+	virtual void setBranchAddress(const std::string& bname, void* bdata, unsigned int sz);
+	/// bind named column by pointer into mapped file (left at bdata if column unavailable)
+	virtual void bindPointer(const std::string& bname, const void** p, void* bdata, unsigned int sz);
+
+	/// load event e
+	virtual void getEvent(unsigned int e) { speedload(e); }
+	/// load event e
+	virtual void speedload(unsigned int e) {
+		if(currentFile < 0 || e < offsets[currentFile] || e-offsets[currentFile] >= files[currentFile]->size())
+			selectFile(e);
+		const unsigned int i = e-offsets[currentFile];
+		for(std::vector<Binding>::const_iterator it = active.begin(); it != active.end(); it++) {
+			if(it->ptr)
+				*it->ptr = it->data+i*it->size;
+			else
+				memcpy(it->readout,it->data+i*it->size,it->size);
+		}
+	}
+	/// number of file containing last loaded event
+	virtual int getFileNumber() const { return currentFile; }
+	/// event number offset of file containing last loaded event
+	virtual unsigned int getFileOffset() const { return currentFile<0 ? 0 : offsets[currentFile]; }
+	/// number of events in file containing last loaded event
+	virtual unsigned int getFileEntries() const { return currentFile<0 ? 0 : files[currentFile]->size(); }
+	/// name of file n
+	virtual std::string getFileName(unsigned int n) const { return n < fileNames.size() ? fileNames[n] : ""; }
+
+protected:
+	/// field binding, resolved to column data for current file
+	struct Binding {
+		std::string name;		//< column name
+		char* readout;			//< readout location for copy binding
+		const void** ptr;		//< pointer to set for pointer binding (NULL for copy binding)
+		const char* data;		//< column data in current file
+		unsigned int size;		//< bytes per event
+	};
+	/// switch to file containing event e, resolving bindings
+	void selectFile(unsigned int e);
+
+	std::vector<EventCache*> files;		//< mapped input files
+	std::vector<std::string> fileNames;	//< name of each input file
+	std::vector<unsigned int> offsets;	//< event number offset of each file
+	unsigned int nEntries;				//< total number of events
+	std::vector<Binding> bindings;		//< requested field bindings
+	std::vector<Binding> active;		//< bindings resolved for current file
+	int currentFile;					//< currently selected file
+};
+
+#endif
@@ -0,0 +1,75 @@
+#include "SkimIndex.hh"
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/// skim index file format identifier
+static const char skimIndexMagic[8] = {'U','C','N','A','S','K','M','1'};
+
+void SkimIndex::select(const ScanSelector& S, unsigned int offset, std::vector<unsigned int>& evts) const {
+	const unsigned int n0 = evts.size();
+	for(std::map< unsigned int, std::vector<unsigned int> >::const_iterator it = entries.begin(); it != entries.end(); it++) {
+		if(!S.select(it->first))
+			continue;
+		for(std::vector<unsigned int>::const_iterator e = it->second.begin(); e != it->second.end(); e++)
+			evts.push_back(*e+offset);
+	}
+	// merge keys back into file order for sequential reading
+	std::sort(evts.begin()+n0,evts.end());
+}
+
+bool SkimIndex::load(const std::string& fname, unsigned int n) {
+	entries.clear();
+	nEvents = 0;
+	FILE* f = fopen(fname.c_str(),"rb");
+	if(!f)
+		return false;
+	char magic[sizeof(skimIndexMagic)];
+	unsigned int nKeys = 0;
+	bool ok = fread(magic,sizeof(magic),1,f)==1 && !memcmp(magic,skimIndexMagic,sizeof(magic));
+	ok = ok && fread(&nEvents,sizeof(nEvents),1,f)==1 && nEvents==n && fread(&nKeys,sizeof(nKeys),1,f)==1;
+	unsigned int nTotal = 0;
+	for(unsigned int k=0; ok && k<nKeys; k++) {
+		unsigned int key, nk;
+		ok = fread(&key,sizeof(key),1,f)==1 && fread(&nk,sizeof(nk),1,f)==1 && nTotal+nk <= nEvents;
+		if(!ok)
+			break;
+		std::vector<unsigned int>& v = entries[key];
+		v.resize(nk);
+		ok = !nk || fread(&v[0],sizeof(unsigned int),nk,f)==nk;
+		nTotal += nk;
+	}
+	fclose(f);
+	ok &= nTotal == nEvents;
+	if(!ok) {
+		entries.clear();
+		nEvents = 0;
+	}
+	return ok;
+}
+
+bool SkimIndex::write(const std::string& fname) const {
+	char pidsfx[32];
+	sprintf(pidsfx,".%i.tmp",(int)getpid());
+	std::string tmpName = fname+pidsfx;	// unique per process, for simultaneous writers
+	FILE* f = fopen(tmpName.c_str(),"wb");
+	if(!f)
+		return false;
+	unsigned int nKeys = entries.size();
+	bool ok = fwrite(skimIndexMagic,sizeof(skimIndexMagic),1,f)==1;
+	ok &= fwrite(&nEvents,sizeof(nEvents),1,f)==1;
+	ok &= fwrite(&nKeys,sizeof(nKeys),1,f)==1;
+	for(std::map< unsigned int, std::vector<unsigned int> >::const_iterator it = entries.begin(); ok && it != entries.end(); it++) {
+		unsigned int nk = it->second.size();
+		ok &= fwrite(&it->first,sizeof(it->first),1,f)==1;
+		ok &= fwrite(&nk,sizeof(nk),1,f)==1;
+		ok &= !nk || fwrite(&it->second[0],sizeof(unsigned int),nk,f)==nk;
+	}
+	ok &= !fclose(f);
+	if(ok)
+		ok = !rename(tmpName.c_str(),fname.c_str());
+	if(!ok)
+		unlink(tmpName.c_str());
+	return ok;
+}
@@ -0,0 +1,36 @@
+#ifndef SKIMINDEX_HH
+#define SKIMINDEX_HH 1
+
+#include <map>
+#include <string>
+#include <vector>
+
+/// selection predicate on per-event skim keys
+class ScanSelector {
+public:
+	/// destructor
+	virtual ~ScanSelector() {}
+	/// whether events with given skim key are selected
+	virtual bool select(unsigned int key) const = 0;
+};
+
+/// per-file index of event numbers by skim key, for scanning only selected events
+class SkimIndex {
+public:
+	/// constructor
+	SkimIndex(): nEvents(0) {}
+	
+	/// add event i (in order) with given key
+	void add(unsigned int key, unsigned int i) { entries[key].push_back(i); nEvents++; }
+	/// append sorted (offset) event numbers selected by S
+	void select(const ScanSelector& S, unsigned int offset, std::vector<unsigned int>& evts) const;
+	/// load from file; return false if missing, damaged, or not for n events
+	bool load(const std::string& fname, unsigned int n);
+	/// write to file
+	bool write(const std::string& fname) const;
+	
+	unsigned int nEvents;	//< number of indexed events
+	std::map< unsigned int, std::vector<unsigned int> > entries;	//< sorted event numbers for each key
+};
+
+#endif
@@ -1,69 +1,208 @@
 #include "TChainScanner.hh"
+#include "PathUtils.hh"
 #include <cassert>
+#include <algorithm>
 #include <stdlib.h>
 #include <time.h>
 
-TChainScanner::TChainScanner(const std::string& treeName): nEvents(0), nFiles(0), Tch(new TChain(treeName.c_str())),
-currentEvent(0), noffset(0), nLocalEvents(0) {
-	Tch->SetMaxVirtualSize(100000000);
+TChainScanner::TChainScanner(const std::string& treeName): nEvents(0), nFiles(0), backend(new TChainBackend(treeName)),
+currentEvent(0), selector(NULL), currentSelected(0), nSkimmed(0), rangeStart(0), rangeEnd(0), noffset(0), nLocalEvents(0) {
+	Tch = ((TChainBackend*)backend)->Tch;
 }
 
+TChainScanner::~TChainScanner() {
+	for(std::vector<SkimIndex*>::iterator it = skims.begin(); it != skims.end(); it++)
+		delete *it;
+	delete(backend);
+}
+
+void TChainScanner::setMappedInput() {
+	assert(!nFiles);
+	delete(backend);
+	backend = new MappedBackend();
+	Tch = NULL;
+}
 
 int TChainScanner::addFile(const std::string& filename) {
 	unsigned int oldEvents = nEvents;
-	int nfAdded = Tch->Add(filename.c_str());
+	int nfAdded = backend->addFile(filename);
 	if(!nfAdded) {
 		printf("*** No such file: '%s'\n",filename.c_str());
 		return 0;
 	}
-	nEvents = Tch->GetEntries();
+	nEvents = backend->getEntries();
 	nnEvents.push_back(nEvents-oldEvents);
+	fileNames.push_back(filename);
 	if(!nFiles)
 		setReadpoints();
 	nFiles+=nfAdded;
 	return nfAdded;
 }
 
+SkimIndex* TChainScanner::getSkimIndex(unsigned int n) {
+	assert(n < nnEvents.size());
+	if(skims.size() <= n)
+		skims.resize(nnEvents.size(),NULL);
+	if(skims[n])
+		return skims[n];
+	
+	unsigned int e0 = 0;
+	for(unsigned int i=0; i<n; i++)
+		e0 += nnEvents[i];
+	const std::string& src = fileNames[n];
+	std::string fname = src+".skim";
+	skims[n] = new SkimIndex();
+	if(fileExists(src) && fileExists(fname) && fileAge(fname) < fileAge(src) && skims[n]->load(fname,nnEvents[n]))
+		return skims[n];
+	
+	printf("\nBuilding skim index for '%s' (%i events)...\n",src.c_str(),nnEvents[n]);
+	for(unsigned int e = e0; e < e0+nnEvents[n]; e++) {
+		speedload(e);
+		skims[n]->add(skimKey(),e-e0);
+	}
+	if(fileExists(src) && !skims[n]->write(fname))
+		printf("*** Unable to save skim index '%s'; using for this session only.\n",fname.c_str());
+	return skims[n];
+}
+
+void TChainScanner::updateSelection() {
+	assert(selector);
+	if(nSkimmed == nnEvents.size())
+		return;
+	unsigned int e0 = 0;
+	for(unsigned int n=0; n<nnEvents.size(); n++) {
+		if(n >= nSkimmed)
+			getSkimIndex(n)->select(*selector,e0,selected);
+		e0 += nnEvents[n];
+	}
+	nSkimmed = nnEvents.size();
+	printf("Selected %i of %i events.\n",(int)selected.size(),nEvents);
+}
+
+void TChainScanner::setSelection(const ScanSelector* S) {
+	selector = S;
+	selected.clear();
+	nSkimmed = 0;
+	currentEvent = 0;
+	currentSelected = 0;
+}
+
+bool TChainScanner::writeFlatFile(const std::string& fname) {
+	std::vector<EventCacheColumn> cols;
+	for(std::vector<EventCacheColumn>::const_iterator it = bindings.begin(); it != bindings.end(); it++)
+		if(it->size && hasBranch(it->name))
+			cols.push_back(*it);
+	EventCache C(cols);
+	if(!C.create(fname,nEvents))
+		return false;
+	printf("Writing %i events to flat file '%s'...\n",nEvents,fname.c_str());
+	for(unsigned int e=0; e<nEvents; e++) {
+		backend->speedload(e);
+		C.fill();
+	}
+	startScan();
+	return C.close();
+}
+
+void TChainScanner::setScanRange(unsigned int e0, unsigned int e1) {
+	assert(!e1 || e0 < e1);
+	rangeStart = e0;
+	rangeEnd = e1;
+	currentEvent = 0;
+}
+
+void TChainScanner::reopenAfterFork() {
+	backend->prefetcher.detach();
+	ScanBackend* B;
+	if(Tch) {
+		TChainBackend* TB = new TChainBackend(Tch->GetName());
+		TB->preloadBaskets = ((TChainBackend*)backend)->preloadBaskets;
+		B = TB;
+	} else {
+		B = new MappedBackend();
+	}
+	B->prefetchNext = backend->prefetchNext;
+	B->prefetcher.budget = backend->prefetcher.budget;
+	for(std::vector<std::string>::const_iterator it = fileNames.begin(); it != fileNames.end(); it++)
+		B->addFile(*it);
+	assert(B->getEntries() == nEvents);
+	for(unsigned int i=0; i<bindings.size(); i++) {
+		if(bindPtrs[i])
+			B->bindPointer(bindings[i].name,bindPtrs[i],bindings[i].readout,bindings[i].size);
+		else
+			B->setBranchAddress(bindings[i].name,bindings[i].readout,bindings[i].size);
+	}
+	delete(backend);
+	backend = B;
+	Tch = Tch ? ((TChainBackend*)backend)->Tch : NULL;
+	nLocalEvents = noffset = 0;
+}
+
 void TChainScanner::startScan(unsigned int startRandom) { 
-	if(startRandom) {
-		if(!currentEvent) {
+	const unsigned int e1 = rangeEnd?rangeEnd:nEvents;
+	if(selector) {
+		updateSelection();
+		const unsigned int s0 = std::lower_bound(selected.begin(),selected.end(),rangeStart)-selected.begin();
+		const unsigned int s1 = std::lower_bound(selected.begin(),selected.end(),e1)-selected.begin();
+		currentSelected = startRandom && s1 > s0 ? s0+rand()%(s1-s0) : s0;
+		currentEvent = currentSelected < selected.size() ? selected[currentSelected] : 0;
+		if(nEvents)
+			backend->getEvent(currentEvent);
+		currentSelected--;
+		printf(">%i/%i< ",s1-s0,nEvents);
+	} else if(startRandom) {
+		if(!currentEvent || currentEvent < rangeStart || currentEvent >= e1) {
 			srand(time(NULL));	// random random seed
-			currentEvent = rand()%Tch->GetEntries();
-			Tch->GetEvent(currentEvent);
-			assert(Tch->GetTree());
+			currentEvent = rangeStart+rand()%(e1-rangeStart);
+			backend->getEvent(currentEvent);
 			printf("Scan Starting at offset %i/%i: ",currentEvent,nEvents);
 		} else {
 			printf("Scan Continuing at offset %i/%i: ",currentEvent,nEvents);
 		}
 	} else {
-		Tch->GetEvent(0);
-		assert(Tch->GetTree());
-		currentEvent = -1;
-		printf(">%i< ",nEvents);
+		backend->getEvent(rangeStart);
+		currentEvent = rangeStart-1;
+		printf(">%i< ",e1-rangeStart);
 	}
 	fflush(stdout);
 	nLocalEvents = noffset = 0;
 }
 
-void TChainScanner::SetBranchAddress(const std::string& bname, void* bdata) {
+void TChainScanner::SetBranchAddress(const std::string& bname, void* bdata, unsigned int sz) {
 	assert(bdata);
-	Tch->SetBranchAddress(bname.c_str(),bdata);
+	backend->setBranchAddress(bname,bdata,sz);
+	bindings.push_back(EventCacheColumn(bname,bdata,sz));
+	bindPtrs.push_back(NULL);
+}
+
+void TChainScanner::bindPointer(const std::string& bname, const void** p, void* bdata, unsigned int sz) {
+	assert(p && bdata);
+	backend->bindPointer(bname,p,bdata,sz);
+	bindings.push_back(EventCacheColumn(bname,bdata,sz));
+	bindPtrs.push_back(p);
 }
 
 void TChainScanner::speedload(unsigned int e) {
-	if(e < noffset || e-noffset >= nLocalEvents) {
-		Tch->LoadTree(e);
-		Tch->GetTree()->SetMaxVirtualSize(10000000);
-		//Tch->GetTree()->LoadBaskets();
-		nLocalEvents = Tch->GetTree()->GetEntries();
-		noffset = Tch->GetChainOffset();
-	}
-	Tch->GetTree()->GetEvent(e-noffset);
+	backend->speedload(e);
 }
 
 bool TChainScanner::nextPoint() {
+	if(selector) {
+		++currentSelected;
+		if(currentSelected >= selected.size() || (rangeEnd && selected[currentSelected] >= rangeEnd)) {
+			printf("\n");
+			startScan();
+			return false;
+		}
+		if(selected.size() >= 20 && !(currentSelected%(selected.size()/20))) {
+			printf("*"); fflush(stdout);
+		}
+		currentEvent = selected[currentSelected];
+		speedload(currentEvent);
+		return true;
+	}
 	++currentEvent;
-	if(currentEvent >= nEvents) {
+	if(currentEvent >= (rangeEnd?rangeEnd:nEvents)) {
 		printf("\n");
 		startScan();
 		return false;
@@ -1,20 +1,26 @@
 #ifndef TCHAINSCANNER_HH
 #define TCHAINSCANNER_HH 1
 
+#include "ScanBackend.hh"
+#include "SkimIndex.hh"
 #include <TChain.h>
 #include <string>
 #include <vector>
 
-/// class for assembling and scanning a TChain
+/// class for assembling and scanning a TChain (or other ScanBackend data source)
 class TChainScanner {
 public:
 	/// constructor
 	TChainScanner(const std::string& treeName);
 	/// destructor
-	virtual ~TChainScanner() { delete(Tch); }
+	virtual ~TChainScanner();
 	
 	/// add a file to the TChain
 	virtual int addFile(const std::string& filename);
+	/// switch to memory-mapped flat file input (before adding files)
+	void setMappedInput();
+	/// write flat file (for memory-mapped input) of all bound fields for all loaded events
+	bool writeFlatFile(const std::string& fname);
 	
 	/// start a "speed scan," possibly at a random entry number
 	virtual void startScan(unsigned int startRandom = 0);
@@ -22,18 +28,30 @@ public:
 	virtual void speedload(unsigned int e);	
 	/// load next "speed scan" point
 	virtual bool nextPoint();	
+	/// scan only events selected by S (applied at start of next scan), using skim index stored with each file (NULL to scan all events)
+	void setSelection(const ScanSelector* S);
+	/// append selected events from files added since last update (building any missing skim indices; done automatically at start of scan)
+	void updateSelection();
+	/// restrict scans to events [e0,e1) (e1 = 0 for all events)
+	void setScanRange(unsigned int e0, unsigned int e1);
+	/// re-open input files with fresh file handles, for scanning in a forked process
+	void reopenAfterFork();
 	/// get current speed scan point
 	unsigned int getCurrentEvent() const { return currentEvent; }
 	/// load data for given event number
-	virtual void getEvent(unsigned int e) { Tch->GetEvent(e); }
+	virtual void getEvent(unsigned int e) { backend->getEvent(e); }
 	/// get named branch address
 	TChain* getChain() { return Tch; }
 	/// get branch
-	TBranch* getBranch(const char* bname) { return Tch->GetBranch(bname); }
+	TBranch* getBranch(const char* bname) { return Tch?Tch->GetBranch(bname):NULL; }
+	/// check whether named field is available in input
+	bool hasBranch(const std::string& bname) { return backend->hasBranch(bname); }
 	/// get local event number
 	unsigned int getLocal(unsigned int e) { return Tch->LoadTree(e); }
 	/// get number of files
 	unsigned int getnFiles() const { return nFiles; }
+	/// get name of input file n (after pattern expansion); "" if none
+	std::string getFileName(unsigned int n) const { return backend->getFileName(n); }
 		
 	UInt_t nEvents;						//< number of events in current TChain
 	
@@ -41,14 +59,31 @@ protected:
 	
 	/// over-write this in subclass to automaticlly set readout points on first loaded file
 	virtual void setReadpoints() {}
-	/// "string friendly" SetBranchAddress
-	void SetBranchAddress(const std::string& bname, void* bdata);
+	/// over-write this in subclass to provide skim index key for currently loaded event
+	virtual unsigned int skimKey() { return 0; }
+	/// load (or build and save) skim index for file n
+	SkimIndex* getSkimIndex(unsigned int n);
+	/// "string friendly" SetBranchAddress; sz (readout size) needed for writing flat files
+	virtual void SetBranchAddress(const std::string& bname, void* bdata, unsigned int sz = 0);
+	/// bind field by pointer *p, re-pointed to each event's data without copying for memory-mapped input (else to readout buffer bdata)
+	void bindPointer(const std::string& bname, const void** p, void* bdata, unsigned int sz);
 	
 	std::vector<unsigned int> nnEvents;	//< number of events in each loaded TChain;
+	std::vector<std::string> fileNames;	//< name (or pattern) of each loaded file
 	unsigned int nFiles;				//< get number of loaded files
 	
-	TChain* Tch;						//< TChain of relevant runs
+	ScanBackend* backend;				//< event data source
+	TChain* Tch;						//< TChain of relevant runs (NULL if not TChain backend)
+	std::vector<EventCacheColumn> bindings;	//< fields bound with SetBranchAddress or bindPointer
+	std::vector<const void**> bindPtrs;		//< pointer location for each of bindings (NULL for copy binding)
 	unsigned int currentEvent;			//< event number of current event in chain
+	const ScanSelector* selector;		//< event selection for scans (NULL for all events)
+	std::vector<SkimIndex*> skims;		//< skim index for each file (NULL until needed)
+	std::vector<unsigned int> selected;	//< sorted list of selected event numbers
+	unsigned int currentSelected;		//< position of current event in selected list
+	unsigned int nSkimmed;				//< number of files included in selected list
+	unsigned int rangeStart;			//< first event in scan range
+	unsigned int rangeEnd;				//< end of scan range (0 for all events)
 	unsigned int noffset;				//< offset of current event relative to currently loaded tree
 	unsigned int nLocalEvents;			//< number of events in currently loaded tree
 };
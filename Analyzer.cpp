@@ -14,6 +14,8 @@
 #include "ReSource.hh"
 #include "RData.hh"
 #include "G4toPMT.hh"
+#include "DataSource.hh"
+#include "CalDBSnapshot.hh"
 
 
 std::vector<RunNum> selectRuns(RunNum r0, RunNum r1, std::string typeSelect) {
@@ -53,6 +55,18 @@ void mi_VerifyCalperiods(std::deque<std::string>&, std::stack<std::string>&) {
 	}
 }
 
+void mi_CalSnapshot(std::deque<std::string>&, std::stack<std::string>& stack) {
+	std::string fname = streamInteractor::popString(stack);
+	RunNum r1 = streamInteractor::popInt(stack);
+	RunNum r0 = streamInteractor::popInt(stack);
+	std::vector<RunNum> C = selectRuns(r0,r1,"all");
+	printf("Capturing calibrations for %i runs...\n",(int)C.size());
+	CalDBSnapshot S(CalDBSQL::getCDB());
+	for(std::vector<RunNum>::iterator it=C.begin(); it!=C.end(); it++)
+		S.captureRun(*it);
+	S.write(fname);
+}
+
 void mi_EndpointStudy(std::deque<std::string>&, std::stack<std::string>& stack) {
 	unsigned int nr = streamInteractor::popInt(stack);
 	RunNum r1 = streamInteractor::popInt(stack);
@@ -123,41 +137,38 @@ void mi_processOctet(std::deque<std::string>&, std::stack<std::string>& stack) {
 	const std::string outputDir="OctetAsym_Offic";
 	//const std::string outputDir="OctetAsym_10keV_Bins";
 	AsymmetryAnalyzer::processedLocation = getEnvSafe("UCNA_ANALYSIS_OUTPUT_DIR")+"/"+outputDir+"/"+outputDir;
+	const unsigned int nJobs = atoi(getEnvSafe("UCNA_ANALYSIS_JOBS","1").c_str());
 	
 	if(octn==1000) {
 		OutputManager OM("ThisNameIsNotUsedAnywhere",getEnvSafe("UCNA_ANALYSIS_OUTPUT_DIR"));
 		AsymmetryAnalyzer AA(&OM,outputDir);
-		processOctets(AA,Octet::loadOctets(QFile(getEnvSafe("UCNA_OCTET_LIST"))),365*24*3600);
+		processOctets(AA,Octet::loadOctets(QFile(getEnvSafe("UCNA_OCTET_LIST"))),365*24*3600,nJobs);
 	} else if(octn==-1000) {
 		OutputManager OM("ThisNameIsNotUsedAnywhere",getEnvSafe("UCNA_ANALYSIS_OUTPUT_DIR"));
 		AsymmetryAnalyzer AA_Sim(&OM,outputDir+"_Simulated",AsymmetryAnalyzer::processedLocation);
-		G4toPMT simData;
-		simData.addFile("/home/mmendenhall/geant4/output/Livermore_neutronBetaUnpol_geomC/analyzed_*.root");
-		simuClone(getEnvSafe("UCNA_ANALYSIS_OUTPUT_DIR")+"/"+outputDir, AA_Sim, simData, 1.0, 365*24*3600);
+		simuClone(getEnvSafe("UCNA_ANALYSIS_OUTPUT_DIR")+"/"+outputDir, AA_Sim, "/home/mmendenhall/geant4/output/Livermore_neutronBetaUnpol_geomC/analyzed_*.root", 1.0, 365*24*3600);
 	} else if(octn < 0) {
 		Octet oct = Octet::loadOctet(QFile(getEnvSafe("UCNA_OCTET_LIST")),-octn-1);
 		if(!oct.getNRuns()) return;
 		OutputManager OM("ThisNameIsNotUsedAnywhere",getEnvSafe("UCNA_ANALYSIS_OUTPUT_DIR")+"/"+outputDir+"_Simulated");
 		AsymmetryAnalyzer AA_Sim(&OM,oct.octName(),getEnvSafe("UCNA_ANALYSIS_OUTPUT_DIR")+"/"+outputDir+"/"+oct.octName()+"/"+oct.octName());		
-		G4toPMT simData;
-		simData.addFile("/home/mmendenhall/geant4/output/Livermore_neutronBetaUnpol_geomC/analyzed_*.root");
-		simuClone(getEnvSafe("UCNA_ANALYSIS_OUTPUT_DIR")+"/"+outputDir+"/"+oct.octName(), AA_Sim, simData, 1.0, 24*3600);
+		simuClone(getEnvSafe("UCNA_ANALYSIS_OUTPUT_DIR")+"/"+outputDir+"/"+oct.octName(), AA_Sim, "/home/mmendenhall/geant4/output/Livermore_neutronBetaUnpol_geomC/analyzed_*.root", 1.0, 24*3600);
 	} else {
 		Octet oct = Octet::loadOctet(QFile(getEnvSafe("UCNA_OCTET_LIST")),octn);
 		if(!oct.getNRuns()) return;
 		OutputManager OM("ThisNameIsNotUsedAnywhere",getEnvSafe("UCNA_ANALYSIS_OUTPUT_DIR")+"/"+outputDir);
 		AsymmetryAnalyzer AA(&OM,oct.octName());
-		processOctets(AA,oct.getSubdivs(oct.divlevel+1,false));
+		processOctets(AA,oct.getSubdivs(oct.divlevel+1,false),0,nJobs);
 	}
 }
 
 void simulations_evis() {
 	OutputManager OM("Evis2ETrue","../PostPlots/Evis2ETrue/Livermore/");
-	G4toPMT g2p;
-	g2p.addFile("/home/mmendenhall/geant4/output/Livermore_neutronBetaUnpol_geomC/analyzed_*.root");
+	Sim2PMT* g2p = getSimSource("/home/mmendenhall/geant4/output/Livermore_neutronBetaUnpol_geomC/analyzed_*.root");
 	PMTCalibrator PCal(16000,CalDBSQL::getCDB());
-	g2p.setCalibrator(PCal);
-	SimSpectrumInfo(g2p,OM);
+	g2p->setCalibrator(PCal);
+	SimSpectrumInfo(*g2p,OM);
+	delete(g2p);
 	OM.setWriteRoot(true);
 	OM.write();
 }
@@ -206,6 +217,16 @@ void mi_Special(std::deque<std::string>&, std::stack<std::string>&) {
 	}
 }
 
+void mi_ReduceG4(std::deque<std::string>&, std::stack<std::string>& stack) {
+	std::string fout = streamInteractor::popString(stack);
+	std::string fin = streamInteractor::popString(stack);
+	if(fout == "default")
+		fout = reducedSimName(fin);
+	G4toPMT g2p;
+	if(!g2p.addFile(fin) || !ReducedG4toPMT::convert(g2p,fout))
+		printf("*** Failed to reduce '%s' to '%s'!\n",fin.c_str(),fout.c_str());
+}
+
 void Analyzer(std::deque<std::string> args=std::deque<std::string>()) {
 	
 	gStyle->SetPalette(1);
@@ -239,6 +260,10 @@ void Analyzer(std::deque<std::string> args=std::deque<std::string>()) {
 	inputRequester pm_mi3("Process positions file",&mi_EndpointProcessFile);	
 	inputRequester pm_mi4("Process calibrations file",&mi_ProcessCalFile);
 	inputRequester pm_mi5("Verify calibration assignments",&mi_VerifyCalperiods);
+	inputRequester pm_snapshot("Make calibration snapshot",&mi_CalSnapshot);
+	pm_snapshot.addArg("Start Run");
+	pm_snapshot.addArg("End Run");
+	pm_snapshot.addArg("Output file","../SummaryData/CalSnapshot.dat");
 	
 	inputRequester plotGMS("Plot GMS corrections",&mi_PlotGMS);
 	plotGMS.addArg("Start Run");
@@ -259,6 +284,10 @@ void Analyzer(std::deque<std::string> args=std::deque<std::string>()) {
 	
 	inputRequester specialJunk("Special Junk",&mi_Special);
 	
+	inputRequester g4Reducer("Reduce Geant4 simulation",&mi_ReduceG4);
+	g4Reducer.addArg("Input files");
+	g4Reducer.addArg("Output file","default");
+	
 	// Posprocessing menu
 	OptionsMenu PostRoutines("Postprocessing Routines");
 	PostRoutines.addChoice(&pm_posmap,"pmap");
@@ -266,12 +295,14 @@ void Analyzer(std::deque<std::string> args=std::deque<std::string>()) {
 	PostRoutines.addChoice(&pm_mi3);
 	PostRoutines.addChoice(&pm_mi4);
 	PostRoutines.addChoice(&pm_mi5);
+	PostRoutines.addChoice(&pm_snapshot,"snap");
 	PostRoutines.addChoice(&plotGMS);
 	PostRoutines.addChoice(&posmapPlot);
 	PostRoutines.addChoice(&nPEPlot);
 	PostRoutines.addChoice(&posmapDumper,"dpm");
 	PostRoutines.addChoice(&octetProcessor,"oct");
 	PostRoutines.addChoice(&specialJunk,"spec");
+	PostRoutines.addChoice(&g4Reducer,"g4r");
 	PostRoutines.addChoice(&exitMenu,"x");	
 	
 	// special run processing
@@ -36,9 +36,12 @@ void TagCounter<T>::add(const T& itm, double c) {
 
 template<typename T>
 void TagCounter<T>::operator+=(const TagCounter<T>& c) {
-	std::map<T,float> dfksj;
-	for(typename std::map<T,double>::const_iterator it = c.counts.begin(); it != c.counts.end(); it++)
-		add(it->first,it->second);
+	// both maps sorted: insert each item after the previous one, instead of searching from the root
+	typename std::map<T,double>::iterator hint = counts.begin();
+	for(typename std::map<T,double>::const_iterator it = c.counts.begin(); it != c.counts.end(); it++) {
+		hint = counts.insert(hint,std::make_pair(it->first,0.0));
+		hint->second += it->second;
+	}
 }
 
 template<typename T>
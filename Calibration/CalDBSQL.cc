@@ -1,27 +1,268 @@
 #include "CalDBSQL.hh"
 #include "PathUtils.hh"
+#include "strutils.hh"
 #include <utility>
+#include <algorithm>
+#include <set>
+
+/// split ID list into comma-separated chunks for "IN (...)" queries
+static std::vector<std::string> inLists(const std::vector<unsigned int>& ids, unsigned int nmax = 500) {
+	std::vector<std::string> v;
+	for(unsigned int i=0; i<ids.size(); i++) {
+		if(!(i%nmax))
+			v.push_back(itos(ids[i]));
+		else
+			v.back() += ","+itos(ids[i]);
+	}
+	return v;
+}
+
+/// key for prefetched tube calibration data
+static std::string tubecalKey(unsigned int ecid, const std::string& side, unsigned int t) {
+	return itos(ecid)+"/"+side+"/"+itos(t);
+}
+
+/// key for prefetched run-specific data by name (sensor, side, ...) and type (monitor type, quadrant, ...)
+static std::string runDataKey(RunNum rn, const std::string& nm, const std::string& tp) {
+	return itos(rn)+"/"+nm+"/"+tp;
+}
+
+/// tube_calibration fields loaded by prefetch
+static const char* tubecalFields[] = {"linearity_graph","noisecal_width","noisecal_adc","encal_adc","encal_evis","encal_xpos","encal_ypos"};
+static const unsigned int nTubecalFields = sizeof(tubecalFields)/sizeof(tubecalFields[0]);
+
+/// globally shared read-only DB connection
+static CalDBSQL* CDBr = NULL;
+/// globally shared writeable DB connection
+static CalDBSQL* CDBw = NULL;
 
 CalDBSQL* CalDBSQL::getCDB(bool readonly) {
 	if(readonly) {
-		static CalDBSQL* CDBr = NULL;
 		if(!CDBr) CDBr = new CalDBSQL(getEnvSafe("UCNADB"),getEnvSafe("UCNADBADDRESS"),
 									  getEnvSafe("UCNADBUSER_READONLY"),getEnvSafe("UCNADBPASS_READONLY"));
 		return CDBr;
 	} else {
-		static CalDBSQL* CDBw = NULL;
 		if(!CDBw) CDBw = new CalDBSQL(getEnvSafe("UCNADB"),getEnvSafe("UCNADBADDRESS"),
 									  getEnvSafe("UCNADBUSER"),getEnvSafe("UCNADBPASS"));
 		return CDBw;		
 	}
 }
 
+void CalDBSQL::forgetCDB() {
+	if(CDBr) CDBr->dropInheritedConnection();
+	if(CDBw) CDBw->dropInheritedConnection();
+}
+
 CalDBSQL::~CalDBSQL() {
 	for(unsigned int i=0; i<pcors.size(); i++)
 		delete pcors[i];
 }
 
+void CalDBSQL::clearPrefetch() {
+	pfCalSet.clear();
+	pfTubecal.clear();
+	pfRunTimes.clear();
+	pfRunInfo.clear();
+	pfGroupName.clear();
+	pfAnalysis.clear();
+	pfMonitors.clear();
+	pfTrigeff.clear();
+	pfGraphs.clear();
+}
+
+void CalDBSQL::prefetchCalSets(const std::vector<RunNum>& runs) {
+	if(!runs.size())
+		return;
+	// runs without a calibration set get (authoritative) zeros, as from getCalSetInfo
+	std::map<RunNum,int> width;
+	for(std::vector<RunNum>::const_iterator it = runs.begin(); it != runs.end(); it++) {
+		std::map<std::string,int>& m = pfCalSet[*it];
+		m["ecal_id"] = m["gms_run"] = m["posmap_set_id"] = 0;
+	}
+	sprintf(query,"SELECT ecal_id,gms_run,posmap_set_id,start_run,end_run FROM energy_calibration WHERE start_run <= %i AND %i <= end_run",
+			*std::max_element(runs.begin(),runs.end()),*std::min_element(runs.begin(),runs.end()));
+	Query();
+	if(!res)
+		return;
+	TSQLRow* r;
+	while((r = res->Next())) {
+		int r0 = fieldAsInt(r,3);
+		int r1 = fieldAsInt(r,4);
+		for(std::vector<RunNum>::const_iterator it = runs.begin(); it != runs.end(); it++) {
+			if(int(*it) < r0 || r1 < int(*it) || (width.count(*it) && width[*it] <= r1-r0))
+				continue;
+			width[*it] = r1-r0;
+			std::map<std::string,int>& m = pfCalSet[*it];
+			m["ecal_id"] = fieldAsInt(r,0);
+			m["gms_run"] = fieldAsInt(r,1);
+			m["posmap_set_id"] = fieldAsInt(r,2);
+			m["start_run"] = r0;
+		}
+		delete(r);
+	}
+	for(std::vector<RunNum>::const_iterator it = runs.begin(); it != runs.end(); it++)
+		if(pfCalSet[*it]["start_run"] == 1)
+			printf("**** WARNING: Catchall Calibration selected for Run %i\n",*it);
+}
+
+void CalDBSQL::prefetchGraphs(const std::vector<unsigned int>& gids) {
+	std::vector<unsigned int> gv;
+	for(std::vector<unsigned int>::const_iterator it = gids.begin(); it != gids.end(); it++)
+		if(*it && !pfGraphs.count(*it))
+			gv.push_back(*it);
+	std::vector<std::string> gin = inLists(gv);
+	TSQLRow* r;
+	for(std::vector<std::string>::const_iterator it = gin.begin(); it != gin.end(); it++) {
+		sprintf(query,"SELECT graph_id,x_value,x_error,y_value,y_error FROM graph_points WHERE graph_id IN (%s) ORDER BY graph_id,x_value ASC",it->c_str());
+		Query();
+		if(!res)
+			continue;
+		while((r = res->Next())) {
+			std::vector<float>& g = pfGraphs[fieldAsInt(r,0)];
+			for(unsigned int i=1; i<=4; i++)
+				g.push_back(fieldAsFloat(r,i));
+			delete(r);
+		}
+	}
+}
+
+void CalDBSQL::prefetch(const std::vector<RunNum>& runs, bool withPedestals) {
+	if(!db || !runs.size())
+		return;
+	
+	// calibration sets, including GMS reference runs
+	std::set<RunNum> rset(runs.begin(),runs.end());
+	prefetchCalSets(std::vector<RunNum>(rset.begin(),rset.end()));
+	std::set<RunNum> gmsRuns;
+	for(std::set<RunNum>::const_iterator it = rset.begin(); it != rset.end(); it++) {
+		RunNum rGMS = pfCalSet[*it]["gms_run"];
+		if(rGMS && !rset.count(rGMS))
+			gmsRuns.insert(rGMS);
+	}
+	prefetchCalSets(std::vector<RunNum>(gmsRuns.begin(),gmsRuns.end()));
+	rset.insert(gmsRuns.begin(),gmsRuns.end());
+	std::vector<RunNum> rlist(rset.begin(),rset.end());
+	std::vector<std::string> rin = inLists(rlist);
+	printf("Prefetching calibration data for %i runs...\n",(int)rlist.size());
+	
+	std::vector<unsigned int> gids;
+	TSQLRow* r;
+	
+	// tube calibrations for all calibration sets
+	std::set<unsigned int> ecids;
+	for(std::vector<RunNum>::const_iterator it = rlist.begin(); it != rlist.end(); it++)
+		if(pfCalSet[*it]["ecal_id"])
+			ecids.insert(pfCalSet[*it]["ecal_id"]);
+	std::vector<std::string> ein = inLists(std::vector<unsigned int>(ecids.begin(),ecids.end()));
+	std::string fieldList = tubecalFields[0];
+	for(unsigned int i=1; i<nTubecalFields; i++)
+		fieldList += std::string(",")+tubecalFields[i];
+	for(std::vector<std::string>::const_iterator it = ein.begin(); it != ein.end(); it++) {
+		sprintf(query,"SELECT ecal_id,side,quadrant,%s FROM tube_calibration WHERE ecal_id IN (%s)",fieldList.c_str(),it->c_str());
+		Query();
+		if(!res)
+			continue;
+		while((r = res->Next())) {
+			std::string k = tubecalKey(fieldAsInt(r,0),fieldAsString(r,1),fieldAsInt(r,2));
+			if(!pfTubecal.count(k)) {
+				std::map<std::string,double>& m = pfTubecal[k];
+				for(unsigned int i=0; i<nTubecalFields; i++)
+					m[tubecalFields[i]] = fieldAsFloat(r,3+i);
+				gids.push_back(fieldAsInt(r,3));
+			}
+			delete(r);
+		}
+	}
+	
+	for(std::vector<std::string>::const_iterator it = rin.begin(); it != rin.end(); it++) {
+		
+		// run table times and info
+		//                                0                          1                        2               3        4        5          6       7
+		sprintf(query,"SELECT run_number,UNIX_TIMESTAMP(start_time),UNIX_TIMESTAMP(end_time),slow_run_number,run_type,asym_oct,gate_valve,flipper,scs_field \
+				FROM run WHERE run_number IN (%s)",it->c_str());
+		Query();
+		while(res && (r = res->Next())) {
+			RunNum rn = fieldAsInt(r,0);
+			pfRunTimes[rn] = std::make_pair(fieldAsInt(r,1),fieldAsInt(r,2));
+			std::vector<std::string> v;
+			v.push_back(fieldAsString(r,3,"0"));
+			for(unsigned int i=4; i<8; i++)
+				v.push_back(fieldAsString(r,i,"Other"));
+			v.push_back(fieldAsString(r,8,"0"));
+			pfRunInfo[rn] = v;
+			delete(r);
+		}
+		
+		// analysis times
+		sprintf(query,"SELECT run_number,live_time_e,live_time_w,live_time,total_time FROM analysis WHERE run_number IN (%s)",it->c_str());
+		Query();
+		while(res && (r = res->Next())) {
+			RunNum rn = fieldAsInt(r,0);
+			if(!pfAnalysis.count(rn))
+				for(unsigned int i=1; i<=4; i++)
+					pfAnalysis[rn].push_back(fieldAsFloat(r,i));
+			delete(r);
+		}
+		
+		// run monitor graph IDs
+		sprintf(query,"SELECT run_number,sensor_name,monitor_type,center_graph_id,width_graph_id FROM run_monitors,sensors \
+				WHERE sensors_sensor_id = sensor_id AND run_number IN (%s)",it->c_str());
+		Query();
+		while(res && (r = res->Next())) {
+			std::string monType = fieldAsString(r,2);
+			std::string k = runDataKey(fieldAsInt(r,0),fieldAsString(r,1),monType);
+			if(!pfMonitors.count(k)) {
+				pfMonitors[k] = std::make_pair(fieldAsInt(r,3),fieldAsInt(r,4));
+				if(withPedestals || monType != "pedestal") {
+					gids.push_back(pfMonitors[k].first);
+					gids.push_back(pfMonitors[k].second);
+				}
+			}
+			delete(r);
+		}
+		
+		// trigger efficiency parameters
+		sprintf(query,"SELECT run_number,side,quadrant,params_graph FROM mpm_trigeff WHERE run_number IN (%s)",it->c_str());
+		Query();
+		while(res && (r = res->Next())) {
+			std::string k = runDataKey(fieldAsInt(r,0),fieldAsString(r,1),itos(fieldAsInt(r,2)));
+			if(!pfTrigeff.count(k)) {
+				pfTrigeff[k] = fieldAsInt(r,3);
+				gids.push_back(pfTrigeff[k]);
+			}
+			delete(r);
+		}
+	}
+	
+	// run group names
+	sprintf(query,"SELECT name,start_run,end_run FROM run_group WHERE start_run <= %i AND %i <= end_run",rlist.back(),rlist.front());
+	Query();
+	std::map<RunNum,int> width;
+	while(res && (r = res->Next())) {
+		int r0 = fieldAsInt(r,1);
+		int r1 = fieldAsInt(r,2);
+		for(std::vector<RunNum>::const_iterator it = rlist.begin(); it != rlist.end(); it++) {
+			if(int(*it) < r0 || r1 < int(*it) || (width.count(*it) && width[*it] <= r1-r0))
+				continue;
+			width[*it] = r1-r0;
+			pfGroupName[*it] = itos(r0)+" "+fieldAsString(r,0);
+		}
+		delete(r);
+	}
+	
+	// graph points for all of the above
+	prefetchGraphs(gids);
+	printf("Prefetched %i tube calibrations, %i monitors, %i graphs.\n",(int)pfTubecal.size(),(int)pfMonitors.size(),(int)pfGraphs.size());
+}
+
 TGraphErrors* CalDBSQL::getRunMonitor(RunNum rn, const std::string& sensorName, const std::string& monType, bool centers) {
+	std::map<std::string, std::pair<unsigned int,unsigned int> >::const_iterator it = pfMonitors.find(runDataKey(rn,sensorName,monType));
+	if(it != pfMonitors.end()) {
+		TGraphErrors* tg = getGraph(centers?it->second.first:it->second.second);
+		if(!tg)
+			printf("*** Warning: no graph for run monitor %i %s (%s)\n",rn,sensorName.c_str(),monType.c_str());
+		return tg;
+	}
 	if(centers)
 		sprintf(query,"SELECT center_graph_id FROM run_monitors,sensors WHERE run_number = %i \
 				AND sensors_sensor_id = sensor_id AND sensor_name = '%s' AND monitor_type = '%s'",rn,sensorName.c_str(),monType.c_str());
@@ -41,6 +282,12 @@ TGraphErrors* CalDBSQL::getRunMonitor(RunNum rn, const std::string& sensorName,
 }
 
 float CalDBSQL::getRunMonitorStart(RunNum rn, const std::string& sensorName, const std::string& monType) {
+	std::map<std::string, std::pair<unsigned int,unsigned int> >::const_iterator it = pfMonitors.find(runDataKey(rn,sensorName,monType));
+	if(it != pfMonitors.end()) {
+		std::map<unsigned int, std::vector<float> >::const_iterator git = pfGraphs.find(it->second.first);
+		if(git != pfGraphs.end() && git->second.size())
+			return git->second[2];
+	}
 	sprintf(query,"SELECT center_graph_id FROM run_monitors,sensors WHERE run_number = %i \
 			AND sensors_sensor_id = sensor_id AND sensor_name = '%s' AND monitor_type = '%s'",rn,sensorName.c_str(),monType.c_str());
 	TSQLRow* r = getFirst();
@@ -105,7 +352,7 @@ float CalDBSQL::getKurieADC(RunNum rn, Side s, unsigned int t) {
 
 
 PositioningCorrector* CalDBSQL::getPositioningCorrector(RunNum rn) {
-	return getPositioningCorrectorByID(getCalSetInfo(rn,"posmap_set_id"));
+	return getPositioningCorrectorByID(getPosmapID(rn));
 }
 
 
@@ -126,7 +373,7 @@ float CalDBSQL::getAnodeCalInfo(RunNum R, const char* field) {
 }
 
 PositioningCorrector* CalDBSQL::getAnodePositioningCorrector(RunNum rn) {	
-	return getPositioningCorrectorByID(int(getAnodeCalInfo(rn,"anode_posmap_id")));
+	return getPositioningCorrectorByID(getAnodePosmapID(rn));
 }
 
 float CalDBSQL::getAnodeGain(RunNum rn, Side s) {
@@ -141,6 +388,15 @@ PositioningCorrector* CalDBSQL::getPositioningCorrectorByID(unsigned int psid) {
 		return it->second;
 	
 	printf("Loading positioning corrector %i...\n",psid);
+	std::vector<PosmapInfo> pinf = getPosmapInfo(psid);
+	assert(pinf.size() || IGNORE_DEAD_DB);
+	if(!pinf.size()) return NULL;
+	
+	pcors.insert(std::make_pair(psid,new PositioningCorrector(pinf)));
+	return getPositioningCorrectorByID(psid);
+}
+
+std::vector<PosmapInfo> CalDBSQL::getPosmapInfo(unsigned int psid) {
 	std::vector<PosmapInfo> pinf;
 	TSQLRow* r;
 	for(Side s = EAST; s<=WEST; ++s) {
@@ -160,7 +416,7 @@ PositioningCorrector* CalDBSQL::getPositioningCorrectorByID(unsigned int psid) {
 					psid,dbSideName(s),t);
 			Query();
 			if(!res)
-				return NULL;
+				return std::vector<PosmapInfo>();
 			while((r = res->Next())) {
 				pinf.back().adc.push_back(fieldAsFloat(r,0));
 				pinf.back().energy.push_back(fieldAsFloat(r,1));
@@ -171,14 +427,16 @@ PositioningCorrector* CalDBSQL::getPositioningCorrectorByID(unsigned int psid) {
 				pinf.pop_back();
 		}
 	}
-	assert(pinf.size() || IGNORE_DEAD_DB);
-	if(!pinf.size()) return NULL;
-	
-	pcors.insert(std::make_pair(psid,new PositioningCorrector(pinf)));
-	return getPositioningCorrectorByID(psid);
+	return pinf;
 }
 
 unsigned int CalDBSQL::getCalSetInfo(RunNum R, const char* field) {
+	std::map<RunNum, std::map<std::string,int> >::const_iterator it = pfCalSet.find(R);
+	if(it != pfCalSet.end()) {
+		std::map<std::string,int>::const_iterator fit = it->second.find(field);
+		if(fit != it->second.end())
+			return fit->second;
+	}
 	sprintf(query,"SELECT %s,start_run FROM energy_calibration WHERE start_run <= %i AND %i <= end_run ORDER BY end_run - start_run LIMIT 1",field,R,R);
 	TSQLRow* r = getFirst();
 	if(!r)
@@ -204,6 +462,14 @@ unsigned int CalDBSQL::getTubecalID(RunNum R, Side s, unsigned int t) {
 }
 
 float CalDBSQL::getTubecalData(RunNum rn, Side s, unsigned int t, const char* field) {
+	if(pfCalSet.count(rn)) {
+		std::map<std::string, std::map<std::string,double> >::const_iterator it = pfTubecal.find(tubecalKey(getCalSetInfo(rn,"ecal_id"),sideWords(s),t));
+		if(it != pfTubecal.end()) {
+			std::map<std::string,double>::const_iterator fit = it->second.find(field);
+			if(fit != it->second.end())
+				return float(fit->second);
+		}
+	}
 	unsigned int tsid = getTubecalID(rn, s, t);
 	assert(tsid || IGNORE_DEAD_DB);
 	sprintf(query,"SELECT %s FROM tube_calibration WHERE tubecal_id = %i",field,tsid);
@@ -216,6 +482,14 @@ float CalDBSQL::getTubecalData(RunNum rn, Side s, unsigned int t, const char* fi
 }
 
 int CalDBSQL::getTubecalInt(RunNum rn, Side s, unsigned int t, const char* field) {
+	if(pfCalSet.count(rn)) {
+		std::map<std::string, std::map<std::string,double> >::const_iterator it = pfTubecal.find(tubecalKey(getCalSetInfo(rn,"ecal_id"),sideWords(s),t));
+		if(it != pfTubecal.end()) {
+			std::map<std::string,double>::const_iterator fit = it->second.find(field);
+			if(fit != it->second.end())
+				return int(fit->second);
+		}
+	}
 	unsigned int tsid = getTubecalID(rn, s, t);
 	assert(tsid || IGNORE_DEAD_DB);
 	sprintf(query,"SELECT %s FROM tube_calibration WHERE tubecal_id = %i",field,tsid);
@@ -237,6 +511,9 @@ const char* CalDBSQL::dbSideName(Side s) const {
 }
 
 int CalDBSQL::startTime(RunNum rn, int t0) {
+	std::map<RunNum, std::pair<int,int> >::const_iterator it = pfRunTimes.find(rn);
+	if(it != pfRunTimes.end())
+		return it->second.first-t0;
 	sprintf(query,"SELECT UNIX_TIMESTAMP(start_time)-%i FROM run WHERE run_number = %u",t0,rn);
 	TSQLRow* row = getFirst();
 	if(!row)
@@ -247,6 +524,9 @@ int CalDBSQL::startTime(RunNum rn, int t0) {
 }
 
 int CalDBSQL::endTime(RunNum rn, int t0) {
+	std::map<RunNum, std::pair<int,int> >::const_iterator it = pfRunTimes.find(rn);
+	if(it != pfRunTimes.end())
+		return it->second.second-t0;
 	sprintf(query,"SELECT UNIX_TIMESTAMP(end_time)-%i FROM run WHERE run_number = %u",t0,rn);
 	TSQLRow* row = getFirst();
 	if(!row)
@@ -258,6 +538,13 @@ int CalDBSQL::endTime(RunNum rn, int t0) {
 
 BlindTime CalDBSQL::fiducialTime(RunNum rn) {
 	BlindTime b = 0;
+	std::map<RunNum, std::vector<float> >::const_iterator it = pfAnalysis.find(rn);
+	if(it != pfAnalysis.end()) {
+		b.t[EAST] = it->second[0];
+		b.t[WEST] = it->second[1];
+		b.t[BOTH] = it->second[2];
+		return b;
+	}
 	sprintf(query,"SELECT live_time_e,live_time_w,live_time FROM analysis WHERE run_number = %u",rn);
 	TSQLRow* row = getFirst();
 	if(!row)
@@ -270,6 +557,9 @@ BlindTime CalDBSQL::fiducialTime(RunNum rn) {
 }
 
 float CalDBSQL::totalTime(RunNum rn) {
+	std::map<RunNum, std::vector<float> >::const_iterator it = pfAnalysis.find(rn);
+	if(it != pfAnalysis.end())
+		return it->second[3];
 	sprintf(query,"SELECT total_time FROM analysis WHERE run_number = %u",rn);
 	TSQLRow* row = getFirst();
 	if(!row)
@@ -280,6 +570,9 @@ float CalDBSQL::totalTime(RunNum rn) {
 }
 
 std::string CalDBSQL::getGroupName(RunNum rn) {
+	std::map<RunNum,std::string>::const_iterator it = pfGroupName.find(rn);
+	if(it != pfGroupName.end())
+		return it->second;
 	sprintf(query,"SELECT name,start_run FROM run_group WHERE start_run <= %i AND %i <= end_run ORDER BY end_run-start_run LIMIT 1",rn,rn);
 	TSQLRow* r = getFirst();
 	if(!r)
@@ -296,12 +589,23 @@ RunInfo CalDBSQL::getRunInfo(RunNum r) {
 	R.startTime = startTime(r);
 	R.groupName = getGroupName(r);
 	
-	//                    0               1        2        3          4       5
-	sprintf(query,"SELECT slow_run_number,run_type,asym_oct,gate_valve,flipper,scs_field FROM run WHERE run_number = %u",r);
-	TSQLRow* row = getFirst();
-	assert(row);
+	std::vector<std::string> f;
+	std::map<RunNum, std::vector<std::string> >::const_iterator it = pfRunInfo.find(r);
+	if(it != pfRunInfo.end()) {
+		f = it->second;
+	} else {
+		//                    0               1        2        3          4       5
+		sprintf(query,"SELECT slow_run_number,run_type,asym_oct,gate_valve,flipper,scs_field FROM run WHERE run_number = %u",r);
+		TSQLRow* row = getFirst();
+		assert(row);
+		f.push_back(fieldAsString(row,0,"0"));
+		for(unsigned int i=1; i<5; i++)
+			f.push_back(fieldAsString(row,i,"Other"));
+		f.push_back(fieldAsString(row,5,"0"));
+		delete(row);
+	}
 	
-	R.roleName = fieldAsString(row,2,"Other");
+	R.roleName = f[2];
 	R.octet = 0;
 	if(R.roleName[0] == 'A' || R.roleName[0] == 'B') {
 		R.octet += atoi(R.roleName.c_str()+1);
@@ -311,8 +615,8 @@ RunInfo CalDBSQL::getRunInfo(RunNum r) {
 	if(R.octet)
 		R.triad = TriadType((R.octet-1)/3+1);
 	
-	R.slowDaq = fieldAsInt(row,0,0);
-	std::string s = fieldAsString(row,1,"Other");
+	R.slowDaq = atoi(f[0].c_str());
+	std::string s = f[1];
 	if(s=="Asymmetry")
 		R.type = ASYMMETRY_RUN;
 	else if(s=="LEDCalib")
@@ -326,7 +630,7 @@ RunInfo CalDBSQL::getRunInfo(RunNum r) {
 	} else
 		R.type = UNKNOWN_RUN;
 	
-	s = fieldAsString(row,3,"Other");
+	s = f[3];
 	if(s=="Open")
 		R.gvState = GV_OPEN;
 	else if(s=="Closed")
@@ -334,7 +638,7 @@ RunInfo CalDBSQL::getRunInfo(RunNum r) {
 	else
 		R.gvState = GV_OTHER;
 	
-	s=fieldAsString(row,4,"Other");
+	s = f[4];
 	if(s=="On")
 		R.afpState = AFP_ON;
 	else if (s=="Off")
@@ -346,9 +650,7 @@ RunInfo CalDBSQL::getRunInfo(RunNum r) {
 	else
 		R.afpState = AFP_OTHER;
 	
-	R.scsField = fieldAsFloat(row,5,0);
-	
-	delete(row);
+	R.scsField = atof(f[5].c_str());
 	
 	return R;
 }
@@ -369,23 +671,30 @@ std::vector<RunNum> CalDBSQL::findRuns(const char* whereConditions) {
 }
 
 EfficCurve* CalDBSQL::getTrigeff(RunNum rn, Side s, unsigned int t) {
-	sprintf(query,"SELECT params_graph FROM mpm_trigeff WHERE run_number = %i AND side = %s AND quadrant = %i",rn,dbSideName(s),t);
-	Query();
-	if(!res)
-		return NULL;
-	TSQLRow* r = res->Next();
-	if(!r)
-		return NULL;
-	int gid = fieldAsInt(r,0);
-	delete(r);
-	sprintf(query,"SELECT y_value FROM graph_points WHERE graph_id = %i ORDER BY x_value ASC",gid);
-	Query();
-	if(!res)
-		return NULL;
 	std::vector<double> v;
-	while((r = res->Next())) {
-		v.push_back(fieldAsFloat(r,0));
+	std::map<std::string,unsigned int>::const_iterator it = pfTrigeff.find(runDataKey(rn,sideWords(s),itos(t)));
+	std::map<unsigned int, std::vector<float> >::const_iterator git;
+	if(it != pfTrigeff.end() && (git = pfGraphs.find(it->second)) != pfGraphs.end()) {
+		for(unsigned int i=2; i<git->second.size(); i+=4)
+			v.push_back(git->second[i]);
+	} else {
+		sprintf(query,"SELECT params_graph FROM mpm_trigeff WHERE run_number = %i AND side = %s AND quadrant = %i",rn,dbSideName(s),t);
+		Query();
+		if(!res)
+			return NULL;
+		TSQLRow* r = res->Next();
+		if(!r)
+			return NULL;
+		int gid = fieldAsInt(r,0);
 		delete(r);
+		sprintf(query,"SELECT y_value FROM graph_points WHERE graph_id = %i ORDER BY x_value ASC",gid);
+		Query();
+		if(!res)
+			return NULL;
+		while((r = res->Next())) {
+			v.push_back(fieldAsFloat(r,0));
+			delete(r);
+		}
 	}
 	if(v.size() != 4)
 		return NULL;
@@ -408,17 +717,24 @@ TGraph* CalDBSQL::getEvisConversion(RunNum rn, Side s, EventType tp) {
 
 TGraphErrors* CalDBSQL::getGraph(unsigned int gid) {
 	std::vector<float> gdata[4];
-	sprintf(query,"SELECT x_value,x_error,y_value,y_error FROM graph_points WHERE graph_id = %i ORDER BY x_value ASC",gid);
-	Query();
-	if(!res) {
-		printf("*** Warning: no graph found for <%i>!\n",gid);
-		return NULL;
-	}
-	TSQLRow* r;
-	while((r = res->Next())) {
-		for(unsigned int i=0; i<4; i++)
-			gdata[i].push_back(fieldAsFloat(r,i));
-		delete(r);
+	std::map<unsigned int, std::vector<float> >::const_iterator it = pfGraphs.find(gid);
+	if(it != pfGraphs.end()) {
+		for(unsigned int n=0; n+3<it->second.size(); n+=4)
+			for(unsigned int i=0; i<4; i++)
+				gdata[i].push_back(it->second[n+i]);
+	} else {
+		sprintf(query,"SELECT x_value,x_error,y_value,y_error FROM graph_points WHERE graph_id = %i ORDER BY x_value ASC",gid);
+		Query();
+		if(!res) {
+			printf("*** Warning: no graph found for <%i>!\n",gid);
+			return NULL;
+		}
+		TSQLRow* r;
+		while((r = res->Next())) {
+			for(unsigned int i=0; i<4; i++)
+				gdata[i].push_back(fieldAsFloat(r,i));
+			delete(r);
+		}
 	}
 	unsigned int npts = gdata[0].size();
 	if(!npts) {
@@ -522,6 +838,7 @@ unsigned int CalDBSQL::newGraph(const std::string& description) {
 }
 
 void CalDBSQL::deleteGraph(unsigned int gid) {
+	clearPrefetch();
 	printf("Deleting graph %i...\n",gid);
 	sprintf(query,"DELETE FROM graph_points WHERE graph_id = %i",gid);
 	execute();
@@ -545,6 +862,7 @@ unsigned int CalDBSQL::uploadGraph(const std::string& description, std::vector<d
 }
 
 void CalDBSQL::uploadTrigeff(RunNum rn, Side s, unsigned int t, std::vector<double> params, std::vector<double> dparams) {
+	clearPrefetch();
 	unsigned int pgid = uploadGraph("Trigger Efficiency Params",std::vector<double>(),params,std::vector<double>(),dparams);
 	sprintf(query,"INSERT INTO mpm_trigeff(run_number,side,quadrant,params_graph) VALUES (%i,'%s',%i,%i)",
 			rn,sideWords(s),t,pgid);
@@ -552,6 +870,7 @@ void CalDBSQL::uploadTrigeff(RunNum rn, Side s, unsigned int t, std::vector<doub
 }
 
 void CalDBSQL::deleteTrigeff(RunNum rn, Side s, unsigned int t) {
+	clearPrefetch();
 	sprintf(query,"SELECT params_graph FROM mpm_trigeff WHERE run_number = %i AND side = '%s' AND quadrant = %i",rn,sideWords(s),t);
 	Query();
 	TSQLRow* r;
@@ -570,6 +889,7 @@ void CalDBSQL::deleteTrigeff(RunNum rn, Side s, unsigned int t) {
 
 
 void CalDBSQL::deleteRunMonitor(RunNum rn, const std::string& sensorName, const std::string& monType) {
+	clearPrefetch();
 	sprintf(query,"SELECT center_graph_id, width_graph_id,monitor_id FROM run_monitors,sensors WHERE run_number = %i \
 			AND sensors_sensor_id = sensor_id AND sensor_name = '%s' AND monitor_type = '%s'",rn,sensorName.c_str(),monType.c_str());
 	Query();
@@ -607,6 +927,7 @@ unsigned int CalDBSQL::getSensorID(const std::string& sname) {
 }
 
 void CalDBSQL::addRunMonitor(RunNum rn, const std::string& sensorName, const std::string& monType, unsigned int cgid, unsigned int wgid) {
+	clearPrefetch();
 	unsigned int sid = getSensorID(sensorName);
 	sprintf(query,"INSERT INTO run_monitors (run_number,sensors_sensor_id,monitor_type,center_graph_id,width_graph_id) \
 			VALUES (%i,%i,'%s',%i,%i)",rn,sid,monType.c_str(),cgid,wgid);
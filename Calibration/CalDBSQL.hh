@@ -71,6 +71,12 @@ public:
 	virtual PositioningCorrector* getPositioningCorrector(RunNum rn);
 	/// get positioning corrector by ID number
 	PositioningCorrector* getPositioningCorrectorByID(unsigned int psid);
+	/// get positioning map ID for given run
+	unsigned int getPosmapID(RunNum rn) { return getCalSetInfo(rn,"posmap_set_id"); }
+	/// get anode positioning map ID for given run
+	unsigned int getAnodePosmapID(RunNum rn) { return int(getAnodeCalInfo(rn,"anode_posmap_id")); }
+	/// get positioning map data by ID number
+	std::vector<PosmapInfo> getPosmapInfo(unsigned int psid);
 	
 	/// get anode positioning corrector for given run
 	virtual PositioningCorrector* getAnodePositioningCorrector(RunNum rn);
@@ -100,6 +106,15 @@ public:
 	
 	/// globally available CalDB
 	static CalDBSQL* getCDB(bool readonly = true);
+	/// in a forked worker process, close globally available CalDB connections inherited from the parent
+	/// (without ending the parent's sessions); existing CalDBSQL objects re-connect on their next query
+	static void forgetCDB();
+	
+	/// bulk-load calibration data for listed runs (and their GMS reference runs) into local cache, to serve later queries;
+	/// pedestal monitor graphs (needed for replay, not analysis) are only loaded if requested
+	void prefetch(const std::vector<RunNum>& runs, bool withPedestals = false);
+	/// discard prefetched calibration data
+	void clearPrefetch();
 	
 	/// create an ID for a new graph
 	unsigned int newGraph(const std::string& description);
@@ -145,8 +160,22 @@ protected:
 	TGraphErrors* getGraph(unsigned int gid, RunNum rn);
 	/// get run group name for run
 	std::string getGroupName(RunNum rn);
+	/// prefetch energy_calibration set info for listed runs
+	void prefetchCalSets(const std::vector<RunNum>& runs);
+	/// prefetch points for listed graph IDs
+	void prefetchGraphs(const std::vector<unsigned int>& gids);
 	
 	std::map<unsigned int,PositioningCorrector*> pcors;	//< cached positioning correctors
+	
+	std::map<RunNum, std::map<std::string,int> > pfCalSet;					//< prefetched energy_calibration fields by run
+	std::map<std::string, std::map<std::string,double> > pfTubecal;		//< prefetched tube_calibration fields by ecal_id/side/quadrant
+	std::map<RunNum, std::pair<int,int> > pfRunTimes;						//< prefetched run start, end times
+	std::map<RunNum, std::vector<std::string> > pfRunInfo;					//< prefetched run table fields for getRunInfo
+	std::map<RunNum, std::string> pfGroupName;								//< prefetched run group names
+	std::map<RunNum, std::vector<float> > pfAnalysis;						//< prefetched analysis table live_time_e,_w,live_time,total_time
+	std::map<std::string, std::pair<unsigned int,unsigned int> > pfMonitors;	//< prefetched run monitor center, width graph IDs by run/sensor/type
+	std::map<std::string, unsigned int> pfTrigeff;							//< prefetched trigger efficiency parameter graph IDs by run/side/quadrant
+	std::map<unsigned int, std::vector<float> > pfGraphs;					//< prefetched graph points (x,dx,y,dy) by graph ID
 };
 
 #endif
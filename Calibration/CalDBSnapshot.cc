@@ -0,0 +1,445 @@
+#include "CalDBSnapshot.hh"
+#include "EnergyCalibrator.hh"
+#include "WirechamberReconstruction.hh"
+#include "PathUtils.hh"
+#include "strutils.hh"
+#include <stdio.h>
+#include <string.h>
+#include <utility>
+
+/// snapshot file format identifier
+static const char snapshotMagic[8] = {'U','C','N','A','C','D','B','1'};
+
+/// key for per-run quantity
+inline std::string runKey(const char* nm, RunNum rn) { return std::string(nm)+"_"+itos(rn); }
+/// key for per-run, per-side quantity
+inline std::string sideKey(const char* nm, RunNum rn, Side s) { return runKey(nm,rn)+"_"+ctos(sideNames(s)); }
+/// key for per-run, per-tube quantity
+inline std::string tubeKey(const char* nm, RunNum rn, Side s, unsigned int t) { return sideKey(nm,rn,s)+itos(t); }
+/// key for per-run, per-sensor monitor
+inline std::string monKey(const char* nm, RunNum rn, const std::string& sensorName, const std::string& monType) {
+	return runKey(nm,rn)+"_"+sensorName+"_"+monType;
+}
+
+/// read block of bytes from buffer, checking bounds
+inline bool readBytes(const char*& p, const char* end, void* x, size_t n) {
+	if(p+n > end) return false;
+	memcpy(x,p,n);
+	p += n;
+	return true;
+}
+
+CalDBSnapshot::CalDBSnapshot(CalDBSQL* source): src(source) {}
+
+CalDBSnapshot::CalDBSnapshot(const std::string& fname): src(NULL), fileName(fname) {
+	FILE* f = fopen(fname.c_str(),"rb");
+	if(!f) {
+		printf("*** Unable to open calibration snapshot '%s'!\n",fname.c_str());
+		return;
+	}
+	std::vector<char> buf;
+	char chunk[1<<16];
+	size_t n;
+	while((n = fread(chunk,1,sizeof(chunk),f)))
+		buf.insert(buf.end(),chunk,chunk+n);
+	fclose(f);
+
+	const char* p = buf.size() ? &buf[0] : NULL;
+	const char* end = p+buf.size();
+	char magic[sizeof(snapshotMagic)];
+	unsigned int nEntries = 0;
+	if(!readBytes(p,end,magic,sizeof(magic)) || memcmp(magic,snapshotMagic,sizeof(magic)) || !readBytes(p,end,&nEntries,sizeof(nEntries))) {
+		printf("*** '%s' is not a calibration snapshot file!\n",fname.c_str());
+		return;
+	}
+	for(unsigned int i=0; i<nEntries; i++) {
+		unsigned int kl,nv,sl;
+		if(!readBytes(p,end,&kl,sizeof(kl)) || p+kl > end) break;
+		std::string k(p,kl);
+		p += kl;
+		SnapshotEntry& e = entries[k];
+		if(!readBytes(p,end,&nv,sizeof(nv)) || p+nv*sizeof(double) > end) break;
+		e.v.resize(nv);
+		if(nv) readBytes(p,end,&e.v[0],nv*sizeof(double));
+		if(!readBytes(p,end,&sl,sizeof(sl)) || p+sl > end) break;
+		e.s = std::string(p,sl);
+		p += sl;
+	}
+	if(entries.size() != nEntries)
+		printf("*** Calibration snapshot '%s' truncated: %i of %i entries read!\n",fname.c_str(),(int)entries.size(),nEntries);
+	printf("Loaded %i entries from calibration snapshot '%s'.\n",(int)entries.size(),fname.c_str());
+}
+
+CalDBSnapshot::~CalDBSnapshot() {
+	for(std::map<unsigned int,PositioningCorrector*>::iterator it = pcors.begin(); it != pcors.end(); it++)
+		delete it->second;
+}
+
+CalDBSnapshot* CalDBSnapshot::getSnapshot() {
+	static CalDBSnapshot* S = NULL;
+	static bool loaded = false;
+	if(!loaded) {
+		loaded = true;
+		std::string fname = getEnvSafe("UCNACALSNAPSHOT","");
+		if(fname.size())
+			S = new CalDBSnapshot(fname);
+	}
+	return S;
+}
+
+CalDB* CalDBSnapshot::getActiveCDB() {
+	CalDB* CDB = getSnapshot();
+	return CDB ? CDB : CalDBSQL::getCDB();
+}
+
+bool CalDBSnapshot::write(const std::string& fname) const {
+	makePath(fname,true);
+	FILE* f = fopen(fname.c_str(),"wb");
+	if(!f) {
+		printf("*** Unable to write calibration snapshot '%s'!\n",fname.c_str());
+		return false;
+	}
+	unsigned int nEntries = entries.size();
+	fwrite(snapshotMagic,1,sizeof(snapshotMagic),f);
+	fwrite(&nEntries,sizeof(nEntries),1,f);
+	for(std::map<std::string,SnapshotEntry>::const_iterator it = entries.begin(); it != entries.end(); it++) {
+		unsigned int kl = it->first.size();
+		unsigned int nv = it->second.v.size();
+		unsigned int sl = it->second.s.size();
+		fwrite(&kl,sizeof(kl),1,f);
+		fwrite(it->first.data(),1,kl,f);
+		fwrite(&nv,sizeof(nv),1,f);
+		if(nv) fwrite(&it->second.v[0],sizeof(double),nv,f);
+		fwrite(&sl,sizeof(sl),1,f);
+		fwrite(it->second.s.data(),1,sl,f);
+	}
+	bool ok = !ferror(f);
+	fclose(f);
+	printf("Wrote %i entries to calibration snapshot '%s'.\n",nEntries,fname.c_str());
+	return ok;
+}
+
+bool CalDBSnapshot::captureRun(RunNum rn) {
+	assert(src);
+	if(!isValid(rn)) {
+		printf("*** No valid calibrations for run %i; not captured.\n",rn);
+		return false;
+	}
+	printf("Capturing calibrations for run %i...\n",rn);
+	getRunInfo(rn);
+	startTime(rn);
+	endTime(rn);
+	fiducialTime(rn);
+	totalTime(rn);
+
+	// GMS reference run, which may already be cached by LinearityCorrector
+	RunNum rGMS = getGMSRun(rn);
+	if(rGMS && rGMS != rn) {
+		LinearityCorrector LCRef(rGMS,this);
+	}
+
+	PMTCalibrator PCal(rn,this);
+	for(Side s = EAST; s <= WEST; ++s) {
+		for(unsigned int t=0; t<nBetaTubes; t++)
+			PCal.checkPedestals(PCal.sensorNames[s][t]);
+		for(unsigned int d = X_DIRECTION; d <= Y_DIRECTION; d++) {
+			std::vector<std::string> cnames = getCathodeNames(rn,s,AxisDirection(d));
+			for(std::vector<std::string>::const_iterator it = cnames.begin(); it != cnames.end(); it++)
+				PCal.checkPedestals(*it);
+		}
+		PCal.checkPedestals(sideSubst("MWPC%cAnode",s));
+	}
+	return true;
+}
+
+const SnapshotEntry* CalDBSnapshot::find(const std::string& key) const {
+	std::map<std::string,SnapshotEntry>::const_iterator it = entries.find(key);
+	if(it == entries.end()) {
+		printf("*** Warning: '%s' not in calibration snapshot!\n",key.c_str());
+		return NULL;
+	}
+	return &it->second;
+}
+
+double CalDBSnapshot::recordValue(const std::string& key, double x) {
+	SnapshotEntry& e = entries[key];
+	e.v.assign(1,x);
+	return x;
+}
+
+double CalDBSnapshot::loadValue(const std::string& key) const {
+	const SnapshotEntry* e = find(key);
+	return e && e->v.size() ? e->v[0] : 0;
+}
+
+TGraphErrors* CalDBSnapshot::recordGraph(const std::string& key, TGraph* g) {
+	SnapshotEntry& e = entries[key];
+	e.v.clear();
+	if(!g) return NULL;
+	for(int i=0; i<g->GetN(); i++) {
+		double x,y;
+		g->GetPoint(i,x,y);
+		double dx = g->GetErrorX(i);
+		double dy = g->GetErrorY(i);
+		e.v.push_back(x);
+		e.v.push_back(dx>0?dx:0);
+		e.v.push_back(y);
+		e.v.push_back(dy>0?dy:0);
+	}
+	delete g;
+	return loadGraph(key);
+}
+
+TGraphErrors* CalDBSnapshot::loadGraph(const std::string& key) const {
+	const SnapshotEntry* e = find(key);
+	if(!e || !e->v.size())
+		return NULL;
+	unsigned int npts = e->v.size()/4;
+	TGraphErrors* tg = new TGraphErrors(npts);
+	for(unsigned int i=0; i<npts; i++) {
+		tg->SetPoint(i,e->v[4*i],e->v[4*i+2]);
+		tg->SetPointError(i,e->v[4*i+1],e->v[4*i+3]);
+	}
+	return tg;
+}
+
+PositioningCorrector* CalDBSnapshot::getPositioningCorrectorByID(unsigned int psid) {
+	std::map<unsigned int,PositioningCorrector*>::iterator it = pcors.find(psid);
+	if(it != pcors.end())
+		return it->second;
+
+	// posmap stored as: number of tubes; then for each tube, side, tube, rings, radius, points, adc values, energy values
+	std::string k = "posmap_"+itos(psid);
+	if(src && !entries.count(k)) {
+		std::vector<PosmapInfo> pinf = src->getPosmapInfo(psid);
+		SnapshotEntry& e = entries[k];
+		e.v.push_back(pinf.size());
+		for(std::vector<PosmapInfo>::const_iterator pit = pinf.begin(); pit != pinf.end(); pit++) {
+			e.v.push_back(pit->s);
+			e.v.push_back(pit->t);
+			e.v.push_back(pit->nRings);
+			e.v.push_back(pit->radius);
+			e.v.push_back(pit->adc.size());
+			e.v.insert(e.v.end(),pit->adc.begin(),pit->adc.end());
+			e.v.insert(e.v.end(),pit->energy.begin(),pit->energy.end());
+		}
+	}
+	const SnapshotEntry* e = find(k);
+	if(!e || !e->v.size())
+		return NULL;
+	std::vector<PosmapInfo> pinf(e->v[0]);
+	unsigned int n = 1;
+	for(std::vector<PosmapInfo>::iterator pit = pinf.begin(); pit != pinf.end(); pit++) {
+		pit->s = Side(e->v[n++]);
+		pit->t = e->v[n++];
+		pit->nRings = e->v[n++];
+		pit->radius = e->v[n++];
+		unsigned int npts = e->v[n++];
+		pit->adc.assign(e->v.begin()+n,e->v.begin()+n+npts);
+		n += npts;
+		pit->energy.assign(e->v.begin()+n,e->v.begin()+n+npts);
+		n += npts;
+	}
+	assert(n == e->v.size());
+	assert(pinf.size() || IGNORE_DEAD_DB);
+	if(!pinf.size()) return NULL;
+
+	printf("Loading positioning corrector %i from snapshot...\n",psid);
+	PositioningCorrector* P = new PositioningCorrector(pinf);
+	pcors.insert(std::make_pair(psid,P));
+	return P;
+}
+
+bool CalDBSnapshot::isValid(RunNum rn) {
+	std::string k = runKey("valid",rn);
+	if(src) return recordValue(k,src->isValid(rn));
+	return entries.count(k) && loadValue(k);
+}
+
+TGraph* CalDBSnapshot::getLinearity(RunNum rn, Side s, unsigned int t) {
+	std::string k = tubeKey("linearity",rn,s,t);
+	if(src) return recordGraph(k,src->getLinearity(rn,s,t));
+	return loadGraph(k);
+}
+
+float CalDBSnapshot::getNoiseWidth(RunNum rn, Side s, unsigned int t) {
+	std::string k = tubeKey("noisewidth",rn,s,t);
+	if(src) return recordValue(k,src->getNoiseWidth(rn,s,t));
+	return loadValue(k);
+}
+
+float CalDBSnapshot::getNoiseADC(RunNum rn, Side s, unsigned int t) {
+	std::string k = tubeKey("noiseadc",rn,s,t);
+	if(src) return recordValue(k,src->getNoiseADC(rn,s,t));
+	return loadValue(k);
+}
+
+TGraphErrors* CalDBSnapshot::getRunMonitor(RunNum rn, const std::string& sensorName, const std::string& monType, bool centers) {
+	std::string k = monKey(centers?"moncenter":"monwidth",rn,sensorName,monType);
+	if(src) return recordGraph(k,src->getRunMonitor(rn,sensorName,monType,centers));
+	return loadGraph(k);
+}
+
+float CalDBSnapshot::getRunMonitorStart(RunNum rn, const std::string& sensorName, const std::string& monType) {
+	std::string k = monKey("monstart",rn,sensorName,monType);
+	if(src) return recordValue(k,src->getRunMonitorStart(rn,sensorName,monType));
+	return loadValue(k);
+}
+
+TGraph* CalDBSnapshot::getPedestals(RunNum rn, const std::string& sensorName) {
+	std::string k = monKey("ped",rn,sensorName,"pedestal");
+	if(src) return recordGraph(k,src->getPedestals(rn,sensorName));
+	return loadGraph(k);
+}
+
+TGraph* CalDBSnapshot::getPedwidths(RunNum rn, const std::string& sensorName) {
+	std::string k = monKey("pedw",rn,sensorName,"pedestal");
+	if(src) return recordGraph(k,src->getPedwidths(rn,sensorName));
+	return loadGraph(k);
+}
+
+RunNum CalDBSnapshot::getGMSRun(RunNum rn) {
+	std::string k = runKey("gmsrun",rn);
+	if(src) return (RunNum)recordValue(k,src->getGMSRun(rn));
+	return (RunNum)loadValue(k);
+}
+
+float CalDBSnapshot::getEcalADC(RunNum rn, Side s, unsigned int t) {
+	std::string k = tubeKey("ecaladc",rn,s,t);
+	if(src) return recordValue(k,src->getEcalADC(rn,s,t));
+	return loadValue(k);
+}
+
+float CalDBSnapshot::getEcalEvis(RunNum rn, Side s, unsigned int t) {
+	std::string k = tubeKey("ecalevis",rn,s,t);
+	if(src) return recordValue(k,src->getEcalEvis(rn,s,t));
+	return loadValue(k);
+}
+
+float CalDBSnapshot::getEcalX(RunNum rn, Side s) {
+	std::string k = sideKey("ecalx",rn,s);
+	if(src) return recordValue(k,src->getEcalX(rn,s));
+	return loadValue(k);
+}
+
+float CalDBSnapshot::getEcalY(RunNum rn, Side s) {
+	std::string k = sideKey("ecaly",rn,s);
+	if(src) return recordValue(k,src->getEcalY(rn,s));
+	return loadValue(k);
+}
+
+PositioningCorrector* CalDBSnapshot::getPositioningCorrector(RunNum rn) {
+	std::string k = runKey("posmapid",rn);
+	if(src) return getPositioningCorrectorByID(recordValue(k,src->getPosmapID(rn)));
+	return entries.count(k) ? getPositioningCorrectorByID(loadValue(k)) : NULL;
+}
+
+PositioningCorrector* CalDBSnapshot::getAnodePositioningCorrector(RunNum rn) {
+	std::string k = runKey("anodeposmapid",rn);
+	if(src) return getPositioningCorrectorByID(recordValue(k,src->getAnodePosmapID(rn)));
+	return entries.count(k) ? getPositioningCorrectorByID(loadValue(k)) : NULL;
+}
+
+float CalDBSnapshot::getAnodeGain(RunNum rn, Side s) {
+	std::string k = sideKey("anodegain",rn,s);
+	if(src) return recordValue(k,src->getAnodeGain(rn,s));
+	return loadValue(k);
+}
+
+EfficCurve* CalDBSnapshot::getTrigeff(RunNum rn, Side s, unsigned int t) {
+	std::string k = tubeKey("trigeff",rn,s,t);
+	if(src) {
+		EfficCurve* C = src->getTrigeff(rn,s,t);
+		SnapshotEntry& e = entries[k];
+		e.v.clear();
+		if(C) e.v.assign(C->params,C->params+4);
+		return C;
+	}
+	const SnapshotEntry* e = find(k);
+	if(!e || e->v.size() != 4)
+		return NULL;
+	EfficCurve* C = new EfficCurve();
+	for(unsigned int i=0; i<4; i++)
+		C->params[i] = e->v[i];
+	return C;
+}
+
+TGraph* CalDBSnapshot::getEvisConversion(RunNum rn, Side s, EventType tp) {
+	std::string k = sideKey("evisconv",rn,s)+itos(tp);
+	if(src) return recordGraph(k,src->getEvisConversion(rn,s,tp));
+	return loadGraph(k);
+}
+
+int CalDBSnapshot::startTime(RunNum rn, int t0) {
+	std::string k = runKey("starttime",rn);
+	if(src) return int(recordValue(k,src->startTime(rn)))-t0;
+	return int(loadValue(k))-t0;
+}
+
+int CalDBSnapshot::endTime(RunNum rn, int t0) {
+	std::string k = runKey("endtime",rn);
+	if(src) return int(recordValue(k,src->endTime(rn)))-t0;
+	return int(loadValue(k))-t0;
+}
+
+BlindTime CalDBSnapshot::fiducialTime(RunNum rn) {
+	std::string k = runKey("fidtime",rn);
+	if(src) {
+		BlindTime b = src->fiducialTime(rn);
+		SnapshotEntry& e = entries[k];
+		e.v.clear();
+		e.v.push_back(b.t[EAST]);
+		e.v.push_back(b.t[WEST]);
+		e.v.push_back(b.t[BOTH]);
+		return b;
+	}
+	BlindTime b = 0;
+	const SnapshotEntry* e = find(k);
+	if(!e || e->v.size() != 3)
+		return b;
+	b.t[EAST] = e->v[0];
+	b.t[WEST] = e->v[1];
+	b.t[BOTH] = e->v[2];
+	return b;
+}
+
+float CalDBSnapshot::totalTime(RunNum rn) {
+	std::string k = runKey("totaltime",rn);
+	if(src) return recordValue(k,src->totalTime(rn));
+	return loadValue(k);
+}
+
+RunInfo CalDBSnapshot::getRunInfo(RunNum r) {
+	std::string k = runKey("runinfo",r);
+	if(src) {
+		RunInfo R = src->getRunInfo(r);
+		SnapshotEntry& e = entries[k];
+		e.v.clear();
+		e.v.push_back(R.slowDaq);
+		e.v.push_back(R.type);
+		e.v.push_back(R.octet);
+		e.v.push_back(R.triad);
+		e.v.push_back(R.gvState);
+		e.v.push_back(R.afpState);
+		e.v.push_back(R.startTime);
+		e.v.push_back(R.scsField);
+		e.s = R.groupName+"\n"+R.roleName;
+		return R;
+	}
+	RunInfo R(r);
+	const SnapshotEntry* e = find(k);
+	if(!e || e->v.size() != 8)
+		return R;
+	R.slowDaq = int(e->v[0]);
+	R.type = RunType(e->v[1]);
+	R.octet = OctetType(e->v[2]);
+	R.triad = TriadType(e->v[3]);
+	R.gvState = GVState(e->v[4]);
+	R.afpState = AFPState(e->v[5]);
+	R.startTime = e->v[6];
+	R.scsField = e->v[7];
+	size_t n = e->s.find('\n');
+	R.groupName = e->s.substr(0,n);
+	R.roleName = n==std::string::npos ? "" : e->s.substr(n+1);
+	return R;
+}
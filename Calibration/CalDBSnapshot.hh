@@ -0,0 +1,116 @@
+#ifndef CALDBSNAPSHOT_HH
+#define CALDBSNAPSHOT_HH 1
+
+#include "CalDB.hh"
+#include "CalDBSQL.hh"
+#include <map>
+#include <string>
+#include <vector>
+
+/// one stored calibration DB query result
+struct SnapshotEntry {
+	std::vector<double> v;	//< numerical values
+	std::string s;			//< text value
+};
+
+/// calibration DB served from a local binary snapshot file, recorded once from the SQL DB for a range of runs
+class CalDBSnapshot: public CalDB {
+public:
+	/// constructor, loading snapshot from file
+	CalDBSnapshot(const std::string& fname);
+	/// constructor, recording query results passed through from SQL DB
+	CalDBSnapshot(CalDBSQL* source);
+	/// destructor
+	~CalDBSnapshot();
+
+	/// record all calibration data used for replaying or analyzing a run; return false if no valid calibrations
+	bool captureRun(RunNum rn);
+	/// write snapshot to file
+	bool write(const std::string& fname) const;
+	/// number of stored entries
+	unsigned int size() const { return entries.size(); }
+
+	/// globally available snapshot, loaded from file in $UCNACALSNAPSHOT; NULL if unset
+	static CalDBSnapshot* getSnapshot();
+	/// active calibrations DB: global snapshot if loaded, otherwise SQL DB
+	static CalDB* getActiveCDB();
+
+	/// check if valid data available for run
+	bool isValid(RunNum rn);
+
+	/// get linearity correction data
+	TGraph* getLinearity(RunNum rn, Side s, unsigned int t);
+	/// get noise estimate calibration point ADC width
+	float getNoiseWidth(RunNum rn, Side s, unsigned int t);
+	/// get noise estimate calibration point raw ADC value
+	float getNoiseADC(RunNum rn, Side s, unsigned int t);
+
+	/// get a run monitor graph
+	TGraphErrors* getRunMonitor(RunNum rn, const std::string& sensorName, const std::string& monType, bool centers = true);
+	/// get initial value for run monitor graph
+	float getRunMonitorStart(RunNum rn, const std::string& sensorName, const std::string& monType);
+
+	/// get pedestals for named sensor
+	TGraph* getPedestals(RunNum rn, const std::string& sensorName);
+	/// get pedestal widths for named sensor
+	TGraph* getPedwidths(RunNum rn, const std::string& sensorName);
+
+	/// get Calibrations DB name
+	std::string getName() const { return src ? src->getName()+" (recording snapshot)" : "Snapshot "+fileName; }
+
+	/// get GMS Cal run number
+	RunNum getGMSRun(RunNum rn);
+
+	/// get energy calibration point ADC value
+	float getEcalADC(RunNum rn, Side s, unsigned int t);
+	/// get energy calibration point visible energy
+	float getEcalEvis(RunNum rn, Side s, unsigned int t);
+	/// get energy calibration point x position
+	float getEcalX(RunNum rn, Side s);
+	/// get energy calibration point y position
+	float getEcalY(RunNum rn, Side s);
+
+	/// get positioning corrector for given run
+	PositioningCorrector* getPositioningCorrector(RunNum rn);
+	/// get anode positioning corrector for given run
+	PositioningCorrector* getAnodePositioningCorrector(RunNum rn);
+	/// get anode gain correction factor for run
+	float getAnodeGain(RunNum rn, Side s);
+
+	/// get trigger efficiency function
+	EfficCurve* getTrigeff(RunNum rn, Side s, unsigned int t);
+	/// get E_vis -> E_true parametrization
+	TGraph* getEvisConversion(RunNum rn, Side s, EventType tp);
+
+	/// run start time
+	int startTime(RunNum rn, int t0 = 0);
+	/// run end time
+	int endTime(RunNum rn, int t0 = 0);
+	/// run time after cuts, blinded
+	BlindTime fiducialTime(RunNum rn);
+	/// total run time
+	float totalTime(RunNum rn);
+	/// get RunInfo for given run
+	RunInfo getRunInfo(RunNum r);
+
+protected:
+	/// look up stored entry; NULL (with warning) if not in snapshot
+	const SnapshotEntry* find(const std::string& key) const;
+	/// store single value
+	double recordValue(const std::string& key, double x);
+	/// retrieve single value
+	double loadValue(const std::string& key) const;
+	/// store graph points (NULL graph stored as empty)
+	TGraphErrors* recordGraph(const std::string& key, TGraph* g);
+	/// retrieve graph; NULL if stored empty or missing
+	TGraphErrors* loadGraph(const std::string& key) const;
+	/// get positioning corrector by ID number, recording posmap data as needed
+	PositioningCorrector* getPositioningCorrectorByID(unsigned int psid);
+
+	CalDBSQL* src;									//< source DB when recording; NULL when serving from file
+	std::string fileName;							//< snapshot file name
+	std::map<std::string,SnapshotEntry> entries;	//< stored query results by key
+	std::map<unsigned int,PositioningCorrector*> pcors;	//< cached positioning correctors
+};
+
+#endif
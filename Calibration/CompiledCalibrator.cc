@@ -0,0 +1,349 @@
+#include "CompiledCalibrator.hh"
+#include <TRandom3.h>
+#include <TGraph.h>
+#include <cmath>
+
+const float CompiledCalibrator::posRange = 80.0;
+const float CompiledCalibrator::adcMin = -500.0;
+const float CompiledCalibrator::adcMax = 10000.0;
+
+/// relative difference of table value a to exact value b, with denominator floor
+inline float relDiff(float a, float b, float dfloor) {
+	float d = fabs(b)>dfloor?fabs(b):dfloor;
+	return fabs(a-b)/d;
+}
+
+CompiledCalibrator::CompiledCalibrator(const PMTCalibrator& PC, float tmax, float tol):
+PCal(PC), tolerance(tol), tMax(tmax>1?tmax:1), clipThreshold(PC.getClipThreshold()) {
+	printf("Compiling calibration tables for run %i (tolerance %g)...\n",PCal.rn,tolerance);
+	for(Side s = EAST; s <= WEST; ++s) {
+		for(unsigned int t=0; t<nBetaTubes; t++) {
+			gmsRef[s][t] = PCal.gmsFactor(s,t,0);
+			buildGMS(s,t);
+			buildLinearity(s,t);
+			buildLightWeight(s,t);
+			buildEta(s,t);
+			weight50[s][t] = 50/pow(PCal.lightResolution(s,t,50,0),2.0);
+		}
+	}
+	printSummary();
+}
+
+void CompiledCalibrator::buildGMS(Side s, unsigned int t) {
+	LookupTable& T = gms[s][t];
+	for(unsigned int n = (unsigned int)(tMax/10.)+2; ; n = 2*n-1) {
+		T.init(0,tMax,n);
+		for(unsigned int i=0; i<n; i++)
+			T.y[i] = PCal.gmsFactor(s,t,T.gridX(i));
+		maxErr[s][t][0] = 0;
+		for(unsigned int i=0; i+1<n; i++) {
+			float x = 0.5*(T.gridX(i)+T.gridX(i+1));
+			float e = relDiff(T.eval(x),PCal.gmsFactor(s,t,x),1e-3);
+			if(e > maxErr[s][t][0]) maxErr[s][t][0] = e;
+		}
+		if(maxErr[s][t][0] <= tolerance || T.gridX(1) < 0.1)
+			break;
+	}
+}
+
+void CompiledCalibrator::buildLinearity(Side s, unsigned int t) {
+	const TGraph* g = PCal.getLinearityFunction(s,t);
+	maxErr[s][t][1] = 0;
+	if(!g || !g->GetN())
+		return;	// dead tube; fall back on PMTCalibrator
+	LookupTable& T = linearity[s][t];
+	for(unsigned int n = 2049; ; n = 2*n-1) {
+		T.init(adcMin,adcMax,n);
+		for(unsigned int i=0; i<n; i++)
+			T.y[i] = g->Eval(T.gridX(i));
+		// worst errors are at cell midpoints and linearity curve knots
+		maxErr[s][t][1] = 0;
+		for(unsigned int i=0; i+1<n; i++) {
+			float x = 0.5*(T.gridX(i)+T.gridX(i+1));
+			float e = relDiff(T.eval(x),g->Eval(x),1.0);
+			if(e > maxErr[s][t][1]) maxErr[s][t][1] = e;
+		}
+		for(int k=0; k<g->GetN(); k++) {
+			float x = g->GetX()[k];
+			if(!T.inRange(x)) continue;
+			float e = relDiff(T.eval(x),g->Eval(x),1.0);
+			if(e > maxErr[s][t][1]) maxErr[s][t][1] = e;
+		}
+		if(maxErr[s][t][1] <= tolerance || n > (1<<18))
+			break;
+	}
+}
+
+void CompiledCalibrator::buildLightWeight(Side s, unsigned int t) {
+	float lmax = 10000.;
+	if(linearity[s][t].size())
+		for(unsigned int i=0; i<linearity[s][t].size(); i++)
+			if(linearity[s][t].y[i] > lmax) lmax = linearity[s][t].y[i];
+	LookupTable& T = lightWeight[s][t];
+	for(unsigned int n = 1025; ; n = 2*n-1) {
+		T.init(50,lmax,n);
+		for(unsigned int i=0; i<n; i++)
+			T.y[i] = T.gridX(i)/pow(PCal.lightResolution(s,t,T.gridX(i),0),2.0);
+		maxErr[s][t][2] = 0;
+		for(unsigned int i=0; i+1<n; i++) {
+			float l = 0.5*(T.gridX(i)+T.gridX(i+1));
+			float e = relDiff(T.eval(l),l/pow(PCal.lightResolution(s,t,l,0),2.0),1e-3);
+			if(e > maxErr[s][t][2]) maxErr[s][t][2] = e;
+		}
+		if(maxErr[s][t][2] <= tolerance || n > (1<<16))
+			break;
+	}
+}
+
+void CompiledCalibrator::buildEta(Side s, unsigned int t) {
+	LookupTable2D& T = posEta[s][t];
+	for(unsigned int n = 81; ; n = 2*n-1) {
+		T.init(-posRange,posRange,n,-posRange,posRange,n);
+		for(unsigned int i=0; i<n; i++)
+			for(unsigned int j=0; j<n; j++)
+				T(i,j) = PCal.eta(s,t,T.gridX(i),T.gridY(j));
+		// check sub-sample of cell centers
+		maxErr[s][t][3] = 0;
+		unsigned int stride = (n-1)/200+1;
+		for(unsigned int i=0; i+1<n; i+=stride) {
+			for(unsigned int j=0; j+1<n; j+=stride) {
+				float x = 0.5*(T.gridX(i)+T.gridX(i+1));
+				float y = 0.5*(T.gridY(j)+T.gridY(j+1));
+				float e = relDiff(T.eval(x,y),PCal.eta(s,t,x,y),1e-2);
+				if(e > maxErr[s][t][3]) maxErr[s][t][3] = e;
+			}
+		}
+		if(maxErr[s][t][3] <= tolerance || n > 600)
+			break;
+	}
+}
+
+void CompiledCalibrator::calibrateEnergy(Side s, float x, float y, ScintEvent& evt, float time) const {
+	evt.energy.x = evt.energy.err = 0;
+	float weight[nBetaTubes];
+	const bool posTable = posEta[s][0].inRange(x,y);
+	for(unsigned int t=0; t<nBetaTubes; t++) {
+
+		float eta0 = posTable ? posEta[s][t].eval(x,y) : PCal.eta(s,t,x,y);
+		float gmsf = gmsFactor(s,t,time);
+		float g = evt.adc[t]*gmsf;
+		float l0 = linearity[s][t].inRange(g) ? linearity[s][t].eval(g) : PCal.linearityCorrector(s,t,evt.adc[t],time); // tube observed light
+		if(l0 != l0)
+			l0 = 0;
+		float E0 = l0/eta0; // tube observed energy keV
+
+		weight[t] = eta0*getLightWeight(s,t,evt.adc[t],l0,gmsf,time); // = nPE/keV for this position
+
+		// remove bad weights
+		if(!(weight[t]>0.01 && weight[t]<10.0))
+			weight[t] = 0;
+
+		evt.nPE[t] = E0*weight[t];
+
+		// de-weight for clipping
+		if(evt.adc[t]>clipThreshold-500)
+			weight[t] *= (clipThreshold-evt.adc[t])/500.0;
+		if(evt.adc[t]>clipThreshold)
+			weight[t] = 0;
+
+		evt.energy.x += E0*weight[t];
+		evt.energy.err += weight[t];
+		evt.tuben[t].x = E0;
+	}
+	evt.energy.x /= evt.energy.err;
+	evt.energy.err = sqrt(evt.energy.x/evt.energy.err);
+	for(unsigned int t=0; t<nBetaTubes; t++)
+		evt.tuben[t].err = sqrt(evt.energy.x/weight[t]);
+
+	if(!(evt.energy.x==evt.energy.x)) evt.energy = 0.;	// NaN test
+}
+
+void CompiledCalibrator::calibrateEnergy(Side s, ScintBlock& B) const {
+	const unsigned int n = B.size();
+	if(!n) return;
+	float* eta0 = &B.work[0][0];
+	float* l0 = &B.work[1][0];
+	float* lw = &B.work[2][0];
+	float* etot = &B.energy[0];
+	float* wtot = &B.denergy[0];
+	for(unsigned int i=0; i<n; i++)
+		etot[i] = wtot[i] = 0;
+	
+	for(unsigned int t=0; t<nBetaTubes; t++) {
+		const float* adc = &B.adc[t][0];
+		float* E0 = &B.tuben[t][0];
+		float* w = &B.weight[t][0];
+		float* npe = &B.nPE[t][0];
+		
+		// table lookups
+		for(unsigned int i=0; i<n; i++) {
+			eta0[i] = posEta[s][t].inRange(B.x[i],B.y[i]) ? posEta[s][t].eval(B.x[i],B.y[i]) : PCal.eta(s,t,B.x[i],B.y[i]);
+			float gmsf = gmsFactor(s,t,B.time[i]);
+			float g = adc[i]*gmsf;
+			l0[i] = linearity[s][t].inRange(g) ? linearity[s][t].eval(g) : PCal.linearityCorrector(s,t,adc[i],B.time[i]);
+			if(l0[i] != l0[i])
+				l0[i] = 0;
+			lw[i] = getLightWeight(s,t,adc[i],l0[i],gmsf,B.time[i]);
+		}
+		
+		// weights and energy sums
+		for(unsigned int i=0; i<n; i++) {
+			E0[i] = l0[i]/eta0[i];
+			float wi = eta0[i]*lw[i];
+			wi = (wi>0.01 && wi<10.0) ? wi : 0;
+			npe[i] = E0[i]*wi;
+			wi = (adc[i]>clipThreshold-500) ? wi*(clipThreshold-adc[i])/500.0f : wi;
+			wi = (adc[i]>clipThreshold) ? 0 : wi;
+			w[i] = wi;
+			etot[i] += E0[i]*wi;
+			wtot[i] += wi;
+		}
+	}
+	
+	// combined energy and uncertainties
+	for(unsigned int i=0; i<n; i++) {
+		etot[i] /= wtot[i];
+		wtot[i] = sqrt(etot[i]/wtot[i]);
+	}
+	for(unsigned int t=0; t<nBetaTubes; t++) {
+		float* dE0 = &B.dtuben[t][0];
+		const float* w = &B.weight[t][0];
+		for(unsigned int i=0; i<n; i++)
+			dE0[i] = sqrt(etot[i]/w[i]);
+	}
+	for(unsigned int i=0; i<n; i++) {
+		if(!(etot[i]==etot[i])) {	// NaN test
+			etot[i] = 0;
+			wtot[i] = 0;
+		}
+	}
+}
+
+float CompiledCalibrator::validate(unsigned int nSamples) const {
+	TRandom3 rnd(12345);
+	float dmax = 0;
+	unsigned int nFail = 0;
+	for(unsigned int n=0; n<nSamples; n++) {
+		Side s = rnd.Uniform()<0.5?EAST:WEST;
+		float r = 60.0*sqrt(rnd.Uniform());
+		float th = 2*M_PI*rnd.Uniform();
+		float x = r*cos(th);
+		float y = r*sin(th);
+		float time = tMax*rnd.Uniform();
+		ScintEvent e0, e1;
+		for(unsigned int t=0; t<nBetaTubes; t++)
+			e0.adc[t] = e1.adc[t] = rnd.Uniform(-50,4000);
+		PCal.calibrateEnergy(s,x,y,e0,time);
+		calibrateEnergy(s,x,y,e1,time);
+		float d = relDiff(e1.energy.x,e0.energy.x,1.0);
+		if(d > dmax) dmax = d;
+		nFail += (d > tolerance);
+	}
+	printf("Compiled calibrator validation: max deviation %g over %i events; %i exceed tolerance %g.\n",dmax,nSamples,nFail,tolerance);
+	return dmax;
+}
+
+void CompiledCalibrator::printSummary() const {
+	printf("-- Compiled Calibration Tables %i --\n",PCal.rn);
+	for(Side s = EAST; s <= WEST; ++s) {
+		for(unsigned int t=0; t<nBetaTubes; t++)
+			printf("%c%i: GMS %i pts (%.2g)\tLinearity %i pts (%.2g)\tWeight %i pts (%.2g)\tEta %ix%i pts (%.2g)\n",
+				   sideNames(s),t,gms[s][t].size(),maxErr[s][t][0],linearity[s][t].size(),maxErr[s][t][1],
+				   lightWeight[s][t].size(),maxErr[s][t][2],posEta[s][t].sizeX(),posEta[s][t].sizeY(),maxErr[s][t][3]);
+	}
+	printf("----------------------------------------------\n\n");
+}
+
+//-------------------------------------------
+
+const float SimResponseKernel::lightMin = 1.0;
+
+SimResponseKernel::SimResponseKernel(PMTCalibrator& PC, float tol): PCal(PC), tolerance(tol), CC(PC,1.0,tol) {
+	printf("Tabulating simulated detector response for run %i (tolerance %g)...\n",PCal.rn,tolerance);
+	for(Side s = EAST; s <= WEST; ++s) {
+		for(unsigned int t=0; t<nBetaTubes; t++) {
+			pedWidth[s][t] = PC.getPedwidth(PC.sensorNames[s][t],0.0);
+			const TGraph* g = PCal.getLinearityFunction(s,t);
+			lightMax[s][t] = 0;
+			maxErr[s][t][0] = maxErr[s][t][1] = maxErr[s][t][2] = 0;
+			if(!g || !g->GetN())
+				continue;	// dead tube; fall back on PMTCalibrator
+			lightMax[s][t] = PCal.linearityCorrector(s,t,CompiledCalibrator::adcMax,0);
+			if(!(lightMax[s][t] > 2*lightMin))
+				continue;
+			buildNPE(s,t);
+			buildInverse(s,t);
+			buildPosRes(s,t);
+		}
+	}
+	printSummary();
+}
+
+void SimResponseKernel::buildNPE(Side s, unsigned int t) {
+	LookupTable& T = npePerLight[s][t];
+	for(unsigned int n = 1025; ; n = 2*n-1) {
+		T.init(lightMin,lightMax[s][t],n);
+		for(unsigned int i=0; i<n; i++)
+			T.y[i] = T.gridX(i)/pow(PCal.lightResolution(s,t,T.gridX(i),0),2.0);
+		maxErr[s][t][0] = 0;
+		for(unsigned int i=0; i+1<n; i++) {
+			float l = 0.5*(T.gridX(i)+T.gridX(i+1));
+			float e = relDiff(T.eval(l),l/pow(PCal.lightResolution(s,t,l,0),2.0),1e-3);
+			if(e > maxErr[s][t][0]) maxErr[s][t][0] = e;
+		}
+		if(maxErr[s][t][0] <= tolerance || n > (1<<16))
+			break;
+	}
+}
+
+void SimResponseKernel::buildInverse(Side s, unsigned int t) {
+	LookupTable& T = invLinearity[s][t];
+	for(unsigned int n = 2049; ; n = 2*n-1) {
+		T.init(-lightMax[s][t]*0.05,lightMax[s][t],n);
+		for(unsigned int i=0; i<n; i++)
+			T.y[i] = PCal.invertLinearity(s,t,T.gridX(i),0);
+		maxErr[s][t][1] = 0;
+		for(unsigned int i=0; i+1<n; i++) {
+			float l = 0.5*(T.gridX(i)+T.gridX(i+1));
+			float e = relDiff(T.eval(l),PCal.invertLinearity(s,t,l,0),1.0);
+			if(e > maxErr[s][t][1]) maxErr[s][t][1] = e;
+		}
+		if(maxErr[s][t][1] <= tolerance || n > (1<<18))
+			break;
+	}
+}
+
+void SimResponseKernel::buildPosRes(Side s, unsigned int t) {
+	const float r = CompiledCalibrator::posRange;
+	LookupTable2D& T = posRes[s][t];
+	for(unsigned int n = 81; ; n = 2*n-1) {
+		T.init(-r,r,n,-r,r,n);
+		for(unsigned int i=0; i<n; i++)
+			for(unsigned int j=0; j<n; j++)
+				T(i,j) = PCal.nPE(s,t,300.0,T.gridX(i),T.gridY(j),0)/300.0;
+		// check sub-sample of cell centers
+		maxErr[s][t][2] = 0;
+		unsigned int stride = (n-1)/200+1;
+		for(unsigned int i=0; i+1<n; i+=stride) {
+			for(unsigned int j=0; j+1<n; j+=stride) {
+				float x = 0.5*(T.gridX(i)+T.gridX(i+1));
+				float y = 0.5*(T.gridY(j)+T.gridY(j+1));
+				float e = relDiff(T.eval(x,y),PCal.nPE(s,t,300.0,x,y,0)/300.0,1e-2);
+				if(e > maxErr[s][t][2]) maxErr[s][t][2] = e;
+			}
+		}
+		if(maxErr[s][t][2] <= tolerance || n > 600)
+			break;
+	}
+}
+
+void SimResponseKernel::printSummary() const {
+	printf("-- Simulated Response Tables %i --\n",PCal.rn);
+	for(Side s = EAST; s <= WEST; ++s) {
+		for(unsigned int t=0; t<nBetaTubes; t++)
+			printf("%c%i: nPE %i pts (%.2g)\tInverse %i pts (%.2g)\tPosition nPE %ix%i pts (%.2g)\tPedestal width %.1f\n",
+				   sideNames(s),t,npePerLight[s][t].size(),maxErr[s][t][0],invLinearity[s][t].size(),maxErr[s][t][1],
+				   posRes[s][t].sizeX(),posRes[s][t].sizeY(),maxErr[s][t][2],pedWidth[s][t]);
+	}
+	printf("----------------------------------------------\n\n");
+}
@@ -0,0 +1,126 @@
+#ifndef COMPILEDCALIBRATOR_HH
+#define COMPILEDCALIBRATOR_HH 1
+
+#include "EnergyCalibrator.hh"
+#include "LookupTable.hh"
+
+/// PMTCalibrator energy reconstruction "compiled" into uniform-grid lookup tables for one run
+class CompiledCalibrator {
+public:
+	/// constructor, tabulating calibrations for run times in [0,tmax] to within relative tolerance tol
+	CompiledCalibrator(const PMTCalibrator& PC, float tmax, float tol = 1e-4);
+
+	/// convert all 4 tubes ped-subtracted ADC to energy estimates; equivalent to PMTCalibrator::calibrateEnergy
+	void calibrateEnergy(Side s, float x, float y, ScintEvent& evt, float time) const;
+	/// convert block of events to energy estimates, in vectorizable loops over events
+	void calibrateEnergy(Side s, ScintBlock& B) const;
+	/// compare against PMTCalibrator::calibrateEnergy for random events; return maximum relative energy deviation
+	float validate(unsigned int nSamples = 10000) const;
+	/// print summary of table sizes and accuracy
+	void printSummary() const;
+	/// position response eta from table or exact
+	inline float eta(Side s, unsigned int t, float x, float y) const {
+		return posEta[s][t].inRange(x,y) ? posEta[s][t].eval(x,y) : PCal.eta(s,t,x,y);
+	}
+
+	const PMTCalibrator& PCal;	//< calibrator tables are built from
+	const float tolerance;		//< requested relative accuracy
+	const float tMax;			//< maximum tabulated time in run
+
+	static const float posRange;	//< tabulated position range [-posRange,posRange] (mm)
+	static const float adcMin;		//< minimum tabulated GMS-corrected ADC
+	static const float adcMax;		//< maximum tabulated GMS-corrected ADC
+
+protected:
+	/// tabulate GMS factor over run time
+	void buildGMS(Side s, unsigned int t);
+	/// tabulate linearity curve over GMS-corrected ADC
+	void buildLinearity(Side s, unsigned int t);
+	/// tabulate light weight l/sigma(l)^2 over light
+	void buildLightWeight(Side s, unsigned int t);
+	/// tabulate position response eta over (x,y)
+	void buildEta(Side s, unsigned int t);
+
+	/// GMS factor from table or exact
+	inline float gmsFactor(Side s, unsigned int t, float time) const {
+		return gms[s][t].inRange(time) ? gms[s][t].eval(time) : PCal.gmsFactor(s,t,time);
+	}
+
+	/// light weight l/sigma(l)^2 from table or exact, given GMS factor at time
+	inline float getLightWeight(Side s, unsigned int t, float adc, float l0, float gmsf, float time) const {
+		float w;
+		if(adc < 5 || l0 < 50)
+			w = weight50[s][t];
+		else if(lightWeight[s][t].inRange(l0))
+			w = lightWeight[s][t].eval(l0);
+		else
+			return l0/pow(PCal.lightResolution(s,t,l0,time),2.0);
+		if(!PCal.scaleNoiseWithL)
+			w *= gmsRef[s][t]/gmsf;	// tabulated at t=0; resolution^2 scales with GMS factor
+		return w;
+	}
+
+	LookupTable gms[2][nBetaTubes];			//< GMS factor vs. time
+	LookupTable linearity[2][nBetaTubes];	//< light vs. GMS-corrected ADC
+	LookupTable lightWeight[2][nBetaTubes];	//< light/sigma(light)^2 vs. light, at t=0
+	LookupTable2D posEta[2][nBetaTubes];	//< position response eta vs. (x,y)
+	float gmsRef[2][nBetaTubes];			//< GMS factor at t=0 for lightWeight time scaling
+	float weight50[2][nBetaTubes];			//< light weight at 50 light units
+	float maxErr[2][nBetaTubes][4];			//< maximum table error found building [gms,linearity,weight,eta]
+	float clipThreshold;					//< ADC clipping de-weighting threshold
+};
+
+/// PMTCalibrator detector response at run start, tabulated for simulating PMT signals (the inverse of CompiledCalibrator)
+class SimResponseKernel {
+public:
+	/// constructor, tabulating response to within relative tolerance tol
+	SimResponseKernel(PMTCalibrator& PC, float tol = 1e-3);
+	
+	/// position response eta
+	inline float eta(Side s, unsigned int t, float x, float y) const { return CC.eta(s,t,x,y); }
+	/// expected number of photoelectrons for tube light l = eta*E; equivalent to PMTCalibrator::nPE(s,t,E,x,y,0)
+	inline float nPE(Side s, unsigned int t, float l) const {
+		if(l <= 0)
+			return 0;
+		if(npePerLight[s][t].inRange(l))
+			return l*npePerLight[s][t].eval(l);
+		return pow(l/PCal.lightResolution(s,t,l,0),2.0);
+	}
+	/// nPE per keV (at 300keV) for hit position; equivalent to PMTCalibrator::nPE(s,t,300,x,y,0)/300
+	inline float nPEperKeV(Side s, unsigned int t, float x, float y) const {
+		return posRes[s][t].inRange(x,y) ? posRes[s][t].eval(x,y) : PCal.nPE(s,t,300.0,x,y,0)/300.0;
+	}
+	/// ped-subtracted ADC for tube light l; equivalent to PMTCalibrator::invertLinearity(s,t,l,0)
+	inline float invertLinearity(Side s, unsigned int t, float l) const {
+		return invLinearity[s][t].inRange(l) ? invLinearity[s][t].eval(l) : PCal.invertLinearity(s,t,l,0);
+	}
+	/// pedestal width for tube at run start
+	inline float getPedwidth(Side s, unsigned int t) const { return pedWidth[s][t]; }
+	/// energy reconstruction from simulated ADCs
+	inline void calibrateEnergy(Side s, float x, float y, ScintEvent& evt) const { CC.calibrateEnergy(s,x,y,evt,0); }
+	/// print summary of table sizes and accuracy
+	void printSummary() const;
+	
+	const PMTCalibrator& PCal;		//< calibrator tables are built from
+	const float tolerance;			//< requested relative accuracy
+	const CompiledCalibrator CC;	//< forward energy calibration tables
+	
+	static const float lightMin;	//< minimum tabulated light (exact calculation below)
+	
+protected:
+	/// tabulate nPE per unit light
+	void buildNPE(Side s, unsigned int t);
+	/// tabulate inverse linearity
+	void buildInverse(Side s, unsigned int t);
+	/// tabulate nPE/keV over position
+	void buildPosRes(Side s, unsigned int t);
+	
+	LookupTable npePerLight[2][nBetaTubes];		//< nPE/light vs. light
+	LookupTable invLinearity[2][nBetaTubes];	//< ped-subtracted ADC vs. light
+	LookupTable2D posRes[2][nBetaTubes];		//< nPE/keV at 300keV vs. (x,y)
+	float pedWidth[2][nBetaTubes];				//< pedestal widths
+	float lightMax[2][nBetaTubes];				//< light at CompiledCalibrator::adcMax
+	float maxErr[2][nBetaTubes][3];				//< maximum table error found building [nPE,inverse,position nPE]
+};
+
+#endif
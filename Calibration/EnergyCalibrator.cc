@@ -44,6 +44,96 @@ void PedestalCorrector::insertPedestal(const std::string& sensorName, TGraph* g)
 	assert(g->GetN()>=2);
 	pedestals.erase(sensorName);
 	pedestals.insert(std::make_pair(sensorName,g));
+	std::map<std::string,unsigned int>::const_iterator it = sensorIDs.find(sensorName);
+	if(it != sensorIDs.end())
+		samplePedestal(it->second);
+}
+unsigned int PedestalCorrector::getSensorID(const std::string& sensorName) {
+	std::map<std::string,unsigned int>::const_iterator it = sensorIDs.find(sensorName);
+	if(it != sensorIDs.end())
+		return it->second;
+	unsigned int sid = idNames.size();
+	sensorIDs.insert(std::make_pair(sensorName,sid));
+	idNames.push_back(sensorName);
+	idGraphs.push_back(NULL);
+	pedTables.push_back(LookupTable());
+	return sid;
+}
+float PedestalCorrector::evalPedestal(unsigned int sid, float time) {
+	if(!idGraphs[sid])
+		samplePedestal(sid);
+	if(pedTables[sid].inRange(time))
+		return pedTables[sid].eval(time);
+	return idGraphs[sid]->Eval(time);
+}
+void PedestalCorrector::samplePedestal(unsigned int sid) {
+	// make sure graph is loaded
+	getPedestal(idNames[sid],0);
+	TGraph* g = idGraphs[sid] = pedestals.find(idNames[sid])->second;
+	pedTables[sid] = LookupTable();
+	if(g->GetN() < 2)
+		return;
+	// sample at half the graph's finest point spacing, over run span
+	const double* x = g->GetX();
+	double x0 = x[0], x1 = x[0], dx = 0;
+	for(int i=1; i<g->GetN(); i++) {
+		if(x[i] < x0) x0 = x[i];
+		if(x[i] > x1) x1 = x[i];
+		double d = fabs(x[i]-x[i-1]);
+		if(d > 0 && (!dx || d < dx)) dx = d;
+	}
+	if(!dx)
+		return;
+	if(x0 > 0) x0 = 0;
+	x1 += (x1-x0 > 60.0)?(x1-x0):60.0;
+	unsigned int n = (unsigned int)(2*(x1-x0)/dx)+2;
+	if(n > 100000) n = 100000;
+	pedTables[sid].init(x0,x1,n);
+	for(unsigned int i=0; i<n; i++)
+		pedTables[sid].y[i] = g->Eval(pedTables[sid].gridX(i));
+}
+
+
+
+
+
+
+void ScintBlock::resize(unsigned int nev) {
+	n = nev;
+	for(unsigned int t=0; t<nBetaTubes; t++) {
+		adc[t].resize(n);
+		tuben[t].resize(n);
+		dtuben[t].resize(n);
+		nPE[t].resize(n);
+		weight[t].resize(n);
+	}
+	x.resize(n);
+	y.resize(n);
+	time.resize(n);
+	energy.resize(n);
+	denergy.resize(n);
+	for(unsigned int i=0; i<3; i++)
+		work[i].resize(n);
+}
+
+void ScintBlock::setEvent(unsigned int i, const ScintEvent& evt, float xi, float yi, float ti) {
+	assert(i<n);
+	for(unsigned int t=0; t<nBetaTubes; t++)
+		adc[t][i] = evt.adc[t];
+	x[i] = xi;
+	y[i] = yi;
+	time[i] = ti;
+}
+
+void ScintBlock::getEvent(unsigned int i, ScintEvent& evt) const {
+	assert(i<n);
+	for(unsigned int t=0; t<nBetaTubes; t++) {
+		evt.tuben[t].x = tuben[t][i];
+		evt.tuben[t].err = dtuben[t][i];
+		evt.nPE[t] = nPE[t][i];
+	}
+	evt.energy.x = energy[i];
+	evt.energy.err = denergy[i];
 }
 
 
@@ -156,6 +246,9 @@ std::map<RunNum,LinearityCorrector*> LinearityCorrector::cachedRuns = std::map<R
 
 PMTCalibrator::PMTCalibrator(RunNum rn, CalDB* cdb): LinearityCorrector(rn,cdb),
 PedestalCorrector(rn,cdb), EvisConverter(rn,cdb), WirechamberCalibrator(rn,cdb) {
+	for(Side s = EAST; s <= WEST; ++s)
+		for(unsigned int t=0; t<nBetaTubes; t++)
+			pmtPedIDs[s][t] = getSensorID(sensorNames[s][t]);
 	if(myRun < 5000) {
 		printf("******* Bogus PMT Calibration Run! ********\n");
 		return;
@@ -261,7 +354,7 @@ float PMTCalibrator::trigEff(Side s, unsigned int t, float adc) const {
 
 void PMTCalibrator::pedSubtract(Side s, float* adc, float time) {
 	for(unsigned int t=0; t<nBetaTubes; t++)
-		adc[t] -= getPedestal(sensorNames[s][t],time);
+		adc[t] -= getPedestal(pmtPedIDs[s][t],time);
 }
 void PMTCalibrator::calibrateEnergy(Side s, float x, float y, ScintEvent& evt, float time) const {
 	evt.energy.x = evt.energy.err = 0;
@@ -302,6 +395,23 @@ void PMTCalibrator::calibrateEnergy(Side s, float x, float y, ScintEvent& evt, f
 	if(!(evt.energy.x==evt.energy.x)) evt.energy = 0.;	// NaN test
 }
 
+void PMTCalibrator::calibrateEnergy(Side s, ScintBlock& B) const {
+	ScintEvent evt;
+	for(unsigned int i=0; i<B.size(); i++) {
+		for(unsigned int t=0; t<nBetaTubes; t++)
+			evt.adc[t] = B.adc[t][i];
+		calibrateEnergy(s,B.x[i],B.y[i],evt,B.time[i]);
+		for(unsigned int t=0; t<nBetaTubes; t++) {
+			B.tuben[t][i] = evt.tuben[t].x;
+			B.dtuben[t][i] = evt.tuben[t].err;
+			B.nPE[t][i] = evt.nPE[t];
+			B.weight[t][i] = evt.energy.x/(evt.tuben[t].err*evt.tuben[t].err);
+		}
+		B.energy[i] = evt.energy.x;
+		B.denergy[i] = evt.energy.err;
+	}
+}
+
 void PMTCalibrator::summedEnergy(Side s, float x, float y, ScintEvent& evt, float time) const {
 	evt.energy.x = evt.energy.err = 0;
 	for(unsigned int t=0; t<nBetaTubes; t++) {
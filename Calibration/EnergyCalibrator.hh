@@ -7,6 +7,7 @@
 #include "EvisConverter.hh"
 #include "WirechamberCalibrator.hh"
 #include "QFile.hh"
+#include "LookupTable.hh"
 #include <map>
 #include <string>
 #include <vector>
@@ -24,6 +25,15 @@ public:
 	float getPedestal(const std::string& sensorName, float time);
 	/// get sensor pedestal at given time from beginning of run
 	float getPedwidth(const std::string& sensorName, float time);
+	/// get integer ID for sensor name, for fast per-event pedestal lookups
+	unsigned int getSensorID(const std::string& sensorName);
+	/// get sensor pedestal by ID at given time from beginning of run
+	inline float getPedestal(unsigned int sid, float time) {
+		assert(sid < pedTables.size());
+		if(pedTables[sid].inRange(time))
+			return pedTables[sid].eval(time);
+		return evalPedestal(sid,time);
+	}
 	
 	RunNum myRun;								//< run number for this run
 	
@@ -31,8 +41,17 @@ public:
 	void insertPedestal(const std::string& sensorName, TGraph* g);
 
 private:
+	/// pedestal by ID outside pre-sampled table range, loading table if needed
+	float evalPedestal(unsigned int sid, float time);
+	/// pre-sample pedestal graph into table for sensor ID
+	void samplePedestal(unsigned int sid);
+	
 	std::map<std::string,TGraph*> pedestals;	//< pedestals history for each sensor
 	std::map<std::string,TGraph*> pedwidths;		//< pedestal width history for each sensor
+	std::map<std::string,unsigned int> sensorIDs;	//< interned sensor name IDs
+	std::vector<std::string> idNames;			//< sensor names by ID
+	std::vector<TGraph*> idGraphs;				//< pedestal graphs by sensor ID (NULL until loaded)
+	std::vector<LookupTable> pedTables;			//< pedestals pre-sampled on uniform time grid by sensor ID
 	CalDB* pCDB;								//< pedestal-containing DB
 };
 
@@ -58,6 +77,8 @@ public:
 	float dLinearity(Side s, unsigned int t, float adc, float time) const;	
 	/// get ref run t0 GMS factor
 	float getGMS0(Side s, unsigned int t) const { return gms0[s][t]; }
+	/// get linearity correction curve (as function of GMS-corrected ADC)
+	const TGraph* getLinearityFunction(Side s, unsigned int t) const { return linearityFunctions[s][t]; }
 	
 	/// whether this is a reference run
 	bool isRefRun() const { return rGMS == rn || !rGMS; }
@@ -87,6 +108,38 @@ protected:
 	static LinearityCorrector* getCachedRun(RunNum r,CalDB* cdb);	//< retrieve a cached corrector, creating if necessary
 };
 
+/// structure-of-arrays block of scintillator events for batched energy calibration
+class ScintBlock {
+public:
+	/// constructor
+	ScintBlock(): n(0) {}
+	/// set number of events in block
+	void resize(unsigned int nev);
+	/// number of events in block
+	inline unsigned int size() const { return n; }
+	/// load inputs for one event into block slot i
+	void setEvent(unsigned int i, const ScintEvent& evt, float xi, float yi, float ti);
+	/// copy calibrated results for block slot i into event
+	void getEvent(unsigned int i, ScintEvent& evt) const;
+	
+	// inputs
+	std::vector<float> adc[nBetaTubes];		//< ped-subtracted ADC for each tube
+	std::vector<float> x;					//< event x position
+	std::vector<float> y;					//< event y position
+	std::vector<float> time;				//< event time in run
+	// outputs
+	std::vector<float> tuben[nBetaTubes];	//< individual tube energies
+	std::vector<float> dtuben[nBetaTubes];	//< individual tube energy uncertainties
+	std::vector<float> nPE[nBetaTubes];		//< number of PE in each tube
+	std::vector<float> weight[nBetaTubes];	//< tube weights in combined energy
+	std::vector<float> energy;				//< combined energy
+	std::vector<float> denergy;				//< combined energy uncertainty
+	std::vector<float> work[3];				//< scratch space for calibration intermediates
+	
+protected:
+	unsigned int n;							//< number of events in block
+};
+
 /// Energy reconstruction class
 class PMTCalibrator: public LinearityCorrector, public PedestalCorrector, public EvisConverter, public WirechamberCalibrator {
 public:
@@ -132,16 +185,21 @@ public:
 	void pedSubtract(Side s, float* adc, float time);
 	/// convert all 4 tubes ped-subtracted ADC to energy estimates
 	void calibrateEnergy(Side s, float x, float y, ScintEvent& evt, float time) const;	
+	/// convert block of events to energy estimates
+	void calibrateEnergy(Side s, ScintBlock& B) const;
 	/// convert all 4 tubes ped-subtracted ADC to energy estimates and return QADC-sum averaged energy (ignores individual tube resolutions)
 	void summedEnergy(Side s, float x, float y, ScintEvent& evt, float time) const;		
 	/// print summary of energy calibrations
 	void printSummary();
 	/// stringmap energy calibrations summary
 	Stringmap calSummary() const;
+	/// get ADC threshold for clipping de-weighting
+	float getClipThreshold() const { return clipThreshold; }
 	
 protected:
 	
 	float clipThreshold;					//< threshold to de-weight ADC in tube combination due to "clipping"
+	unsigned int pmtPedIDs[2][nBetaTubes];	//< pedestal sensor IDs for each PMT
 	EfficCurve* pmtEffic[2][nBetaTubes];	//< efficiency curves for each PMT
 };
 
@@ -1,6 +1,7 @@
 #include "WirechamberReconstruction.hh"
 #include "strutils.hh"
 #include <cfloat>
+#include <cassert>
 
 std::vector<bool> getLiveWires(RunNum rn, Side s, AxisDirection d) {
 	
@@ -99,15 +100,122 @@ std::vector<float> calcWirePositions(RunNum rn, Side s, AxisDirection d, float w
 
 int sign(float v) { return v > 0 ? 1 : (v < 0 ? -1 : 0); }
 
-wireHit mpmGaussianPositioner(const std::vector<float>& wirepos, float* wireValues, const float* wirePeds) {
-	
-	float x1,x2,x3,y1,y2,y3,d;
-	const double sigma0 = 0.75;	// TODO is this really a sigma? re-understand this
+/// xorshift step for deterministic tie-breaking
+inline unsigned int nextTieState(unsigned int& x) {
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return x;
+}
+
+/// choose (pseudorandomly, from tieState) one of nTies unclipped wires tied for maximum value vmax
+static unsigned int pickTie(const float* wireValues, const bool* isClipped, unsigned int nWires, float vmax, unsigned int nTies, unsigned int& tieState) {
+	unsigned int k = nextTieState(tieState)%nTies;
+	for(unsigned int c=0; c<nWires; c++)
+		if(!isClipped[c] && wireValues[c] == vmax && !k--)
+			return c;
+	assert(false);
+	return 0;
+}
+
+wireHit mpmGaussianPositioner(const std::vector<float>& wirepos, float* wireValues, const float* wirePeds, unsigned int& tieState) {
 	unsigned int nWires = wirepos.size();
+	assert(nWires <= kMaxCathodes);
+	bool isClipped[kMaxCathodes];
+	for(unsigned int c=0; c<nWires; c++) {
+		// values above 3950 count as "clipped"
+		isClipped[c] = wireValues[c] > 3950;
+		// pedestal subtract wire readout
+		wireValues[c] -= wirePeds[c];
+	}
+	return MWPCPositioner::locateHit(nWires?&wirepos[0]:NULL, nWires, wireValues, isClipped, tieState);
+}
+
+MWPCPositioner::MWPCPositioner(unsigned int seed) {
+	setSeed(seed);
+	for(Side s = EAST; s <= WEST; ++s) {
+		for(unsigned int d = X_DIRECTION; d <= Y_DIRECTION; d++) {
+			nWires[s][d] = 0;
+			for(unsigned int c=0; c<kMaxCathodes; c++)
+				wirePos[s][d][c] = liveMask[c][2*s+d] = 0;
+		}
+	}
+}
+
+void MWPCPositioner::setWirePositions(Side s, AxisDirection d, const std::vector<float>& wirepos) {
+	assert((s==EAST || s==WEST) && wirepos.size() <= kMaxCathodes);
+	nWires[s][d] = wirepos.size();
+	for(unsigned int c=0; c<kMaxCathodes; c++) {
+		wirePos[s][d][c] = c<nWires[s][d] ? wirepos[c] : 0;
+		liveMask[c][2*s+d] = c<nWires[s][d];
+	}
+}
+
+void MWPCPositioner::reconstruct(float wireValues[2][2][kMaxCathodes], const float wirePeds[2][2][kMaxCathodes], wireHit hits[2][2]) {
+	
+	// clipping flags and pedestal subtraction; transpose to [wire][plane] so the 4 planes are parallel lanes
+	float* v = &wireValues[0][0][0];
+	const float* p = &wirePeds[0][0][0];
+	bool isClipped[4*kMaxCathodes];
+	float vs[kMaxCathodes][4];		// live wire values, 0 otherwise
+	float vu[kMaxCathodes][4];		// live unclipped wire values, -FLT_MAX otherwise
+	float clipped[kMaxCathodes][4];	// 1 for live clipped wires
+	for(unsigned int i=0; i<4; i++) {
+		for(unsigned int c=0; c<kMaxCathodes; c++) {
+			const unsigned int j = i*kMaxCathodes+c;
+			const bool live = liveMask[c][i];
+			isClipped[j] = v[j] > 3950;
+			v[j] = live ? v[j]-p[j] : v[j];
+			vs[c][i] = live ? v[j] : 0;
+			clipped[c][i] = live && isClipped[j];
+			vu[c][i] = live && !isClipped[j] ? v[j] : -FLT_MAX;
+		}
+	}
+	
+	// sum, multiplicity, clipping, and maximum reductions over wires, all 4 planes at once
+	float sum[4] = {0,0,0,0};
+	float mult[4] = {0,0,0,0};
+	float nClip[4] = {0,0,0,0};
+	float vmax[4] = {-1,-1,-1,-1};
+	for(unsigned int c=0; c<kMaxCathodes; c++) {
+		for(unsigned int i=0; i<4; i++) {
+			sum[i] += vs[c][i];
+			// values above 70 count towards multiplicity
+			mult[i] += vs[c][i] > 70;
+			nClip[i] += clipped[c][i];
+			vmax[i] = vu[c][i] > vmax[i] ? vu[c][i] : vmax[i];
+		}
+	}
+	// number and (first) position of wires at maximum
+	float nTies[4] = {0,0,0,0};
+	unsigned int maxWire[4] = {0,0,0,0};
+	for(unsigned int c=kMaxCathodes; c-- > 0;) {
+		for(unsigned int i=0; i<4; i++) {
+			nTies[i] += vu[c][i] == vmax[i];
+			maxWire[i] = vu[c][i] == vmax[i] ? c : maxWire[i];
+		}
+	}
 	
-	std::vector<float> xs;
-	std::vector<float> ys;
-	int maxn = -1;
+	for(unsigned int i=0; i<4; i++) {
+		const Side s = Side(i/2);
+		const unsigned int d = i%2;
+		wireHit& h = hits[s][d];
+		h.nClipped = (unsigned int)nClip[i];
+		h.multiplicity = (unsigned int)mult[i];
+		h.cathodeSum = sum[i];
+		h.maxValue = vmax[i];
+		// if wires are tied for max value, pseudorandomly choose which is labeled as maxWire
+		h.maxWire = nTies[i] > 1 ? pickTie(wireValues[s][d], isClipped+i*kMaxCathodes, nWires[s][d], vmax[i], (unsigned int)nTies[i], tieState) : maxWire[i];
+		fitHit(h, nTies[i] > 0, wirePos[s][d], nWires[s][d], wireValues[s][d], isClipped+i*kMaxCathodes);
+	}
+}
+
+void MWPCPositioner::reconstructBlock(unsigned int n, float (*wireValues)[2][2][kMaxCathodes], const float (*wirePeds)[2][2][kMaxCathodes], wireHit (*hits)[2][2]) {
+	for(unsigned int e=0; e<n; e++)
+		reconstruct(wireValues[e],wirePeds[e],hits[e]);
+}
+
+wireHit MWPCPositioner::locateHit(const float* wirepos, unsigned int nWires, const float* wireValues, const bool* isClipped, unsigned int& tieState) {
 	
 	// initialize values in h
 	wireHit h;
@@ -115,34 +223,48 @@ wireHit mpmGaussianPositioner(const std::vector<float>& wirepos, float* wireValu
 	h.maxWire = 0;
 	h.cathodeSum = 0;
 	h.multiplicity = 0;
-	h.errflags = 0;
 	h.maxValue = -1;
 	
+	// sums over wires, and maximum unclipped wire
+	unsigned int nTies = 0;
 	for(unsigned int c=0; c<nWires; c++) {
-		// values above 3950 count as "clipped"
-		bool isClipped = wireValues[c] > 3950;
-		// pedestal subtract wire readout
-		wireValues[c] -= wirePeds[c];
-		if(isClipped) {
-			h.nClipped++;
-		} else {
-			// record in usable wires
-			xs.push_back(wirepos[c]);
-			ys.push_back(wireValues[c]);
-		}
+		h.nClipped += isClipped[c];
 		// values above 70 count towards multiplicity
-		if(wireValues[c]>70)
-			h.multiplicity++;
+		h.multiplicity += wireValues[c]>70;
 		h.cathodeSum += wireValues[c];
-		// check if this is the maximum value found so far
-		if(wireValues[c] >= h.maxValue && !isClipped) {
-			// if wires are tied for max value, randomly choose which is labeled as maxWire
-			if(wireValues[c] == h.maxValue && rand()%2)
-				continue;
+		if(isClipped[c] || wireValues[c] < h.maxValue)
+			continue;
+		if(wireValues[c] > h.maxValue || !nTies) {
 			h.maxValue = wireValues[c];
 			h.maxWire = c;
-			maxn = xs.size()-1;
+			nTies = 0;
 		}
+		nTies++;
+	}
+	// if wires are tied for max value, pseudorandomly choose which is labeled as maxWire
+	if(nTies > 1)
+		h.maxWire = pickTie(wireValues, isClipped, nWires, h.maxValue, nTies, tieState);
+	
+	fitHit(h, nTies > 0, wirepos, nWires, wireValues, isClipped);
+	return h;
+}
+
+void MWPCPositioner::fitHit(wireHit& h, bool foundMax, const float* wirepos, unsigned int nWires, const float* wireValues, const bool* isClipped) {
+	
+	float x1,x2,x3,y1,y2,y3,d;
+	const double sigma0 = 0.75;	// TODO is this really a sigma? re-understand this
+	
+	h.errflags = 0;
+	const unsigned int nUsable = nWires-h.nClipped;
+	
+	// nearest usable neighbors of maximum wire
+	int prevWire = -1;
+	int nextWire = -1;
+	if(foundMax) {
+		for(int c = int(h.maxWire)-1; c >= 0 && prevWire < 0; c--)
+			if(!isClipped[c]) prevWire = c;
+		for(unsigned int c = h.maxWire+1; c < nWires && nextWire < 0; c++)
+			if(!isClipped[c]) nextWire = c;
 	}
 	
 	if(h.nClipped > 0)
@@ -151,32 +273,29 @@ wireHit mpmGaussianPositioner(const std::vector<float>& wirepos, float* wireValu
 		h.errflags |= WIRES_MULTICLIP;
 	if(h.maxValue <= 0)
 		h.errflags |= WIRES_NONE;
-	if(maxn==0 || maxn==int(xs.size())-1)
+	if(foundMax ? (prevWire < 0 || nextWire < 0) : !nUsable)
 		h.errflags |= WIRES_EDGE;
 	
 	// no usable wires? There's no hit to reconstruct.
-	if(h.maxValue <= 0 || !xs.size()) {
+	if(h.maxValue <= 0 || !nUsable) {
 		h.center = h.width = 0;
-		return h;
+		return;
 	}
 	// only one usable wire?
-	if(xs.size()==1) {
+	if(nUsable==1) {
 		h.errflags |= WIRES_SINGLET;
-		h.center = xs[0];
-		return h;
+		h.center = wirepos[h.maxWire];
+		return;
 	}
 	
 	// special case for hits near edge (assumes fixed width)
 	if(h.errflags & WIRES_EDGE) {
 		
-		y1 = ys[maxn];
-		x1 = xs[maxn];
-		if(maxn==0)
-			maxn++;
-		else
-			maxn--;
-		y2 = ys[maxn];
-		x2 = xs[maxn];
+		y1 = wireValues[h.maxWire];
+		x1 = wirepos[h.maxWire];
+		unsigned int c2 = prevWire < 0 ? nextWire : prevWire;
+		y2 = wireValues[c2];
+		x2 = wirepos[c2];
 		
 		h.avgCenter = (x1*y1+x2*y2)/(y1+y2);
 		
@@ -191,16 +310,16 @@ wireHit mpmGaussianPositioner(const std::vector<float>& wirepos, float* wireValu
 		float l = 0.5 + (log(y2)-log(y1))*sigma0*sigma0;
 		h.center = (1-l)*x1 + l*x2;
 		h.parabCenter = -1000;
-		return h;
+		return;
 	}
 	
 	// collect x and y values
-	y1 = ys[maxn-1];
-	y2 = ys[maxn];
-	y3 = ys[maxn+1];
-	x1 = xs[maxn-1];
-	x2 = xs[maxn];
-	x3 = xs[maxn+1];
+	y1 = wireValues[prevWire];
+	y2 = wireValues[h.maxWire];
+	y3 = wireValues[nextWire];
+	x1 = wirepos[prevWire];
+	x2 = wirepos[h.maxWire];
+	x3 = wirepos[nextWire];
 	float dx1 = x2-x1;
 	float dx2 = x3-x2;
 	
@@ -226,7 +345,7 @@ wireHit mpmGaussianPositioner(const std::vector<float>& wirepos, float* wireValu
 		h.errflags |= WIRES_SINGLET;
 		h.width = 0;
 		h.center = x2;
-		return h;
+		return;
 	}
 	
 	// isolated doublet (wires on one side negative): fixed sigma reconstruction
@@ -239,7 +358,7 @@ wireHit mpmGaussianPositioner(const std::vector<float>& wirepos, float* wireValu
 		h.width = sigma0*fabs(x3-x2);
 		float l = 0.5 + (log(y3)-log(y2))*sigma0*sigma0;
 		h.center = (1-l)*x2 + l*x3;
-		return h;
+		return;
 	}
 	
 	// calculate gaussian center for non-uniform wires, width for all wires
@@ -251,5 +370,6 @@ wireHit mpmGaussianPositioner(const std::vector<float>& wirepos, float* wireValu
 	if(h.center == -1000)
 		h.center = 0.5*(x1*x1*(y2-y3)  + x2*x2*(y3-y1) + x3*x3*(y1-y2)) / d;
 	
-	return h;
+	return;
 }
+
@@ -46,7 +46,36 @@ std::vector<std::string> getCathodeNames(RunNum rn, Side s, AxisDirection d);
 /// get wire positions for given run number, side, and plane
 std::vector<float> calcWirePositions(RunNum rn, Side s, AxisDirection d, float wireSpacing = 10.16*sqrt(0.6));
 
-/// reconstruct hit positions based on analytic gaussian model
-wireHit mpmGaussianPositioner(const std::vector<float>& wirepos, float* wireValues, const float* wirePeds);
+/// reconstruct hit positions based on analytic gaussian model; tieState is the (seedable, non-zero) tie-breaking generator state
+wireHit mpmGaussianPositioner(const std::vector<float>& wirepos, float* wireValues, const float* wirePeds, unsigned int& tieState);
+
+const unsigned int kMaxCathodes = 16;	//< maximum number of cathode wires per plane
+
+/// allocation-free version of mpmGaussianPositioner for all 4 [side][plane] cathode arrays of an event
+class MWPCPositioner {
+public:
+	/// constructor, with seed for deterministic tie-breaking between equal wires
+	MWPCPositioner(unsigned int seed = 1);
+	/// set live wire positions for side, plane
+	void setWirePositions(Side s, AxisDirection d, const std::vector<float>& wirepos);
+	/// re-seed tie-breaking
+	void setSeed(unsigned int seed) { tieState = seed?seed:1; }
+	/// pedestal-subtract wire values in place and reconstruct hits on all [side][plane], with reductions over the 4 planes in parallel
+	void reconstruct(float wireValues[2][2][kMaxCathodes], const float wirePeds[2][2][kMaxCathodes], wireHit hits[2][2]);
+	/// reconstruct a block of n events
+	void reconstructBlock(unsigned int n, float (*wireValues)[2][2][kMaxCathodes], const float (*wirePeds)[2][2][kMaxCathodes], wireHit (*hits)[2][2]);
+	
+	/// reconstruct hit from pedestal-subtracted wire values and clipping flags
+	static wireHit locateHit(const float* wirepos, unsigned int nWires, const float* wireValues, const bool* isClipped, unsigned int& tieState);
+	
+protected:
+	/// fill in position and error flags for hit with wire sums and maximum already found
+	static void fitHit(wireHit& h, bool foundMax, const float* wirepos, unsigned int nWires, const float* wireValues, const bool* isClipped);
+	
+	float wirePos[2][2][kMaxCathodes];		//< live wire positions on [side][plane]
+	float liveMask[kMaxCathodes][4];		//< 1 for live wire slots, 0 otherwise, on [wire][2*side+plane]
+	unsigned int nWires[2][2];				//< number of live wires on [side][plane]
+	unsigned int tieState;					//< tie-breaking random generator state
+};
 
 #endif
@@ -0,0 +1,56 @@
+#include "FilePrefetcher.hh"
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/// read chunk size for prefetching
+static const size_t prefetchChunk = 1024*1024;
+
+FilePrefetcher::FilePrefetcher(size_t maxBytes): budget(maxBytes), running(false), abort(false), done(true) { }
+
+void FilePrefetcher::request(const std::string& fname) {
+	if(fname == fileName && running)
+		return;
+	cancel();
+	if(!budget || !fname.size())
+		return;
+	fileName = fname;
+	abort = false;
+	done = false;
+	running = !pthread_create(&thread,NULL,&FilePrefetcher::readAhead,this);
+	if(!running) {
+		printf("*** Unable to start prefetch thread for '%s'!\n",fname.c_str());
+		done = true;
+	}
+}
+
+void FilePrefetcher::cancel() {
+	if(!running)
+		return;
+	abort = true;
+	pthread_join(thread,NULL);
+	running = false;
+	fileName = "";
+}
+
+void* FilePrefetcher::readAhead(void* p) {
+	FilePrefetcher* FP = (FilePrefetcher*)p;
+	int fd = open(FP->fileName.c_str(),O_RDONLY);
+	if(fd < 0) {
+		FP->done = true;
+		return NULL;
+	}
+	posix_fadvise(fd,0,FP->budget,POSIX_FADV_WILLNEED);
+	char* buf = new char[prefetchChunk];
+	size_t nread = 0;
+	while(!FP->abort && nread < FP->budget) {
+		ssize_t n = read(fd,buf,prefetchChunk);
+		if(n <= 0)
+			break;
+		nread += n;
+	}
+	delete[] buf;
+	close(fd);
+	FP->done = true;
+	return NULL;
+}
@@ -0,0 +1,38 @@
+#ifndef FILEPREFETCHER_HH
+#define FILEPREFETCHER_HH 1
+
+#include <string>
+#include <pthread.h>
+
+/// reads upcoming input files into the OS page cache from a background thread, so the next file open does not wait on disk
+/// (only raw file reads happen in the background thread; ROOT objects stay in the calling thread)
+class FilePrefetcher {
+public:
+	/// constructor, with maximum bytes read ahead per file
+	FilePrefetcher(size_t maxBytes = 256*1024*1024);
+	/// destructor
+	~FilePrefetcher() { cancel(); }
+	
+	/// start reading file in background, cancelling any other request in progress
+	void request(const std::string& fname);
+	/// stop any request in progress
+	void cancel();
+	/// forget background thread without stopping it (in forked child process, where the thread does not exist)
+	void detach() { running = false; fileName = ""; }
+	/// whether the last requested file has been completely read ahead
+	bool isDone() const { return done; }
+	
+	size_t budget;				//< maximum bytes read ahead per file
+	
+protected:
+	/// background read loop
+	static void* readAhead(void* p);
+	
+	pthread_t thread;			//< background read thread
+	bool running;				//< whether thread needs to be joined
+	volatile bool abort;		//< flag to stop background read
+	volatile bool done;			//< flag for completed background read
+	std::string fileName;		//< file being read ahead
+};
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef STAGETIMER_HH
+#define STAGETIMER_HH 1
+
+#include "QFile.hh"
+#include <time.h>
+#include <sys/time.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+/// accumulates wall-clock time spent in each of a sequence of named processing stages
+class StageTimer {
+public:
+	/// constructor
+	StageTimer(): tLast(0) {}
+
+	/// add a named stage; returns stage index
+	unsigned int addStage(const std::string& nm) {
+		names.push_back(nm);
+		tStage.push_back(0);
+		nCalls.push_back(0);
+		return names.size()-1;
+	}
+	/// number of stages
+	unsigned int nStages() const { return names.size(); }
+	/// stage name
+	const std::string& getName(unsigned int i) const { return names[i]; }
+	/// total time spent in stage [s]
+	double getTime(unsigned int i) const { return tStage[i]; }
+	/// number of times stage was timed
+	double getCalls(unsigned int i) const { return nCalls[i]; }
+	/// total time over all stages [s]
+	double getTotal() const { double t = 0; for(unsigned int i=0; i<tStage.size(); i++) t += tStage[i]; return t; }
+
+	/// start timing from now
+	inline void start() { tLast = now(); }
+	/// assign time since last start/mark to stage i
+	inline void mark(unsigned int i) {
+		double t = now();
+		tStage[i] += t-tLast;
+		nCalls[i]++;
+		tLast = t;
+	}
+	/// reset accumulated times
+	void reset() {
+		for(unsigned int i=0; i<tStage.size(); i++)
+			tStage[i] = nCalls[i] = 0;
+	}
+
+	/// summary as Stringmap, with per-stage time [s], calls, and calls per second
+	Stringmap toStringmap() const {
+		Stringmap m;
+		for(unsigned int i=0; i<names.size(); i++) {
+			m.insert(names[i]+"_time",tStage[i]);
+			m.insert(names[i]+"_calls",nCalls[i]);
+			m.insert(names[i]+"_rate",tStage[i]>0?nCalls[i]/tStage[i]:0);
+		}
+		m.insert("total_time",getTotal());
+		return m;
+	}
+	/// print table of per-stage times and rates
+	void display() const {
+		double ttot = getTotal();
+		printf("%-16s %12s %12s %10s %8s\n","stage","calls","rate [1/s]","us/call","%time");
+		for(unsigned int i=0; i<names.size(); i++)
+			printf("%-16s %12.0f %12.4g %10.3f %8.2f\n",names[i].c_str(),nCalls[i],
+				   tStage[i]>0?nCalls[i]/tStage[i]:0,nCalls[i]?1e6*tStage[i]/nCalls[i]:0,ttot>0?100*tStage[i]/ttot:0);
+	}
+
+	/// current monotonic time [s]
+	static inline double now() {
+#ifdef CLOCK_MONOTONIC
+		timespec ts;
+		clock_gettime(CLOCK_MONOTONIC,&ts);
+		return ts.tv_sec + 1e-9*ts.tv_nsec;
+#else
+		timeval tv;
+		gettimeofday(&tv,NULL);
+		return tv.tv_sec + 1e-6*tv.tv_usec;
+#endif
+	}
+
+protected:
+	std::vector<std::string> names;	//< stage names
+	std::vector<double> tStage;		//< accumulated time in each stage
+	std::vector<double> nCalls;		//< number of timings of each stage
+	double tLast;					//< time of last start/mark
+};
+
+#endif
@@ -101,6 +101,17 @@ std::string join(const std::vector<std::string>& ss, const std::string& sep) {
 	return s;
 }
 
+std::string hashString(const std::string& s) {
+	unsigned long long h = 14695981039346656037ULL;
+	for(std::string::const_iterator it = s.begin(); it != s.end(); it++) {
+		h ^= (unsigned char)(*it);
+		h *= 1099511628211ULL;
+	}
+	char buf[32];
+	sprintf(buf,"%016llx",h);
+	return std::string(buf);
+}
+
 std::string strip(const std::string& s, const std::string splitchars) {
 	size_t wstart = s.find_first_not_of(splitchars);
 	if(wstart == std::string::npos)
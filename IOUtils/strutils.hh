@@ -43,6 +43,8 @@ std::vector<std::string> split(const std::string& s, const std::string splitchar
 std::string join(const std::vector<std::string>& ss, const std::string& sep = " ");
 /// strip junk chars off start and end of string
 std::string strip(const std::string& s, const std::string splitchars = " \t\r\n");
+/// 64-bit FNV-1a hash of string contents, as hex string
+std::string hashString(const std::string& s);
 /// split a string into a vector of doubles
 std::vector<double> sToDoubles(const std::string& s, const std::string splitchars = ", \t\r\n");
 /// split a string into a vector of floats
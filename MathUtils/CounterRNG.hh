@@ -0,0 +1,130 @@
+#ifndef COUNTERRNG_HH
+#define COUNTERRNG_HH 1
+
+#include <math.h>
+
+/// counter-based random number stream: the n^th draw is a hash of (key, n), so any stream can be re-created from its key alone
+class CounterRNG {
+public:
+	/// constructor
+	CounterRNG(unsigned long long k = 0): key(k), counter(0) {}
+
+	/// start a new stream for given key
+	void setKey(unsigned long long k) { key = k; counter = 0; }
+	/// current key
+	unsigned long long getKey() const { return key; }
+	/// number of draws from current stream
+	unsigned long long getCounter() const { return counter; }
+
+	/// next raw 64-bit value
+	inline unsigned long long next() { return mix(key + mix(++counter)); }
+	/// uniform random number in (0,1)
+	inline double Rndm() { return ((next()>>11)+0.5)*(1.0/9007199254740992.0); }
+	/// uniform random number in (a,b)
+	inline double Uniform(double a, double b) { return a+(b-a)*Rndm(); }
+	/// gaussian random number (Box-Muller)
+	inline double Gaus(double mu, double sigma) {
+		const double r = sqrt(-2.0*log(Rndm()));
+		return mu+sigma*r*cos(2*M_PI*Rndm());
+	}
+	/// Poisson-distributed random number with given mean, returned as double
+	double PoissonD(double mean) {
+		if(mean <= 0)
+			return 0;
+		if(mean < 25) {
+			// multiplication of uniform deviates
+			const double expmean = exp(-mean);
+			double pir = 1;
+			int n = -1;
+			do {
+				n++;
+				pir *= Rndm();
+			} while(pir > expmean);
+			return n;
+		}
+		if(mean > 1e9)
+			return floor(Gaus(mean,sqrt(mean))+0.5);
+		// rejection from Lorentzian envelope
+		const double sq = sqrt(2.0*mean);
+		const double alxm = log(mean);
+		const double g = mean*alxm-lgamma(mean+1.0);
+		double em, y, t;
+		do {
+			do {
+				y = tan(M_PI*Rndm());
+				em = sq*y+mean;
+			} while(em < 0);
+			em = floor(em);
+			t = 0.9*(1.0+y*y)*exp(em*alxm-lgamma(em+1.0)-g);
+		} while(Rndm() > t);
+		return em;
+	}
+
+	/// fill array with n uniform random numbers in (0,1)
+	inline void fillUniform(double* u, unsigned int n) {
+		const unsigned long long c0 = counter;
+		for(unsigned int i=0; i<n; i++)
+			u[i] = ((mix(key+mix(c0+1+i))>>11)+0.5)*(1.0/9007199254740992.0);
+		counter += n;
+	}
+	/// fill array with n unit gaussian random numbers (Box-Muller pairs)
+	inline void fillGaus(double* g, unsigned int n) {
+		double u[32];
+		for(unsigned int i0=0; i0<n; i0+=32) {
+			const unsigned int m = (n-i0<32 ? n-i0 : 32);
+			const unsigned int m2 = m+(m&1);
+			fillUniform(u,m2);
+			for(unsigned int i=0; i<m2; i+=2) {
+				const double r = sqrt(-2.0*log(u[i]));
+				u[i] = r*cos(2*M_PI*u[i+1]);
+				u[i+1] = r*sin(2*M_PI*u[i+1]);
+			}
+			for(unsigned int i=0; i<m; i++)
+				g[i0+i] = u[i];
+		}
+	}
+	/// Poisson-distributed number with given mean from pre-drawn uniform u (by inversion) or, for mean above normalAbove, unit gaussian z
+	static inline double poissonFromVariates(double mean, double u, double z, double normalAbove) {
+		if(mean <= 0)
+			return 0;
+		if(mean > normalAbove) {
+			const double n = floor(mean+sqrt(mean)*z+0.5);
+			return n>0?n:0;
+		}
+		double p = exp(-mean);
+		double F = p;
+		const double kmax = mean+20*sqrt(mean)+20;
+		double k = 0;
+		while(u > F && k < kmax) {
+			k++;
+			p *= mean/k;
+			F += p;
+		}
+		return k;
+	}
+
+	/// 64-bit mixing function (SplitMix64 finalizer), also useful for combining key components
+	static inline unsigned long long mix(unsigned long long z) {
+		z += 0x9E3779B97F4A7C15ULL;
+		z = (z^(z>>30))*0xBF58476D1CE4E5B9ULL;
+		z = (z^(z>>27))*0x94D049BB133111EBULL;
+		return z^(z>>31);
+	}
+	/// combine key components into stream key
+	static inline unsigned long long makeKey(unsigned long long a, unsigned long long b) { return mix(mix(a)^b); }
+
+protected:
+	unsigned long long key;		//< stream key
+	unsigned long long counter;	//< number of values drawn from stream
+};
+
+/// fixed-size block of uniform and gaussian variates, drawn together from a stream for use in simulation inner loops
+template<unsigned int NU, unsigned int NG>
+struct VariateBlock {
+	/// draw new block from stream
+	void fill(CounterRNG& R) { R.fillUniform(u,NU); R.fillGaus(g,NG); }
+	double u[NU];	//< uniform variates in (0,1)
+	double g[NG];	//< unit gaussian variates
+};
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef LOOKUPTABLE_HH
+#define LOOKUPTABLE_HH 1
+
+#include <vector>
+#include <cassert>
+
+/// linearly interpolated function values tabulated on a uniform grid
+class LookupTable {
+public:
+	/// constructor
+	LookupTable(): x0(0), x1(0), dx(1), idx(1) {}
+
+	/// set up grid of n>=2 points spanning [a,b]
+	void init(double a, double b, unsigned int n) {
+		assert(n>=2 && b>a);
+		x0 = a;
+		x1 = b;
+		dx = (b-a)/(n-1);
+		idx = 1.0/dx;
+		y.assign(n,0);
+	}
+	/// number of grid points
+	inline unsigned int size() const { return y.size(); }
+	/// position of i^th grid point
+	inline double gridX(unsigned int i) const { return x0+i*dx; }
+	/// whether x falls inside the tabulated range
+	inline bool inRange(double x) const { return y.size()>1 && x0<=x && x<=x1; }
+	/// interpolated value at x (x must be in range)
+	inline float eval(float x) const {
+		float u = (x-x0)*idx;
+		unsigned int i = (unsigned int)u;
+		if(i+1 >= y.size()) i = y.size()-2;
+		u -= i;
+		return y[i]+u*(y[i+1]-y[i]);
+	}
+
+	std::vector<float> y;	//< tabulated values at each grid point
+
+protected:
+	double x0;				//< grid start
+	double x1;				//< grid end
+	double dx;				//< grid spacing
+	double idx;				//< inverse grid spacing
+};
+
+/// bilinearly interpolated function values tabulated on a uniform 2D grid
+class LookupTable2D {
+public:
+	/// constructor
+	LookupTable2D(): nx(0), ny(0), x0(0), x1(0), y0(0), y1(0), idx(1), idy(1) {}
+
+	/// set up grid of n>=2 by m>=2 points spanning [xa,xb]x[ya,yb]
+	void init(double xa, double xb, unsigned int n, double ya, double yb, unsigned int m) {
+		assert(n>=2 && m>=2 && xb>xa && yb>ya);
+		nx = n;
+		ny = m;
+		x0 = xa;
+		x1 = xb;
+		y0 = ya;
+		y1 = yb;
+		idx = (n-1)/(xb-xa);
+		idy = (m-1)/(yb-ya);
+		z.assign(n*m,0);
+	}
+	/// number of grid points in x
+	inline unsigned int sizeX() const { return nx; }
+	/// number of grid points in y
+	inline unsigned int sizeY() const { return ny; }
+	/// x position of i^th grid column
+	inline double gridX(unsigned int i) const { return x0+i/idx; }
+	/// y position of j^th grid row
+	inline double gridY(unsigned int j) const { return y0+j/idy; }
+	/// value at grid point (i,j)
+	inline float& operator()(unsigned int i, unsigned int j) { return z[i+nx*j]; }
+	/// whether (x,y) falls inside the tabulated range
+	inline bool inRange(double x, double y) const { return nx>1 && x0<=x && x<=x1 && y0<=y && y<=y1; }
+	/// interpolated value at (x,y) (must be in range)
+	inline float eval(float x, float y) const {
+		float u = (x-x0)*idx;
+		float v = (y-y0)*idy;
+		unsigned int i = (unsigned int)u;
+		unsigned int j = (unsigned int)v;
+		if(i+1 >= nx) i = nx-2;
+		if(j+1 >= ny) j = ny-2;
+		u -= i;
+		v -= j;
+		const float* p = &z[i+nx*j];
+		return (1-v)*(p[0]+u*(p[1]-p[0])) + v*(p[nx]+u*(p[nx+1]-p[nx]));
+	}
+
+protected:
+	std::vector<float> z;	//< tabulated values, x index fastest
+	unsigned int nx;		//< number of x grid points
+	unsigned int ny;		//< number of y grid points
+	double x0;				//< x grid start
+	double x1;				//< x grid end
+	double y0;				//< y grid start
+	double y1;				//< y grid end
+	double idx;				//< inverse x grid spacing
+	double idy;				//< inverse y grid spacing
+};
+
+#endif
@@ -1,10 +1,17 @@
 #include "ucnaDataAnalyzer11b.hh"
+#include "ucnaReplayBenchmark.hh"
+#include "CalDBSnapshot.hh"
 #include "strutils.hh"
 #include "ManualInfo.hh"
 #include "GraphicsUtils.hh"
 #include "MultiGaus.hh"
 #include <stdio.h>
 #include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <map>
+#include <algorithm>
 #include <TStyle.h>
 #include <TDatime.h>
 
@@ -13,8 +20,11 @@ RangeCut::RangeCut(const Stringmap& m): start(m.getDefault("start",0.0)), end(m.
 ManualInfo ucnaDataAnalyzer11b::MI = ManualInfo("../../SummaryData/ManualInfo.txt");
 
 ucnaDataAnalyzer11b::ucnaDataAnalyzer11b(RunNum R, std::string bp, CalDB* CDB):
-TChainScanner("h1"), OutputManager(std::string("spec_")+itos(R),bp+"/hists/"), rn(R), PCal(R,CDB), CDBout(NULL),
-deltaT(0), totalTime(0), ignore_beam_out(false), nFailedEvnb(0), nFailedBkhf(0), gvMonChecker(5,5.0), prevPassedCuts(true), prevPassedGVRate(true) {
+TChainScanner("h1"), OutputManager(std::string("spec_")+itos(R),bp+"/hists/"), rn(R), PCal(R,CDB), CCal(NULL), compiledCalTol(0), CDBout(NULL),
+deltaT(0), totalTime(0), ignore_beam_out(false), nFailedEvnb(0), nFailedBkhf(0), singlePass(true), bufferBudget(512), timingPeriod(0), timeThisEvent(false), gvMonChecker(5,5.0), prevPassedCuts(true), prevPassedGVRate(true) {
+	const char* stageNames[] = {"header","times","peds","early hists","position","energy","vetos","classify","hists","tree"};
+	for(unsigned int i=STAGE_HEADER; i<=STAGE_TREE; i++)
+		PT.addStage(stageNames[i]);
 	if(R>16300 && !CDB->isValid(R)) {
 		printf("*** Bogus calibration for new runs! ***\n");
 		PCal = PMTCalibrator(16000,CDB);
@@ -27,13 +37,20 @@ void ucnaDataAnalyzer11b::analyze() {
 	loadCuts();
 	setupOutputTree();
 	
-	pedestalPrePass();
-	printf("\nRun wall time is %.1fs\n\n",wallTime);
-	setupHistograms();
-	printf("Scanning input data...\n");
-	startScan();
-	while (nextPoint())
-		processEvent();
+	bool needsPeds = needsPedestals();
+	if(needsPeds && singlePass && singlePassWindow()) {
+		singlePassScan();
+	} else {
+		if(needsPeds)
+			pedestalPrePass();
+		printf("\nRun wall time is %.1fs\n\n",wallTime);
+		setupHistograms();
+		setupCompiledCal();
+		printf("Scanning input data...\n");
+		startScan();
+		while (nextPoint())
+			processEvent();
+	}
 	printf("Done.\n");
 	processBiPulser();
 	calcTrigEffic();
@@ -43,6 +60,7 @@ void ucnaDataAnalyzer11b::analyze() {
 	replaySummary();
 	
 	quickAnalyzerSummary();
+	stageTimingSummary();
 }
 
 void ucnaDataAnalyzer11b::loadCut(CutVariable& c, const std::string& cutName) {
@@ -170,14 +188,14 @@ bool ucnaDataAnalyzer11b::passesBeamCuts() {
 }
 
 void ucnaDataAnalyzer11b::reconstructPosition() {
+	float cathPeds[2][2][kMWPCWires];
+	for(Side s = EAST; s <= WEST; ++s)
+		for(unsigned int d = X_DIRECTION; d <= Y_DIRECTION; d++)
+			for(unsigned int c=0; c<cathPedIDs[s][d].size(); c++)
+				cathPeds[s][d][c] = PCal.getPedestal(cathPedIDs[s][d][c],fTimeScaler.t[BOTH]);
+	MWPos.reconstruct(fMWPC_caths, cathPeds, wirePos);
 	for(Side s = EAST; s <= WEST; ++s) {
-		for(unsigned int d = X_DIRECTION; d <= Y_DIRECTION; d++) {
-			float cathPeds[kMWPCWires];
-			for(unsigned int c=0; c<cathNames[s][d].size(); c++)
-				cathPeds[c] = PCal.getPedestal(cathNames[s][d][c],fTimeScaler.t[BOTH]);
-			wirePos[s][d] = mpmGaussianPositioner(kWirePositions[s][d], fMWPC_caths[s][d], cathPeds);
-		}
-		fMWPC_anode[s].val -= PCal.getPedestal(sideSubst("MWPC%cAnode",s),fTimeScaler.t[BOTH]);
+		fMWPC_anode[s].val -= PCal.getPedestal(anodePedID[s],fTimeScaler.t[BOTH]);
 		fCathSum[s].val = wirePos[s][X_DIRECTION].cathodeSum + wirePos[s][Y_DIRECTION].cathodeSum;
 		fCathMax[s].val = wirePos[s][X_DIRECTION].maxValue<wirePos[s][Y_DIRECTION].maxValue?wirePos[s][X_DIRECTION].maxValue:wirePos[s][Y_DIRECTION].maxValue;
 		fPassedAnode[s] = fMWPC_anode[s].inRange();
@@ -186,15 +204,32 @@ void ucnaDataAnalyzer11b::reconstructPosition() {
 	}
 }
 
+void ucnaDataAnalyzer11b::setupCompiledCal() {
+	if(compiledCalTol > 0 && !CCal) {
+		CCal = new CompiledCalibrator(PCal,1.1*wallTime+60.0,compiledCalTol);
+		if(CCal->validate() > compiledCalTol) {
+			printf("*** Compiled calibration tables exceed tolerance %g; using direct calibration.\n",compiledCalTol);
+			delete CCal;
+			CCal = NULL;
+		}
+	}
+}
+
 void ucnaDataAnalyzer11b::reconstructVisibleEnergy() {
 	
 	for(Side s = EAST; s <= WEST; ++s) {
 		// get calibrated energy from the 4 tubes combined; also, wirechamber energy deposition estimate
 		if(passedMWPC(s)) {
-			PCal.calibrateEnergy(s,wirePos[s][X_DIRECTION].center,wirePos[s][Y_DIRECTION].center,sevt[s],fTimeScaler.t[BOTH]);
+			if(CCal)
+				CCal->calibrateEnergy(s,wirePos[s][X_DIRECTION].center,wirePos[s][Y_DIRECTION].center,sevt[s],fTimeScaler.t[BOTH]);
+			else
+				PCal.calibrateEnergy(s,wirePos[s][X_DIRECTION].center,wirePos[s][Y_DIRECTION].center,sevt[s],fTimeScaler.t[BOTH]);
 			fEMWPC[s] = PCal.calibrateAnode(fMWPC_anode[s].val,s,wirePos[s][X_DIRECTION].center,wirePos[s][Y_DIRECTION].center,fTimeScaler.t[BOTH]);
 		} else {
-			PCal.calibrateEnergy(s,0,0,sevt[s],fTimeScaler.t[BOTH]);
+			if(CCal)
+				CCal->calibrateEnergy(s,0,0,sevt[s],fTimeScaler.t[BOTH]);
+			else
+				PCal.calibrateEnergy(s,0,0,sevt[s],fTimeScaler.t[BOTH]);
 			fEMWPC[s] = PCal.calibrateAnode(fMWPC_anode[s].val,s,0,0,fTimeScaler.t[BOTH]);
 		}
 	}	
@@ -317,24 +352,49 @@ void ucnaDataAnalyzer11b::calcTrigEffic() {
 }
 
 void ucnaDataAnalyzer11b::processEvent() {
+	timeThisEvent = timingPeriod && !(currentEvent%timingPeriod);
+	if(timeThisEvent)
+		PT.start();
+	
 	checkHeaderQuality();
+	markStage(STAGE_HEADER);
 	calibrateTimes();
+	markStage(STAGE_TIMES);
 	for(Side s = EAST; s <= WEST; ++s)
 		PCal.pedSubtract(s, sevt[s].adc, fTimeScaler.t[BOTH]);
+	markStage(STAGE_PEDS);
 	fillEarlyHistograms();
+	markStage(STAGE_EARLYHISTS);
 	
 	if(!isScintTrigger() || isLED())
 		return;
 	
 	reconstructPosition();
+	markStage(STAGE_POSITION);
 	reconstructVisibleEnergy();
+	markStage(STAGE_ENERGY);
 	checkMuonVetos();
+	markStage(STAGE_VETOS);
 	classifyEventType();
 	reconstructTrueEnergy();
+	markStage(STAGE_CLASSIFY);
 	fillHistograms();
+	markStage(STAGE_HISTS);
 	
 	if(fPassedGlobal)
 		TPhys->Fill();
+	markStage(STAGE_TREE);
+}
+
+void ucnaDataAnalyzer11b::stageTimingSummary() {
+	if(!timingPeriod) return;
+	printf("\n---------- Event Processing Stage Timing ----------\n");
+	printf("Sampling every %i events; estimated total %.2fs\n",timingPeriod,PT.getTotal()*timingPeriod);
+	PT.display();
+	printf("----------------------------------------------------\n\n");
+	Stringmap m = PT.toStringmap();
+	m.insert("period",timingPeriod);
+	qOut.insert("stage_timing",m);
 }
 
 void ucnaDataAnalyzer11b::processBiPulser() {
@@ -459,14 +519,138 @@ void ucnaDataAnalyzer11b::quickAnalyzerSummary() const {
 	printf("----------------------------------------------------\n\n");
 }
 
+/// replay options shared by all runs
+struct ReplayOptions {
+	ReplayOptions(): cutBeam(false), nodbout(false), noroot(false), twopass(false), fastcal(false), bufferMB(512), nJobs(1), timingPeriod(100) {}
+	bool cutBeam;			//< whether to apply beam cuts
+	bool nodbout;			//< whether to skip output DB uploads
+	bool noroot;			//< whether to skip writing output .root file
+	bool twopass;			//< whether to use separate pedestals pre-pass
+	bool fastcal;			//< whether to use lookup-table energy calibration
+	unsigned int bufferMB;	//< single-pass raw event look-back buffer size [MB]
+	unsigned int nJobs;		//< number of runs to replay simultaneously
+	unsigned int timingPeriod;	//< sample processing stage timing every timingPeriod events (0 to disable)
+	std::string outDir;		//< output base directory
+};
+
+/// replay a single run
+void replayRun(RunNum r, const ReplayOptions& opts) {
+	std::string inDir = getEnvSafe("UCNADATADIR");
+	if(!fileExists(inDir+"/full"+itos(r)+".root") && r > 16300)
+		inDir = "/data/ucnadata/2011/rootfiles/";
+	
+	CalDB* CDB = CalDBSnapshot::getSnapshot();
+	if(!CDB)
+		CDB = CalDBSQL::getCDB(true);
+	ucnaDataAnalyzer11b A(r,opts.outDir,CDB);
+	A.setIgnoreBeamOut(!opts.cutBeam);
+	A.setSinglePass(!opts.twopass,opts.bufferMB);
+	if(opts.fastcal)
+		A.setCompiledCal(1e-4);
+	A.setStageTiming(opts.timingPeriod);
+	if(!opts.nodbout) {
+		printf("Connecting to output DB...\n");
+		A.setOutputDB(CalDBSQL::getCDB(false));
+	}
+	A.addFile(inDir+"/full"+itos(r)+".root");
+	A.analyze();
+	A.setWriteRoot(!opts.noroot);
+	A.write();
+}
+
+/// replay runs in forked worker processes, each with its own DB connections and ROOT state; return number of failed runs
+unsigned int replayRunsParallel(RunNum r0, RunNum r1, const ReplayOptions& opts) {
+	
+	const unsigned int nRuns = r1-r0+1;
+	printf("Replaying %i runs with %i worker processes; logs in %s/Logs/\n",nRuns,opts.nJobs,opts.outDir.c_str());
+	makePath(opts.outDir+"/Logs/");
+	
+	std::map<pid_t,RunNum> running;
+	std::vector<RunNum> failed;
+	unsigned int nDone = 0;
+	time_t tStart = time(NULL);
+	RunNum rnext = r0;
+	while(rnext <= r1 || running.size()) {
+		
+		// launch workers up to limit
+		while(running.size() < opts.nJobs && rnext <= r1) {
+			fflush(stdout);
+			fflush(stderr);
+			pid_t pid = fork();
+			if(pid < 0) {
+				printf("*** Failed to fork replay of run %i!\n",rnext);
+				failed.push_back(rnext++);
+				nDone++;
+				continue;
+			}
+			if(!pid) {
+				std::string logName = opts.outDir+"/Logs/Replay_"+itos(rnext)+".txt";
+				if(!freopen(logName.c_str(),"w",stdout) || dup2(fileno(stdout),fileno(stderr)) < 0)
+					_exit(1);
+				replayRun(rnext,opts);
+				fflush(stdout);
+				_exit(0);
+			}
+			running.insert(std::make_pair(pid,rnext++));
+		}
+		
+		// collect finished worker
+		int status = 0;
+		pid_t pid = wait(&status);
+		if(pid < 0)
+			break;
+		std::map<pid_t,RunNum>::iterator it = running.find(pid);
+		if(it == running.end())
+			continue;
+		bool ok = WIFEXITED(status) && !WEXITSTATUS(status);
+		if(!ok)
+			failed.push_back(it->second);
+		nDone++;
+		double dt = difftime(time(NULL),tStart);
+		printf("[%i/%i] Run %i %s; %i running, %.1f runs/hour\n",
+			   nDone,nRuns,it->second,ok?"done":"FAILED",(int)running.size()-1,dt>0?3600.0*nDone/dt:0.0);
+		fflush(stdout);
+		running.erase(it);
+	}
+	
+	double dt = difftime(time(NULL),tStart);
+	printf("\nReplayed %i runs in %.1f minutes (%.1f runs/hour).\n",nDone,dt/60.0,dt>0?3600.0*nDone/dt:0.0);
+	if(failed.size()) {
+		std::sort(failed.begin(),failed.end());
+		printf("*** %i runs failed:",(int)failed.size());
+		for(std::vector<RunNum>::const_iterator it = failed.begin(); it != failed.end(); it++)
+			printf(" %i",*it);
+		printf("\n");
+	}
+	return failed.size();
+}
+
 int main(int argc, char** argv) {
 	
 	// check correct arguments
 	if(argc<2) {
-		printf("Syntax: %s <run number> [ignore beam/source status]\n",argv[0]);
+		printf("Syntax: %s <run number>[-<last run>] [cutbeam] [nodbout] [noroot] [twopass] [buffer=<MB>] [fastcal] [jobs=<N>] [timing=<N>]\n",argv[0]);
+		printf("        %s benchmark [events=<N>] [fastcal]\n",argv[0]);
 		exit(1);
 	}
 	
+	// throughput benchmark on synthetic data
+	if(std::string(argv[1])=="benchmark") {
+		unsigned int nEvents = 200000;
+		float compiledTol = 0;
+		for(int i=2; i<argc; i++) {
+			std::string arg(argv[i]);
+			if(arg.substr(0,7)=="events=")
+				nEvents = atoi(arg.substr(7).c_str());
+			else if(arg=="fastcal")
+				compiledTol = 1e-4;
+			else
+				assert(false);
+		}
+		runReplayBenchmark(nEvents,compiledTol,getEnvSafe("UCNAOUTPUTDIR")+"/Benchmark/");
+		return 0;
+	}
+	
 	// get run(s)
 	std::vector<int> rlist = sToInts(argv[1],"-");
 	if(!rlist.size() || !rlist[0] || rlist.size()>2) {
@@ -477,17 +661,25 @@ int main(int argc, char** argv) {
 		rlist.push_back(rlist[0]);
 	
 	// other options
-	bool cutBeam = false;
-	bool nodbout = false;
-	bool noroot = false;
+	ReplayOptions opts;
 	for(int i=2; i<argc; i++) {
 		std::string arg(argv[i]);
 		if(arg=="cutbeam")
-			cutBeam = true;
+			opts.cutBeam = true;
 		else if(arg=="nodbout")
-			nodbout = true;
+			opts.nodbout = true;
 		else if(arg=="noroot")
-			noroot = true;
+			opts.noroot = true;
+		else if(arg=="twopass")
+			opts.twopass = true;
+		else if(arg=="fastcal")
+			opts.fastcal = true;
+		else if(arg.substr(0,7)=="buffer=")
+			opts.bufferMB = atoi(arg.substr(7).c_str());
+		else if(arg.substr(0,5)=="jobs=")
+			opts.nJobs = atoi(arg.substr(5).c_str());
+		else if(arg.substr(0,7)=="timing=")
+			opts.timingPeriod = atoi(arg.substr(7).c_str());
 		else
 			assert(false);
 	}
@@ -496,25 +688,13 @@ int main(int argc, char** argv) {
 	gStyle->SetNumberContours(255);
 	gStyle->SetOptStat("e");
 	
-	std::string outDir = getEnvSafe("UCNAOUTPUTDIR");
+	opts.outDir = getEnvSafe("UCNAOUTPUTDIR");
 	
-	for(RunNum r = (unsigned int)rlist[0]; r<=(unsigned int)rlist[1]; r++) {
-		
-		std::string inDir = getEnvSafe("UCNADATADIR");
-		if(!fileExists(inDir+"/full"+itos(r)+".root") && r > 16300)
-			inDir = "/data/ucnadata/2011/rootfiles/";
-		
-		ucnaDataAnalyzer11b A(r,outDir,CalDBSQL::getCDB(true));
-		A.setIgnoreBeamOut(!cutBeam);
-		if(!nodbout) {
-			printf("Connecting to output DB...\n");
-			A.setOutputDB(CalDBSQL::getCDB(false));
-		}
-		A.addFile(inDir+"/full"+itos(r)+".root");
-		A.analyze();
-		A.setWriteRoot(!noroot);
-		A.write();
-	}
+	if(opts.nJobs > 1 && rlist[1] > rlist[0])
+		return replayRunsParallel(rlist[0],rlist[1],opts)?1:0;
+	
+	for(RunNum r = (unsigned int)rlist[0]; r<=(unsigned int)rlist[1]; r++)
+		replayRun(r,opts);
 	
 	return 0;
 }
@@ -6,12 +6,14 @@
 #include "Enums.hh"
 #include "Types.hh"
 #include "EnergyCalibrator.hh"
+#include "CompiledCalibrator.hh"
 #include "CalDBSQL.hh"
 #include "WirechamberReconstruction.hh"
 #include "ManualInfo.hh"
 #include "RollingWindow.hh"
+#include "StageTimer.hh"
 
-const size_t kMWPCWires = 16;	//< maximum number of MWPC wires (may be less if some dead)
+const size_t kMWPCWires = kMaxCathodes;	//< maximum number of MWPC wires (may be less if some dead)
 const size_t kNumModules = 5;	//< number of DAQ modules for internal event header checks
 const size_t kNumUCNMons = 4;	//< number of UCN monitors
 
@@ -22,6 +24,20 @@ enum UCN_MON_ID {
 	UCN_MON_SCS = 3
 };
 
+/// event processing stages for timing
+enum ReplayStage {
+	STAGE_HEADER,	//< event header quality checks
+	STAGE_TIMES,	//< time calibration
+	STAGE_PEDS,		//< PMT pedestal subtraction
+	STAGE_EARLYHISTS,	//< early (few calibration dependencies) histogram filling
+	STAGE_POSITION,	//< wirechamber position reconstruction
+	STAGE_ENERGY,	//< visible energy reconstruction
+	STAGE_VETOS,	//< muon veto classification
+	STAGE_CLASSIFY,	//< event type classification and true energy
+	STAGE_HISTS,	//< histogram filling
+	STAGE_TREE		//< output tree filling
+};
+
 /// simple class for cuts from Stringmap
 class RangeCut {
 public:
@@ -54,13 +70,35 @@ struct Blip {
 	BlindTime length() const { return end-start; }
 };
 
+/// raw input readout for one event, buffered for re-processing in single-pass mode
+struct RawEventRecord {
+	Float_t sis00;							//< Sis00 trigger flags
+	Float_t triggerNumber;					//< event trigger number
+	Float_t timeScaler[3];					//< E, W, unblinded time scalers
+	Float_t beamclock;						//< time since last beam pulse
+	Float_t delt0;							//< time since previous event
+	Float_t absTime;						//< absolute time during run
+	Float_t monADC[kNumUCNMons];			//< UCN monitor ADCs
+	Float_t adc[2][nBetaTubes];				//< PMT ADCs
+	Float_t scint_tdc[2][nBetaTubes+1];		//< PMT and 2-of-4 TDCs
+	Float_t caths[2][2][kMWPCWires];		//< cathodes on [side][xplane][wire]
+	Float_t anode[2];						//< anode ADCs
+	Float_t backing_tdc[2];					//< muon backing veto TDC
+	Float_t backing_adc[2];					//< muon backing veto ADC
+	Float_t drift_tac[2];					//< muon veto drift tubes TAC
+	Float_t top_tdc;						//< East top veto TDC
+	Float_t top_adc;						//< East top veto ADC
+	Float_t evnb[kNumModules];				//< header and footer counters per module
+	Float_t bkhf[kNumModules];				//< header and footer counters per module
+};
+
 /// new clean-ish re-write of data analyzer; try to be backward compatible with old output tree
 class ucnaDataAnalyzer11b: public TChainScanner, public OutputManager {
 public:
 	/// constructor
 	ucnaDataAnalyzer11b(RunNum R, std::string bp, CalDB* CDB);
 	/// destructor
-	virtual ~ucnaDataAnalyzer11b() {}
+	virtual ~ucnaDataAnalyzer11b() { if(CCal) delete(CCal); }
 	
 	/// run analysis
 	void analyze();
@@ -68,6 +106,12 @@ public:
 	inline void setOutputDB(CalDBSQL* CDB = NULL) { CDBout = CDB; }
 	/// set to ignore beam cuts
 	inline void setIgnoreBeamOut(bool ibo) { ignore_beam_out = ibo; }
+	/// set whether to extract pedestals on the same read as event processing, keeping the last budgetMB of raw events in memory
+	inline void setSinglePass(bool sp, unsigned int budgetMB = 512) { singlePass = sp; bufferBudget = budgetMB; }
+	/// set to use lookup-table energy calibration with given relative tolerance (0 to disable)
+	inline void setCompiledCal(float tol) { compiledCalTol = tol; }
+	/// set to time processing stages on every n^th event (0 to disable)
+	inline void setStageTiming(unsigned int n) { timingPeriod = n; }
 	
 	/// beam + data cuts
 	bool passesBeamCuts();
@@ -102,9 +146,14 @@ protected:
 	// whole run variables
 	RunNum rn;									//< run number for file being processed
 	PMTCalibrator PCal;							//< PMT Calibrator for this run
+	CompiledCalibrator* CCal;					//< optional lookup-table version of PCal energy calibration
+	float compiledCalTol;						//< relative tolerance for CCal tables; 0 to disable
 	CalDBSQL* CDBout;							//< output database connection
 	std::vector<Float_t> kWirePositions[2][2];	//< wire positions on each [side][xplane]
+	MWPCPositioner MWPos;						//< wirechamber hit positioner
 	std::vector<std::string> cathNames[2][2];	//< cathode sensor names on each [side][xplane]
+	std::vector<unsigned int> cathPedIDs[2][2];	//< cathode pedestal sensor IDs on each [side][xplane]
+	unsigned int anodePedID[2];					//< anode pedestal sensor ID on each side
 	Float_t fAbsTime;							//< absolute time during run
 	Float_t fAbsTimeStart;						//< absolute start time of run
 	Float_t fAbsTimeEnd;						//< absolute end time of run
@@ -118,6 +167,11 @@ protected:
 	static ManualInfo MI;								//< source for manual cuts info
 	std::vector< std::pair<double,double> > manualCuts;	//< manually cut time segments
 	std::vector<Blip> cutBlips;							//< keep track of cut run time
+	bool singlePass;									//< whether to collect pedestals on the same read as event processing
+	unsigned int bufferBudget;							//< memory for raw events buffered in single-pass mode [MB]; earlier events are re-read
+	StageTimer PT;										//< per-stage event processing timer
+	unsigned int timingPeriod;							//< time processing stages every timingPeriod events; 0 to disable
+	bool timeThisEvent;									//< whether current event's processing stages are being timed
 	
 	
 	// event variables read in, re-calibrated as necessary
@@ -172,20 +226,42 @@ protected:
 	PID fPID;			//< event particle ID
 	Float_t fEtrue;			//< event reconstructed true energy
 	
+	/// check whether pedestals or run time are missing from DB (loads DB run time into wallTime)
+	bool needsPedestals();
 	/// pre-scan data to extract pedestals
 	void pedestalPrePass();
+	/// single scan of input data, extracting pedestals and processing buffered events (re-reading only events before the look-back window)
+	void singlePassScan();
+	/// number of raw events held in single-pass look-back window
+	unsigned int singlePassWindow() const;
+	/// collect pedestal data points from current (time-calibrated) event
+	void collectPedestalPoints();
+	/// fit collected pedestal data points
+	void fitPedestals();
+	/// reset time calibration and blip tracking before re-scanning events
+	void resetTimeCalibration();
+	/// copy current raw event readout into buffer record
+	void saveRawEvent(RawEventRecord& r) const;
+	/// restore raw event readout from buffer record
+	void loadRawEvent(const RawEventRecord& r);
 	/// fit pedestals
 	void monitorPedestal(std::vector< std::pair<float,float> > dpts, const std::string& mon_name, double graphWidth);
 	
 	/*--- event processing loop ---*/
 	/// process current event raw->phys
 	void processEvent();
+	/// mark end of processing stage on timed events
+	inline void markStage(ReplayStage s) { if(timeThisEvent) PT.mark(s); }
+	/// print and record per-stage processing times
+	void stageTimingSummary();
 	/// check event headers for errors
 	void checkHeaderQuality();
 	/// fix scaler overflows, convert times to seconds
 	void calibrateTimes();
 	/// reconstruct wirechamber positions
 	void reconstructPosition();
+	/// build lookup-table energy calibration (once run length is known), before event processing
+	void setupCompiledCal();
 	/// apply PMT calibrations to get visible energy
 	void reconstructVisibleEnergy();
 	/// classify muon veto response
@@ -245,6 +321,11 @@ protected:
 	TH2F* hHitPos[2];			//< hit position on each side, 2D
 	TH1F* hTrigEffic[2][nBetaTubes][2];			//< trigger efficiency for [side][tube][all/trig]
 	std::vector<TH1*> hBiPulser[2][nBetaTubes];	//< Bi puser for [side][tube]
+	
+	// pedestal data points collected during scan
+	std::vector< std::pair<float,float> > pmtPedPts[2][nBetaTubes];	//< PMT pedestal (time,value) points
+	std::vector< std::pair<float,float> > anodePedPts[2];			//< anode pedestal (time,value) points
+	std::vector< std::pair<float,float> > cathPedPts[2][2][kMWPCWires];//< cathode pedestal (time,value) points
 };
 
 
@@ -4,7 +4,7 @@
 #include <TGraph.h>
 #include <utility>
 
-void ucnaDataAnalyzer11b::pedestalPrePass() {
+bool ucnaDataAnalyzer11b::needsPedestals() {
 	
 	// get total run time; force pre-pass if missing
 	wallTime = PCal.CDB->totalTime(rn);
@@ -23,42 +23,173 @@ void ucnaDataAnalyzer11b::pedestalPrePass() {
 			needsPeds += !PCal.checkPedestals(sideSubst("MWPC%cAnode",s));
 		}
 	}
-	if(!needsPeds) return;
+	return needsPeds;
+}
+
+void ucnaDataAnalyzer11b::pedestalPrePass() {
 	
 	printf("Pre-pass for pedestals and run time...\n");
 	
-	// collect pedestal data points
-	std::vector< std::pair<float,float> > pmtPeds[2][nBetaTubes];
-	std::vector< std::pair<float,float> > anodePeds[2];
-	std::vector< std::pair<float,float> > cathPeds[2][2][kMWPCWires];
 	startScan();
 	while (nextPoint()) {
 		calibrateTimes();
-		for(Side s = EAST; s <= WEST; ++s) {
-			if( !trig2of4(s) && qadcSum(otherSide(s))>2000 && !isLED() )
-				for(unsigned int t=0; t<nBetaTubes; t++)
-					pmtPeds[s][t].push_back(std::make_pair(fTimeScaler.t[BOTH],sevt[s].adc[t]));
-			if(isLED() || (isPulserTrigger() && !nFiring(s)) || isUCNMon()) {
-				for(unsigned int p = X_DIRECTION; p <= Y_DIRECTION; p++)
-					for(unsigned int c=0; c<kMWPCWires; c++)
-						cathPeds[s][p][c].push_back(std::make_pair(fTimeScaler.t[BOTH],fMWPC_caths[s][p][c]));
-				anodePeds[s].push_back(std::make_pair(fTimeScaler.t[BOTH],fMWPC_anode[s].val));
-			}
-		}
+		collectPedestalPoints();
+	}
+	fitPedestals();
+	
+	// re-set for next scan
+	wallTime = totalTime.t[BOTH];
+	resetTimeCalibration();
+}
+
+unsigned int ucnaDataAnalyzer11b::singlePassWindow() const {
+	const unsigned int nMax = (unsigned int)(((unsigned long long)bufferBudget<<20)/sizeof(RawEventRecord));
+	return nEvents < nMax ? nEvents : nMax;
+}
+
+void ucnaDataAnalyzer11b::singlePassScan() {
+	
+	printf("Single pass for pedestals, run time, and event processing...\n");
+	
+	// collect pedestals and run time, keeping the most recent raw events in a ring buffer for processing once pedestals are known
+	const unsigned int nWindow = singlePassWindow();
+	assert(nWindow);
+	std::vector<RawEventRecord> rawBuffer(nWindow);
+	unsigned int nRead = 0;
+	startScan();
+	while (nextPoint()) {
+		saveRawEvent(rawBuffer[nRead%nWindow]);
+		nRead++;
+		calibrateTimes();
+		collectPedestalPoints();
+	}
+	fitPedestals();
+	wallTime = totalTime.t[BOTH];
+	resetTimeCalibration();
+	printf("\nRun wall time is %.1fs\n\n",wallTime);
+	setupHistograms();
+	setupCompiledCal();
+	
+	// re-read events that dropped out of the look-back window
+	const unsigned int nEarly = nRead > nWindow ? nRead-nWindow : 0;
+	if(nEarly) {
+		printf("Re-reading %i events preceding %iMB look-back buffer...\n",nEarly,bufferBudget);
+		startScan();
+		for(unsigned int i=0; i<nEarly && nextPoint(); i++)
+			processEvent();
 	}
 	
+	// process buffered events
+	printf("Processing %i buffered events...\n",nRead-nEarly);
+	for(currentEvent = nEarly; currentEvent < nRead; currentEvent++) {
+		loadRawEvent(rawBuffer[currentEvent%nWindow]);
+		processEvent();
+	}
+	std::vector<RawEventRecord>().swap(rawBuffer);
+}
+
+void ucnaDataAnalyzer11b::collectPedestalPoints() {
+	for(Side s = EAST; s <= WEST; ++s) {
+		if( !trig2of4(s) && qadcSum(otherSide(s))>2000 && !isLED() )
+			for(unsigned int t=0; t<nBetaTubes; t++)
+				pmtPedPts[s][t].push_back(std::make_pair(fTimeScaler.t[BOTH],sevt[s].adc[t]));
+		if(isLED() || (isPulserTrigger() && !nFiring(s)) || isUCNMon()) {
+			for(unsigned int p = X_DIRECTION; p <= Y_DIRECTION; p++)
+				for(unsigned int c=0; c<kMWPCWires; c++)
+					cathPedPts[s][p][c].push_back(std::make_pair(fTimeScaler.t[BOTH],fMWPC_caths[s][p][c]));
+			anodePedPts[s].push_back(std::make_pair(fTimeScaler.t[BOTH],fMWPC_anode[s].val));
+		}
+	}
+}
+
+void ucnaDataAnalyzer11b::fitPedestals() {
 	// fit pedestals, save results
 	for(Side s = EAST; s <= WEST; ++s) {
 		for(unsigned int t=0; t<nBetaTubes; t++)
-			monitorPedestal(pmtPeds[s][t],PCal.sensorNames[s][t],50);
+			monitorPedestal(pmtPedPts[s][t],PCal.sensorNames[s][t],50);
 		for(unsigned int p = X_DIRECTION; p <= Y_DIRECTION; p++)
 			for(unsigned int c=0; c<cathNames[s][p].size(); c++)
-				monitorPedestal(cathPeds[s][p][c],cathNames[s][p][c],150);
-		monitorPedestal(anodePeds[s],sideSubst("MWPC%cAnode",s),100);
+				monitorPedestal(cathPedPts[s][p][c],cathNames[s][p][c],150);
+		monitorPedestal(anodePedPts[s],sideSubst("MWPC%cAnode",s),100);
+	}
+	// free collected points
+	for(Side s = EAST; s <= WEST; ++s) {
+		for(unsigned int t=0; t<nBetaTubes; t++)
+			std::vector< std::pair<float,float> >().swap(pmtPedPts[s][t]);
+		for(unsigned int p = X_DIRECTION; p <= Y_DIRECTION; p++)
+			for(unsigned int c=0; c<kMWPCWires; c++)
+				std::vector< std::pair<float,float> >().swap(cathPedPts[s][p][c]);
+		std::vector< std::pair<float,float> >().swap(anodePedPts[s]);
+	}
+}
+
+void ucnaDataAnalyzer11b::resetTimeCalibration() {
+	totalTime = deltaT = 0;
+	prevPassedCuts = prevPassedGVRate = true;
+	gvMonChecker = RollingWindow(gvMonChecker.nMax,gvMonChecker.lMax);
+	cutBlips.clear();
+}
+
+void ucnaDataAnalyzer11b::saveRawEvent(RawEventRecord& r) const {
+	r.sis00 = fSis00;
+	r.triggerNumber = fTriggerNumber;
+	for(Side s = EAST; s <= BOTH; ++s)
+		r.timeScaler[s] = fTimeScaler.t[s];
+	r.beamclock = fBeamclock.val;
+	r.delt0 = fDelt0;
+	r.absTime = fAbsTime;
+	for(unsigned int n=0; n<kNumUCNMons; n++)
+		r.monADC[n] = fMonADC[n].val;
+	for(Side s = EAST; s <= WEST; ++s) {
+		for(unsigned int t=0; t<nBetaTubes; t++)
+			r.adc[s][t] = sevt[s].adc[t];
+		for(unsigned int t=0; t<=nBetaTubes; t++)
+			r.scint_tdc[s][t] = fScint_tdc[s][t].val;
+		for(unsigned int p = X_DIRECTION; p <= Y_DIRECTION; p++)
+			for(unsigned int c=0; c<kMWPCWires; c++)
+				r.caths[s][p][c] = fMWPC_caths[s][p][c];
+		r.anode[s] = fMWPC_anode[s].val;
+		r.backing_tdc[s] = fBacking_tdc[s].val;
+		r.backing_adc[s] = fBacking_adc[s];
+		r.drift_tac[s] = fDrift_tac[s].val;
+	}
+	r.top_tdc = fTop_tdc[EAST].val;
+	r.top_adc = fTop_adc[EAST];
+	for(size_t i=0; i<kNumModules; i++) {
+		r.evnb[i] = fEvnb[i];
+		r.bkhf[i] = fBkhf[i];
+	}
+}
+
+void ucnaDataAnalyzer11b::loadRawEvent(const RawEventRecord& r) {
+	fSis00 = r.sis00;
+	fTriggerNumber = r.triggerNumber;
+	for(Side s = EAST; s <= BOTH; ++s)
+		fTimeScaler.t[s] = r.timeScaler[s];
+	fBeamclock.val = r.beamclock;
+	fDelt0 = r.delt0;
+	fAbsTime = r.absTime;
+	for(unsigned int n=0; n<kNumUCNMons; n++)
+		fMonADC[n].val = r.monADC[n];
+	for(Side s = EAST; s <= WEST; ++s) {
+		for(unsigned int t=0; t<nBetaTubes; t++)
+			sevt[s].adc[t] = r.adc[s][t];
+		for(unsigned int t=0; t<=nBetaTubes; t++)
+			fScint_tdc[s][t].val = r.scint_tdc[s][t];
+		for(unsigned int p = X_DIRECTION; p <= Y_DIRECTION; p++)
+			for(unsigned int c=0; c<kMWPCWires; c++)
+				fMWPC_caths[s][p][c] = r.caths[s][p][c];
+		fMWPC_anode[s].val = r.anode[s];
+		fBacking_tdc[s].val = r.backing_tdc[s];
+		fBacking_adc[s] = r.backing_adc[s];
+		fDrift_tac[s].val = r.drift_tac[s];
+	}
+	fTop_tdc[EAST].val = r.top_tdc;
+	fTop_adc[EAST] = r.top_adc;
+	for(size_t i=0; i<kNumModules; i++) {
+		fEvnb[i] = r.evnb[i];
+		fBkhf[i] = r.bkhf[i];
 	}
-	
-	// re-set for next scan
-	wallTime = totalTime.t[BOTH];
 }
 
 void ucnaDataAnalyzer11b::monitorPedestal(std::vector< std::pair<float,float> > dpts, const std::string& mon_name, double graphWidth) {
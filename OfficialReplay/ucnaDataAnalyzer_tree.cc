@@ -39,15 +39,21 @@ void ucnaDataAnalyzer11b::setReadpoints() {
 	
 	// Wirechambers	
 	const int anode_pdc_nums[] = {30,34};
+	MWPos.setSeed(rn);
 	for(Side s = EAST; s<=WEST; ++s) {
 		for(int d = X_DIRECTION; d <= Y_DIRECTION; d++) {
 			std::vector<unsigned int> padcNums = getPadcNumbers(rn,s,AxisDirection(d));
 			kWirePositions[s][d] = calcWirePositions(rn,s,AxisDirection(d));
+			MWPos.setWirePositions(s,AxisDirection(d),kWirePositions[s][d]);
 			cathNames[s][d] = getCathodeNames(rn,s,AxisDirection(d));
+			cathPedIDs[s][d].clear();
+			for(unsigned int c=0; c<cathNames[s][d].size(); c++)
+				cathPedIDs[s][d].push_back(PCal.getSensorID(cathNames[s][d][c]));
 			for(std::vector<unsigned int>::iterator it = padcNums.begin(); it != padcNums.end(); it++)
 				SetBranchAddress(std::string(s==EAST?"Pdc":"Padc")+itos(*it),&fMWPC_caths[s][d][it-padcNums.begin()]);
 		}
 		SetBranchAddress(std::string("Pdc")+itos(anode_pdc_nums[s]),&fMWPC_anode[s].val);
+		anodePedID[s] = PCal.getSensorID(sideSubst("MWPC%cAnode",s));
 	}
 	
 	// muon vetos
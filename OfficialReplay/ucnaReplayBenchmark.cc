@@ -0,0 +1,258 @@
+#include "ucnaReplayBenchmark.hh"
+#include "CalDBFake.hh"
+#include "PathUtils.hh"
+#include <TFile.h>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+/// set cut range
+inline void setRange(RangeCut& r, double x0, double x1) { r.start = x0; r.end = x1; }
+
+ucnaReplayBenchmark::ucnaReplayBenchmark(RunNum R, std::string bp, CalDB* CDB, unsigned int seed):
+ucnaDataAnalyzer11b(R,bp,CDB), synthTree(NULL), rnd(seed), tClock(0), tRead(0), tPedestals(0), tSetup(0), nBlockPos(0), tBlockPos(0) {
+	setStageTiming(1);
+	for(Side s = EAST; s <= WEST; ++s) {
+		for(unsigned int t=0; t<nBetaTubes; t++)
+			pmtPed[s][t] = rnd.Uniform(100,300);
+		for(unsigned int d = X_DIRECTION; d <= Y_DIRECTION; d++)
+			for(unsigned int c=0; c<kMWPCWires; c++)
+				cathPed[s][d][c] = rnd.Uniform(50,400);
+		anodePed[s] = rnd.Uniform(100,200);
+	}
+}
+
+void ucnaReplayBenchmark::SetBranchAddress(const std::string& bname, void* bdata, unsigned int sz) {
+	if(synthTree)
+		synthTree->Branch(bname.c_str(),bdata,(bname+"/F").c_str());
+	else
+		TChainScanner::SetBranchAddress(bname,bdata,sz);
+}
+
+void ucnaReplayBenchmark::setBenchmarkCuts() {
+	for(Side s = EAST; s <= WEST; ++s) {
+		setRange(fMWPC_anode[s].R,50,FLT_MAX);
+		setRange(fCathMax[s].R,100,FLT_MAX);
+		setRange(fCathSum[s].R,300,FLT_MAX);
+		setRange(fBacking_tdc[s].R,500,4000);
+		setRange(fDrift_tac[s].R,500,4000);
+		setRange(ScintSelftrig[s],1900,2100);
+		setRange(fScint_tdc[s][nBetaTubes].R,1000,4000);
+	}
+	setRange(fTop_tdc[EAST].R,500,4000);
+	setRange(fBeamclock.R,0.05,FLT_MAX);
+	manualCuts.clear();
+}
+
+void ucnaReplayBenchmark::generateScint(Side s, float E) {
+	unsigned int nfired = 0;
+	for(unsigned int t=0; t<nBetaTubes; t++) {
+		float q = rnd.Poisson(0.3*E)/0.3;
+		sevt[s].adc[t] += q;
+		if(sevt[s].adc[t] > 4095)
+			sevt[s].adc[t] = 4095;
+		if(q > 20) {
+			fScint_tdc[s][t].val = rnd.Gaus(2500,20);
+			nfired++;
+		}
+	}
+	if(nfired >= 2)
+		fScint_tdc[s][nBetaTubes].val = rnd.Gaus(2000,30);
+}
+
+void ucnaReplayBenchmark::generateMWPC(Side s, float x, float y, float a) {
+	const float wireSigma = 4.0;
+	for(unsigned int d = X_DIRECTION; d <= Y_DIRECTION; d++) {
+		const std::vector<Float_t>& wpos = kWirePositions[s][d];
+		const float x0 = d==X_DIRECTION?x:y;
+		for(unsigned int c=0; c<wpos.size() && c<kMWPCWires; c++) {
+			float u = (wpos[c]-x0)/wireSigma;
+			fMWPC_caths[s][d][c] += a*exp(-0.5*u*u);
+			if(fMWPC_caths[s][d][c] > 4095)
+				fMWPC_caths[s][d][c] = 4095;
+		}
+	}
+	fMWPC_anode[s].val += 0.5*a;
+}
+
+void ucnaReplayBenchmark::generateEvent(unsigned int n) {
+
+	// clocks and headers; ~100Hz event rate, 10s beam cycle
+	double dt = rnd.Exp(1.0e4);
+	tClock += dt;
+	fTriggerNumber = n;
+	for(Side s = EAST; s <= BOTH; ++s)
+		fTimeScaler.t[s] = fmod(tClock,4294967296.0);
+	fBeamclock.val = fmod(tClock,1.0e7);
+	fDelt0 = dt;
+	fAbsTime = 1.3e9 + 1.0e-6*tClock;
+	for(size_t i=0; i<kNumModules; i++) {
+		fEvnb[i] = n;
+		fBkhf[i] = 17;
+	}
+	if(rnd.Uniform() < 1e-4)
+		fBkhf[rnd.Integer(kNumModules)] = 0;
+
+	// pedestal noise on all channels
+	fSis00 = 0;
+	for(unsigned int m=0; m<kNumUCNMons; m++)
+		fMonADC[m].val = rnd.Gaus(100,10);
+	for(Side s = EAST; s <= WEST; ++s) {
+		for(unsigned int t=0; t<nBetaTubes; t++)
+			sevt[s].adc[t] = pmtPed[s][t]+rnd.Gaus(0,3);
+		for(unsigned int t=0; t<=nBetaTubes; t++)
+			fScint_tdc[s][t].val = 0;
+		for(unsigned int d = X_DIRECTION; d <= Y_DIRECTION; d++)
+			for(unsigned int c=0; c<kMWPCWires; c++)
+				fMWPC_caths[s][d][c] = cathPed[s][d][c]+rnd.Gaus(0,4);
+		fMWPC_anode[s].val = anodePed[s]+rnd.Gaus(0,5);
+		fBacking_tdc[s].val = 0;
+		fBacking_adc[s] = rnd.Gaus(50,5);
+		fDrift_tac[s].val = 0;
+	}
+	fTop_tdc[EAST].val = 0;
+	fTop_adc[EAST] = rnd.Gaus(50,5);
+
+	double u = rnd.Uniform();
+	if(u < 0.01) {
+		// LED
+		fSis00 = 1<<7;
+		for(Side s = EAST; s <= WEST; ++s)
+			generateScint(s,1000);
+	} else if(u < 0.09) {
+		// UCN monitor; half of these GV
+		unsigned int m = rnd.Uniform()<0.5 ? UCN_MON_GV : rnd.Integer(kNumUCNMons);
+		fSis00 = (1<<2) | (1<<(8+m));
+		fMonADC[m].val += rnd.Gaus(1500,200);
+	} else if(u < 0.10) {
+		// Bi pulser into one tube
+		fSis00 = 1<<5;
+		Side s = rnd.Uniform()<0.5?EAST:WEST;
+		sevt[s].adc[rnd.Integer(nBetaTubes)] += rnd.Gaus(3000,60);
+	} else {
+		// scintillator trigger: betas, with some backscatters, gammas, and muons
+		Side s = rnd.Uniform()<0.5?EAST:WEST;
+		fSis00 = s==EAST?1:2;
+		bool gamma = rnd.Uniform() < 0.1;
+		bool muon = !gamma && rnd.Uniform() < 0.03;
+		float E = muon ? rnd.Uniform(1000,3000) : rnd.Uniform(10,800);
+		float Eback = (!gamma && !muon && rnd.Uniform() < 0.05) ? rnd.Uniform(10,100) : 0;
+		float r = 50.0*sqrt(rnd.Uniform());
+		float th = 2*M_PI*rnd.Uniform();
+		generateScint(s,E-Eback);
+		if(!gamma)
+			generateMWPC(s,r*cos(th),r*sin(th),rnd.Landau(800,200));
+		if(Eback) {
+			generateScint(otherSide(s),Eback);
+			generateMWPC(otherSide(s),-r*cos(th),r*sin(th),rnd.Landau(800,200));
+		}
+		if(muon) {
+			fBacking_tdc[s].val = rnd.Gaus(2000,100);
+			fBacking_adc[s] += rnd.Gaus(1000,200);
+			fDrift_tac[s].val = rnd.Gaus(2000,200);
+			if(s==EAST) {
+				fTop_tdc[EAST].val = rnd.Gaus(2000,100);
+				fTop_adc[EAST] += rnd.Gaus(1000,200);
+			}
+		}
+	}
+}
+
+void ucnaReplayBenchmark::benchmarkBlockPositioning(unsigned int n) {
+	float (*caths)[2][2][kMWPCWires] = new float[n][2][2][kMWPCWires];
+	float (*peds)[2][2][kMWPCWires] = new float[n][2][2][kMWPCWires];
+	wireHit (*hits)[2][2] = new wireHit[n][2][2];
+	for(unsigned int i=0; i<n; i++) {
+		generateEvent(i);
+		memcpy(caths[i],fMWPC_caths,sizeof(fMWPC_caths));
+		memcpy(peds[i],cathPed,sizeof(cathPed));
+	}
+	double t0 = StageTimer::now();
+	MWPos.reconstructBlock(n,caths,peds,hits);
+	tBlockPos = StageTimer::now()-t0;
+	nBlockPos = n;
+	delete[] caths;
+	delete[] peds;
+	delete[] hits;
+}
+
+void ucnaReplayBenchmark::makeSyntheticData(const std::string& fname, unsigned int n) {
+	printf("Generating %i synthetic events in '%s'...\n",n,fname.c_str());
+	makePath(fname,true);
+	TFile f(fname.c_str(),"RECREATE");
+	synthTree = new TTree("h1","synthetic raw data");
+	setReadpoints();
+	tClock = 0;
+	for(unsigned int i=0; i<n; i++) {
+		generateEvent(i);
+		synthTree->Fill();
+	}
+	synthTree->Write();
+	f.Close();
+	synthTree = NULL;
+}
+
+void ucnaReplayBenchmark::runBenchmark() {
+	setBenchmarkCuts();
+	setupOutputTree();
+
+	// pedestals and run time from synthetic data, as in replay pre-pass
+	double t0 = StageTimer::now();
+	pedestalPrePass();
+	tPedestals = StageTimer::now()-t0;
+
+	// histograms and (optional) calibration tables built outside of timed event loop
+	t0 = StageTimer::now();
+	setupHistograms();
+	setupCompiledCal();
+	tSetup = StageTimer::now()-t0;
+
+	printf("Benchmark scan...\n");
+	PT.reset();
+	startScan();
+	tRead = 0;
+	t0 = StageTimer::now();
+	while(nextPoint()) {
+		tRead += StageTimer::now()-t0;
+		processEvent();
+		t0 = StageTimer::now();
+	}
+
+	benchmarkBlockPositioning(nEvents < (1<<16) ? nEvents : (1<<16));
+	
+	printRates();
+	Stringmap m = PT.toStringmap();
+	m.insert("read_time",tRead);
+	m.insert("nEvents",nEvents);
+	m.insert("pedestals_time",tPedestals);
+	m.insert("setup_time",tSetup);
+	m.insert("block_position_time",tBlockPos);
+	m.insert("compiledTol",compiledCalTol);
+	qOut.insert("benchmark",m);
+}
+
+void ucnaReplayBenchmark::printRates() const {
+	double ttot = PT.getTotal();
+	printf("\n------------------ Replay Benchmark ------------------\n");
+	printf("%i events; calibration '%s'%s\n",nEvents,PCal.CDB->getName().c_str(),CCal?", compiled energy tables":"");
+	printf("Pedestal extraction pass: %.2fs = %.0f events/s\n",tPedestals,tPedestals>0?nEvents/tPedestals:0);
+	printf("Histogram and calibration setup: %.2fs\n",tSetup);
+	printf("Input read: %.2fs = %.0f events/s\n",tRead,tRead>0?nEvents/tRead:0);
+	PT.display();
+	printf("Event processing: %.2fs = %.0f events/s\n",ttot,ttot>0?nEvents/ttot:0);
+	printf("Read + processing: %.0f events/s\n",ttot+tRead>0?nEvents/(ttot+tRead):0);
+	printf("Block wirechamber positioning: %.2fs = %.0f events/s\n",tBlockPos,tBlockPos>0?nBlockPos/tBlockPos:0);
+	printf("------------------------------------------------------\n\n");
+}
+
+void runReplayBenchmark(unsigned int nEvents, float compiledTol, const std::string& outDir) {
+	const RunNum rn = 16000;	// 2011 detector readout layout
+	CalDBFake CDB;
+	ucnaReplayBenchmark B(rn,outDir,&CDB);
+	B.setCompiledCal(compiledTol);
+	std::string fname = outDir+"/Synthetic/full"+itos(rn)+".root";
+	B.makeSyntheticData(fname,nEvents);
+	B.addFile(fname);
+	B.runBenchmark();
+	B.write();
+}
@@ -0,0 +1,51 @@
+#ifndef UCNAREPLAYBENCHMARK_HH
+#define UCNAREPLAYBENCHMARK_HH 1
+
+#include "ucnaDataAnalyzer11b.hh"
+#include "StageTimer.hh"
+#include <TRandom3.h>
+
+/// replay throughput benchmark: synthetic raw "h1" data through the full event processing chain
+class ucnaReplayBenchmark: public ucnaDataAnalyzer11b {
+public:
+	/// constructor
+	ucnaReplayBenchmark(RunNum R, std::string bp, CalDB* CDB, unsigned int seed = 1);
+
+	/// write synthetic raw data tree with n events to file
+	void makeSyntheticData(const std::string& fname, unsigned int n);
+	/// process loaded input files, timing each processing stage
+	void runBenchmark();
+	/// print per-stage processing rates
+	void printRates() const;
+
+protected:
+	/// create synthetic data tree branches when writing, otherwise set read points
+	virtual void SetBranchAddress(const std::string& bname, void* bdata, unsigned int sz = 0);
+	/// set generic cuts in place of ManualInfo run cuts
+	void setBenchmarkCuts();
+	/// generate raw readout for one synthetic event
+	void generateEvent(unsigned int n);
+	/// generate scintillator PMT and TDC readout for visible energy E
+	void generateScint(Side s, float E);
+	/// generate wirechamber cathode and anode readout for hit at (x,y) with charge amplitude a
+	void generateMWPC(Side s, float x, float y, float a);
+	/// time batch wirechamber positioning for a block of n synthetic events
+	void benchmarkBlockPositioning(unsigned int n);
+
+	TTree* synthTree;						//< synthetic data tree being written
+	TRandom3 rnd;							//< random number source for synthetic data
+	double tClock;							//< synthetic run clock [us]
+	float pmtPed[2][nBetaTubes];			//< synthetic PMT pedestals
+	float cathPed[2][2][kMWPCWires];		//< synthetic cathode pedestals
+	float anodePed[2];						//< synthetic anode pedestals
+	double tRead;							//< time reading input events [s]
+	double tPedestals;						//< time for pedestal extraction pass [s]
+	double tSetup;							//< time for histogram and calibration table setup [s]
+	unsigned int nBlockPos;					//< number of events in batch wirechamber positioning block
+	double tBlockPos;						//< time for batch wirechamber positioning [s]
+};
+
+/// generate synthetic data and run replay benchmark with fake calibrations; compiledTol > 0 for lookup-table energy calibration
+void runReplayBenchmark(unsigned int nEvents, float compiledTol, const std::string& outDir);
+
+#endif
@@ -1,16 +1,43 @@
 #include "SQL_Utils.hh"
 #include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <set>
 #include "strutils.hh"
 
+/// currently open socket file descriptors
+static std::set<int> openSockets() {
+	std::set<int> socks;
+	struct stat st;
+	const int nfd = getdtablesize();
+	for(int fd=0; fd<nfd; fd++)
+		if(!fstat(fd,&st) && S_ISSOCK(st.st_mode))
+			socks.insert(fd);
+	return socks;
+}
+
 SQLHelper::SQLHelper(const std::string& dbnm,
 					 const std::string& dbAddress,
-					 const std::string& dbUser,
-					 const std::string& dbPass,
+					 const std::string& dbUsr,
+					 const std::string& dbPw,
 					 unsigned int port,
-					 unsigned int ntries): db(NULL), res(NULL), dbName(dbnm) {
-	
-	std::string dbAddressFull = std::string("mysql://")+dbAddress+":"+itos(port)+"/"+dbnm;
-	
+					 unsigned int ntries): db(NULL), res(NULL), dbName(dbnm),
+dbAddressFull(std::string("mysql://")+dbAddress+":"+itos(port)+"/"+dbnm), dbUser(dbUsr), dbPass(dbPw), dbSocket(-1) {
+	connect(ntries);
+}
+
+void SQLHelper::dropInheritedConnection() {
+	// TSQLServer::Close() would send "quit" over the socket shared with the parent, so the connection object is abandoned
+	if(dbSocket >= 0)
+		close(dbSocket);
+	dbSocket = -1;
+	db = NULL;
+	res = NULL;
+}
+
+void SQLHelper::connect(unsigned int ntries) {
+	// identify connection socket as the one newly opened by connecting
+	std::set<int> socks0 = openSockets();
 	while(!db) {
 		ntries--;
 		db = TSQLServer::Connect(dbAddressFull.c_str(),dbUser.c_str(),dbPass.c_str());
@@ -21,6 +48,10 @@ SQLHelper::SQLHelper(const std::string& dbnm,
 			sleep(2);
 		} else {
 			printf("Connected to DB server: %s\n", db->ServerInfo());
+			std::set<int> socks1 = openSockets();
+			for(std::set<int>::const_iterator it = socks1.begin(); it != socks1.end(); it++)
+				if(!socks0.count(*it))
+					dbSocket = *it;
 			return;
 		}
 	}
@@ -29,6 +60,8 @@ SQLHelper::SQLHelper(const std::string& dbnm,
 }
 
 void SQLHelper::execute() {
+	if(!db)
+		connect(3);
 	assert(db || IGNORE_DEAD_DB);
 	if(res) delete(res);
 	res = NULL;
@@ -36,6 +69,8 @@ void SQLHelper::execute() {
 }
 
 void SQLHelper::Query() { 
+	if(!db)
+		connect(3);
 	assert(db || IGNORE_DEAD_DB);
 	if(!db) {
 		res = NULL;
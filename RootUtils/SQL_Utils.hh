@@ -28,6 +28,10 @@ public:
 	/// destructor
 	virtual ~SQLHelper() { if(res) delete(res); if(db) db->Close(); }
 	
+	/// in a forked child process, close the connection inherited from the parent without sending the protocol "quit"
+	/// (which would end the parent's session); a new connection is opened on next use
+	void dropInheritedConnection();
+	
 	/// get name of DB in use
 	std::string getDBName() const { return dbName; }
 	
@@ -50,15 +54,21 @@ protected:
 	void printResult();
 	
 	/// check if table exists in DB
-	bool checkTable(const char* tname) { return db && db->HasTable(tname); }
+	bool checkTable(const char* tname) { if(!db) connect(3); return db && db->HasTable(tname); }
 	
 	/// execute an info-returning query
 	void Query();
+	/// (re-)connect to DB server, with ntries attempts
+	void connect(unsigned int ntries);
 
 protected:	
 	TSQLServer* db;				//< DB server connection
 	TSQLResult* res;			//< result of most recent query
 	std::string dbName;			//< name of DB in use
+	std::string dbAddressFull;	//< DB server URL
+	std::string dbUser;			//< DB user name
+	std::string dbPass;			//< DB password
+	int dbSocket;				//< socket descriptor for DB connection (-1 if unknown)
 };
 
 /// convert a stringmap to "(vars,...) VALUES (vals,...)" for DB insert query
@@ -1,5 +1,5 @@
 #include "EndpointStudy.hh"
-#include "CalDBSQL.hh"
+#include "CalDBSnapshot.hh"
 #include "MultiGaus.hh"
 #include "TH1toPMT.hh"
 #include <TStyle.h>
@@ -97,7 +97,7 @@ void PositionBinner::fillCoreHists(ProcessedDataScanner& PDS, double weight) {
 void PositionBinner::calculateResults() {
 	
 	assert(runTimes.counts.size());
-	PMTCalibrator PCal(runTimes.counts.begin()->first,CalDBSQL::getCDB());
+	PMTCalibrator PCal(runTimes.counts.begin()->first,CalDBSnapshot::getActiveCDB());
 	printf("\n\n---- Using Calibrator: ----\n");
 	PCal.printSummary();
 	
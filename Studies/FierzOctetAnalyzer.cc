@@ -91,9 +91,8 @@ int main(int argc, char *argv[]) {
 		// make another version of the analyzer, with a different output path for simulation, pointing to the data to clone
 		FierzOctetAnalyzer OAE_Sim(&OM,"Full_Energy_Asymmetry_Example_Simulated",FierzOctetAnalyzer::processedLocation);
 
-		// and set up a simulation data source from neutron beta decay simulation
-		G4toPMT simData;
-		simData.addFile("/home/mmendenhall/geant4/output/Livermore_neutronBetaUnpol_geomC/analyzed_*.root");
+		// simulation data source from neutron beta decay simulation (reduced input if available, see getSimSource)
+		const std::string simData = "/home/mmendenhall/geant4/output/Livermore_neutronBetaUnpol_geomC/analyzed_*.root";
 
 		// point the simulation cloner to the real data; clone equal amounts of counts where not already simulated within the past hour
 		//simuClone(OM.basePath+"/Anode_Asymmetry_Example", OAE_Sim, simData, 1.0, 3600);
@@ -0,0 +1,170 @@
+#include "HistArena.hh"
+#include "Types.hh"
+#include <cassert>
+#include <algorithm>
+
+unsigned int HistArena::addSlot(TH1* h) {
+	assert(h && !pending);
+	hists.push_back(h);
+	offsets.push_back(nBins);
+	nBins += totalBins(h);
+	contents.clear();
+	sumw2.clear();
+	entries.clear();
+	stats.clear();
+	return hists.size()-1;
+}
+
+void HistArena::allocate() {
+	if(contents.size() == nBins && entries.size() == hists.size())
+		return;
+	contents.assign(nBins,0);
+	sumw2.assign(nBins,0);
+	entries.assign(hists.size(),0);
+	stats.assign(nStats*hists.size(),0);
+}
+
+void HistArena::accumulate(unsigned int i, const TH1* h) {
+	assert(i < hists.size() && h);
+	const unsigned int n = totalBins(h);
+	assert(n == totalBins(hists[i]));
+	allocate();
+	double* c = &contents[offsets[i]];
+	double* s = &sumw2[offsets[i]];
+	if(h->GetSumw2N()) {
+		const double* hs = ((TH1*)h)->GetSumw2()->GetArray();
+		for(unsigned int b=0; b<n; b++) {
+			c[b] += h->GetBinContent(b);
+			s[b] += hs[b];
+		}
+	} else {
+		for(unsigned int b=0; b<n; b++) {
+			const double x = h->GetBinContent(b);
+			c[b] += x;
+			s[b] += x;
+		}
+	}
+	entries[i] += h->GetEntries();
+	double hst[nStats];
+	std::fill(hst,hst+nStats,0.);
+	h->GetStats(hst);
+	for(unsigned int k=0; k<nStats; k++)
+		stats[nStats*i+k] += hst[k];
+	pending = true;
+}
+
+void HistArena::accumulate(const HistArena& A) {
+	assert(A.nBins == nBins && A.hists.size() == hists.size());
+	if(!A.pending)
+		return;
+	allocate();
+	for(unsigned int b=0; b<nBins; b++) {
+		contents[b] += A.contents[b];
+		sumw2[b] += A.sumw2[b];
+	}
+	for(unsigned int i=0; i<entries.size(); i++)
+		entries[i] += A.entries[i];
+	for(unsigned int k=0; k<stats.size(); k++)
+		stats[k] += A.stats[k];
+	pending = true;
+}
+
+void HistArena::accumulate(unsigned int i, const HistArena& A, unsigned int j) {
+	assert(i < hists.size() && j < A.hists.size());
+	if(!A.pending)
+		return;
+	const unsigned int n = totalBins(A.hists[j]);
+	assert(n == totalBins(hists[i]));
+	allocate();
+	for(unsigned int b=0; b<n; b++) {
+		contents[offsets[i]+b] += A.contents[A.offsets[j]+b];
+		sumw2[offsets[i]+b] += A.sumw2[A.offsets[j]+b];
+	}
+	entries[i] += A.entries[j];
+	for(unsigned int k=0; k<nStats; k++)
+		stats[nStats*i+k] += A.stats[nStats*j+k];
+	pending = true;
+}
+
+void HistArena::flush() {
+	if(!pending)
+		return;
+	for(unsigned int i=0; i<hists.size(); i++) {
+		TH1* h = hists[i];
+		const double* c = &contents[offsets[i]];
+		const double* s = &sumw2[offsets[i]];
+		const unsigned int n = totalBins(h);
+		if(!h->GetSumw2N())
+			h->Sumw2();
+		double* hs = h->GetSumw2()->GetArray();
+		const double e0 = h->GetEntries();
+		// SetBinContent resets the unbinned statistics; capture and restore them summed
+		double hst[nStats];
+		std::fill(hst,hst+nStats,0.);
+		h->GetStats(hst);
+		for(unsigned int k=0; k<nStats; k++)
+			hst[k] += stats[nStats*i+k];
+		for(unsigned int b=0; b<n; b++) {
+			h->SetBinContent(b,h->GetBinContent(b)+c[b]);
+			hs[b] += s[b];
+		}
+		h->PutStats(hst);
+		h->SetEntries(e0+entries[i]);
+	}
+	clear();
+}
+
+bool HistArena::writeHists(FILE* f) const {
+	std::vector<double> buf;
+	for(unsigned int i=0; i<hists.size(); i++) {
+		TH1* h = hists[i];
+		const unsigned int n = totalBins(h);
+		buf.resize(2*n+1+nStats);
+		for(unsigned int b=0; b<n; b++)
+			buf[b] = h->GetBinContent(b);
+		if(h->GetSumw2N()) {
+			const double* hs = h->GetSumw2()->GetArray();
+			for(unsigned int b=0; b<n; b++)
+				buf[n+b] = hs[b];
+		} else {
+			for(unsigned int b=0; b<n; b++)
+				buf[n+b] = buf[b];
+		}
+		buf[2*n] = h->GetEntries();
+		std::fill(buf.begin()+2*n+1,buf.end(),0.);
+		h->GetStats(&buf[2*n+1]);
+		if(fwrite(&buf[0],sizeof(double),buf.size(),f) != buf.size())
+			return false;
+	}
+	return true;
+}
+
+bool HistArena::readAccumulate(FILE* f) {
+	// read everything before adding, so a failed read leaves arena unchanged
+	std::vector<double> buf(2*nBins+(1+nStats)*hists.size());
+	if(buf.size() && fread(&buf[0],sizeof(double),buf.size(),f) != buf.size())
+		return false;
+	allocate();
+	const double* p = buf.size()?&buf[0]:NULL;
+	for(unsigned int i=0; i<hists.size(); i++) {
+		const unsigned int n = totalBins(hists[i]);
+		for(unsigned int b=0; b<n; b++) {
+			contents[offsets[i]+b] += p[b];
+			sumw2[offsets[i]+b] += p[n+b];
+		}
+		entries[i] += p[2*n];
+		for(unsigned int k=0; k<nStats; k++)
+			stats[nStats*i+k] += p[2*n+1+k];
+		p += 2*n+1+nStats;
+	}
+	pending = true;
+	return true;
+}
+
+void HistArena::clear() {
+	contents.clear();
+	sumw2.clear();
+	entries.clear();
+	stats.clear();
+	pending = false;
+}
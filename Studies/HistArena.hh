@@ -0,0 +1,52 @@
+#ifndef HISTARENA_HH
+#define HISTARENA_HH 1
+
+#include <TH1.h>
+#include <vector>
+#include <stdio.h>
+
+/// contiguous storage of bin contents and sum of squared weights for a set of histograms, for merging many segments with flat array adds
+class HistArena {
+public:
+	static const unsigned int nStats = 13;	//< unbinned statistics (TH1::GetStats) kept per slot; enough for any TH1/TProfile
+	
+	/// constructor
+	HistArena(): nBins(0), pending(false) {}
+	
+	/// add histogram to arena layout; return slot number
+	unsigned int addSlot(TH1* h);
+	/// number of histogram slots
+	unsigned int size() const { return hists.size(); }
+	/// whether arena holds data not yet added into histograms
+	bool isPending() const { return pending; }
+	
+	/// add contents of h (same binning as slot i) into arena
+	void accumulate(unsigned int i, const TH1* h);
+	/// add another arena with same layout
+	void accumulate(const HistArena& A);
+	/// add slot j of another arena into slot i
+	void accumulate(unsigned int i, const HistArena& A, unsigned int j);
+	/// add arena contents into histograms and clear arena
+	void flush();
+	/// write current histogram contents, in slot order
+	bool writeHists(FILE* f) const;
+	/// read and add histogram contents written by writeHists from arena with same layout
+	bool readAccumulate(FILE* f);
+	/// clear arena contents
+	void clear();
+	
+protected:
+	/// allocate storage for all slots
+	void allocate();
+	
+	std::vector<TH1*> hists;			//< histogram for each slot
+	std::vector<unsigned int> offsets;	//< start of each slot's bins in storage
+	unsigned int nBins;					//< total number of bins in all slots
+	std::vector<double> contents;		//< bin contents for all slots
+	std::vector<double> sumw2;			//< sum of squared weights for all slots
+	std::vector<double> entries;		//< number of entries for each slot
+	std::vector<double> stats;			//< unbinned statistics (sumw, sumw2, sumwx, sumwx2, ...) for each slot, nStats per slot
+	bool pending;						//< whether arena holds un-flushed data
+};
+
+#endif
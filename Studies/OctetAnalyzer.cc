@@ -4,7 +4,14 @@
 #include "GraphicsUtils.hh"
 #include "EnergyCalibrator.hh"
 #include "CalDBSQL.hh"
+#include "CalDBSnapshot.hh"
+#include "SegmentManifest.hh"
 #include "Types.hh"
+#include <set>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <time.h>
 
 void quadHists::setFillPoint(AFPState afp, GVState gv) {
 	if(!fillPoint) return;
@@ -81,6 +88,7 @@ void OctetAnalyzer::setFillPoints(AFPState afp, GVState gv) {
 }
 
 quadHists& OctetAnalyzer::getCoreHist(const std::string& qname) {
+	flushArena();
 	std::map<std::string,quadHists>::iterator it = coreHists.find(qname);
 	assert(it != coreHists.end());
 	return it->second;
@@ -251,9 +259,122 @@ unsigned int processPulsePair(OctetAnalyzer& OA, const Octet& PP) {
 	return nproc;
 }
 
-unsigned int processOctets(OctetAnalyzer& OA, const std::vector<Octet>& Octs, double replaceIfOlder) {
+/// check whether saved output for a sub-octet can be re-used: made from the same runs, calibrations, settings, and code,
+/// and newer than replaceIfOlder
+static bool octetUpToDate(const OctetAnalyzer& OA, const Octet& oct, double replaceIfOlder) {
+	std::string inflname = OA.basePath+"/"+oct.octName()+"/"+oct.octName();
+	double fAge = fileAge(inflname+".root");
+	if(fAge < 0 || fAge >= replaceIfOlder)
+		return false;
+	return SegmentManifest(OA,oct.getAllRuns()).matches(inflname);
+}
+
+/// check whether file exists and was modified at or after time t0
+static bool writtenSince(const std::string& fname, time_t t0) {
+	struct stat attrib;
+	return !stat(fname.c_str(),&attrib) && attrib.st_mtime >= t0;
+}
+
+/// process sub-octets needing re-processing in up to nJobs forked workers, each writing its own output for merging;
+/// fills done with names of successfully processed sub-octets; returns number of processed pulse-pairs
+unsigned int processOctetsParallel(OctetAnalyzer& OA, const std::vector<Octet>& Octs, double replaceIfOlder,
+								   unsigned int nJobs, std::set<std::string>& done) {
+	
+	// select sub-octets without up-to-date output
+	std::vector<const Octet*> todo;
+	for(std::vector<Octet>::const_iterator octit = Octs.begin(); octit != Octs.end(); octit++) {
+		if(octit->divlevel > 2 || !octit->getNRuns())
+			continue;
+		if(octetUpToDate(OA,*octit,replaceIfOlder))
+			continue;
+		todo.push_back(&*octit);
+	}
+	if(todo.size() < 2)
+		return 0;
+	printf("Processing %i octet divisions with %i worker processes...\n",(int)todo.size(),nJobs);
 	
 	unsigned int nproc = 0;
+	unsigned int nDone = 0;
+	std::map< pid_t, std::pair<const Octet*,int> > running;	// worker process -> octet, result pipe
+	std::map<pid_t,time_t> started;							// worker process -> start time
+	std::vector<const Octet*>::const_iterator nextOct = todo.begin();
+	while(nextOct != todo.end() || running.size()) {
+		
+		// launch workers up to limit
+		while(running.size() < nJobs && nextOct != todo.end()) {
+			const Octet& oct = **(nextOct++);
+			int fd[2];
+			if(pipe(fd)) {
+				printf("*** Failed to open result pipe for '%s'!\n",oct.octName().c_str());
+				continue;
+			}
+			fflush(stdout);
+			fflush(stderr);
+			const time_t t0 = time(NULL);
+			pid_t pid = fork();
+			if(pid < 0) {
+				printf("*** Failed to fork processing of '%s'!\n",oct.octName().c_str());
+				close(fd[0]);
+				close(fd[1]);
+				continue;
+			}
+			if(!pid) {
+				close(fd[0]);
+				std::string octDir = OA.basePath+"/"+oct.octName();
+				makePath(octDir);
+				std::string logName = octDir+"/"+oct.octName()+"_log.txt";
+				if(!freopen(logName.c_str(),"w",stdout) || dup2(fileno(stdout),fileno(stderr)) < 0)
+					_exit(1);
+				CalDBSQL::forgetCDB();
+				// share fill/simulation worker processes among simultaneous octet jobs
+				const unsigned int innerJobs = OA.fillJobs/nJobs;
+				setenv("UCNA_FILL_JOBS",itos(innerJobs?innerJobs:1).c_str(),1);
+				OctetAnalyzer* subOA = (OctetAnalyzer*)OA.makeAnalyzer(oct.octName(),"");
+				subOA->depth = oct.divlevel;
+				unsigned int n = processOctets(*subOA,oct.getSubdivs(oct.divlevel+1,false),replaceIfOlder);
+				// .root output is written on deletion
+				const std::string rootName = subOA->rootPath+"/"+subOA->name+".root";
+				delete(subOA);
+				bool ok = writtenSince(rootName,t0) && write(fd[1],&n,sizeof(n)) == (ssize_t)sizeof(n);
+				fflush(stdout);
+				_exit(ok?0:1);
+			}
+			close(fd[1]);
+			running.insert(std::make_pair(pid,std::make_pair(&oct,fd[0])));
+			started[pid] = t0;
+		}
+		
+		// collect finished worker
+		int status = 0;
+		pid_t pid = wait(&status);
+		if(pid < 0)
+			break;
+		std::map< pid_t, std::pair<const Octet*,int> >::iterator it = running.find(pid);
+		if(it == running.end())
+			continue;
+		unsigned int n = 0;
+		const std::string octName = it->second.first->octName();
+		bool ok = WIFEXITED(status) && !WEXITSTATUS(status) && read(it->second.second,&n,sizeof(n)) == (ssize_t)sizeof(n);
+		ok = ok && writtenSince(OA.basePath+"/"+octName+"/"+octName+".root",started[pid]);
+		close(it->second.second);
+		started.erase(pid);
+		if(ok) {
+			done.insert(it->second.first->octName());
+			nproc += n;
+		}
+		printf("[%i/%i] Octet '%s' %s\n",++nDone,(int)todo.size(),it->second.first->octName().c_str(),ok?"done":"FAILED; will re-process serially");
+		fflush(stdout);
+		running.erase(it);
+	}
+	return nproc;
+}
+
+unsigned int processOctets(OctetAnalyzer& OA, const std::vector<Octet>& Octs, double replaceIfOlder, unsigned int nJobs) {
+	
+	// sub-octets processed in parallel workers, merged in the serial loop below in input order
+	std::set<std::string> workerDone;
+	unsigned int nproc = nJobs > 1 ? processOctetsParallel(OA,Octs,replaceIfOlder,nJobs,workerDone) : 0;
+	std::vector<RunNum> allRuns;
 	
 	for(std::vector<Octet>::const_iterator octit = Octs.begin(); octit != Octs.end(); octit++) {
 		
@@ -264,14 +385,19 @@ unsigned int processOctets(OctetAnalyzer& OA, const std::vector<Octet>& Octs, do
 			continue;
 		}
 		OA.qOut.insert("Octet",octit->toStringmap());
+		std::vector<RunNum> octRuns = octit->getAllRuns();
+		allRuns.insert(allRuns.end(),octRuns.begin(),octRuns.end());
 		
 		if(octit->divlevel<=2) {
 			// make sub-Analyzer for this octet, to load data if already available, otherwise re-process
 			OctetAnalyzer* subOA;
 			std::string inflname = OA.basePath+"/"+octit->octName()+"/"+octit->octName();
 			double fAge = fileAge(inflname+".root");
-			if(fileExists(inflname+".root") && fileExists(inflname+".txt") && fAge < replaceIfOlder) {
-				printf("Octet '%s' already scanned %.1fh ago; skipping\n",octit->octName().c_str(),fAge/3600);
+			if(workerDone.count(octit->octName())) {
+				printf("Octet '%s' processed by worker; merging\n",octit->octName().c_str());
+				subOA = (OctetAnalyzer*)OA.makeAnalyzer(octit->octName(),inflname);
+			} else if(octetUpToDate(OA,*octit,replaceIfOlder)) {
+				printf("Octet '%s' already scanned %.1fh ago with unchanged inputs; skipping\n",octit->octName().c_str(),fAge/3600);
 				subOA = (OctetAnalyzer*)OA.makeAnalyzer(octit->octName(),inflname);
 			} else {
 				subOA = (OctetAnalyzer*)OA.makeAnalyzer(octit->octName(),"");
@@ -286,10 +412,12 @@ unsigned int processOctets(OctetAnalyzer& OA, const std::vector<Octet>& Octs, do
 	}
 	
 	// make output for octet
+	OA.flushArena();
 	if(OA.needsSubtraction)
 		OA.bgSubtractAll();
 	OA.calculateResults();
 	OA.makePlots();
+	OA.qOut.insert("manifest",SegmentManifest(OA,allRuns).toStringmap());
 	OA.write();
 	OA.setWriteRoot(true);
 	
@@ -298,12 +426,19 @@ unsigned int processOctets(OctetAnalyzer& OA, const std::vector<Octet>& Octs, do
  
 void simForRun(OctetAnalyzer& OA, Sim2PMT& simData, RunNum rn, AFPState afp, unsigned int nToSim) {
 	assert(afp == AFP_ON || afp == AFP_OFF || afp == AFP_OTHER);
-	PMTCalibrator PCal(rn,CalDBSQL::getCDB());
+	PMTCalibrator PCal(rn,CalDBSnapshot::getActiveCDB());
 	simData.setCalibrator(PCal);
 	simData.setAFP(afp);
 	OA.loadSimData(simData,nToSim);
 }
 
+unsigned int simuClone(const std::string& basedata, OctetAnalyzer& OA, const std::string& g4files, double simfactor, double replaceIfOlder) {
+	Sim2PMT* simData = getSimSource(g4files);
+	unsigned int n = simuClone(basedata,OA,*simData,simfactor,replaceIfOlder);
+	delete(simData);
+	return n;
+}
+
 unsigned int simuClone(const std::string& basedata, OctetAnalyzer& OA, Sim2PMT& simData, double simfactor, double replaceIfOlder) {
 	
 	printf("\n------ Cloning asymmetry data in '%s'... --------\n",basedata.c_str());
@@ -336,7 +471,18 @@ unsigned int simuClone(const std::string& basedata, OctetAnalyzer& OA, Sim2PMT&
 		printf("\tNo data subdirectories found; assume data here needs cloning...\n");
 		// check if simulation has already been done; load that data if so
 		std::string prevCloneInfl = OA.basePath+"/"+OA.name;
-		if(fileExists(prevCloneInfl+".root") && fileAge(prevCloneInfl+".root") < replaceIfOlder) {
+		std::vector<RunNum> origRuns;
+		for(std::map<RunNum,double>::iterator it = origOA->runCounts.counts.begin(); it != origOA->runCounts.counts.end(); it++)
+			if(it->first && it->second) origRuns.push_back(it->first);
+		SegmentManifest M(OA,origRuns);
+		M.addInput("data",SegmentManifest::fileStamp(OA.getInflName()+".root"));
+		M.addInput("simfactor",dtos(simfactor));
+		std::string simFiles;
+		for(unsigned int n=0; simData.getFileName(n).size(); n++)
+			simFiles += SegmentManifest::fileStamp(simData.getFileName(n));
+		M.addInput("simulation",simFiles);
+		OA.qOut.insert("manifest",M.toStringmap());
+		if(fileAge(prevCloneInfl+".root") >= 0 && fileAge(prevCloneInfl+".root") < replaceIfOlder && M.matches(prevCloneInfl)) {
 			OA.zeroCounters();
 			printf("\tSimulations in '%s' already recently generated; loading them...\n",OA.basePath.c_str());
 			OctetAnalyzer* subOA = (OctetAnalyzer*)OA.makeAnalyzer("NameUnused",prevCloneInfl);
@@ -348,7 +494,7 @@ unsigned int simuClone(const std::string& basedata, OctetAnalyzer& OA, Sim2PMT&
 			nCloned++;
 			for(std::map<RunNum,double>::iterator it = origOA->runCounts.counts.begin(); it != origOA->runCounts.counts.end(); it++) {
 				if(!it->first || !it->second) continue;
-				RunInfo RI = CalDBSQL::getCDB()->getRunInfo(it->first);
+				RunInfo RI = CalDBSnapshot::getActiveCDB()->getRunInfo(it->first);
 				if(RI.gvState != GV_OPEN) continue;	// no simulation for background runs
 				// estimate background count share for this run (and reduce simulation by this amount)
 				double bgEst = origOA->getTotalCounts(RI.afpState,0)*origOA->getRunTime(it->first)/origOA->getTotalTime(RI.afpState,0).t[BOTH];
@@ -363,6 +509,7 @@ unsigned int simuClone(const std::string& basedata, OctetAnalyzer& OA, Sim2PMT&
 	}
 	
 	// generate output
+	OA.flushArena();
 	OA.calculateResults();
 	OA.makePlots();
 	origOA->calculateResults();
@@ -89,10 +89,12 @@ private:
 /// process one pulse-pair worth of data
 unsigned int processPulsePair(OctetAnalyzer& OA, const Octet& PP);
 
-/// process a set of octets; return number of processed pulse-pairs
-unsigned int processOctets(OctetAnalyzer& OA, const std::vector<Octet>& O, double replaceIfOlder = 0);
+/// process a set of octets, with sub-octets processed in up to nJobs parallel worker processes; return number of processed pulse-pairs
+unsigned int processOctets(OctetAnalyzer& OA, const std::vector<Octet>& O, double replaceIfOlder = 0, unsigned int nJobs = 1);
 
 /// make a simulation clone (using simulation data from simData) of analyzed data in directory basedata; return number of cloned pulse-pairs
 unsigned int simuClone(const std::string& basedata, OctetAnalyzer& OA, Sim2PMT& simData, double simfactor = 1.0, double replaceIfOlder = 0);
+/// make a simulation clone using Geant4 simulation files matching g4files (reduced input if available, see getSimSource)
+unsigned int simuClone(const std::string& basedata, OctetAnalyzer& OA, const std::string& g4files, double simfactor = 1.0, double replaceIfOlder = 0);
 	
 #endif
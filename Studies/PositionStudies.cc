@@ -29,6 +29,9 @@ void AnodeCalibration(ProcessedDataScanner& PDS, OutputManager& OM, unsigned int
 	
 	// collect data
 	printf("Scanning data...\n");
+	EventSkim skim(PID_BETA,1<<TYPE_0_EVENT,fidRadius);
+	skim.sides[NONE] = skim.sides[BOTH] = false;
+	PDS.setSelection(&skim);
 	PDS.startScan();
 	while(PDS.nextPoint()) {
 		Side s = PDS.fSide;
@@ -39,6 +42,7 @@ void AnodeCalibration(ProcessedDataScanner& PDS, OutputManager& OM, unsigned int
 		masterEnergySpectrum->Fill(PDS.getEtrue());
 		anodeSpectra[s][e][p]->Fill(PDS.mwpcs[s].anode);
 	}
+	PDS.setSelection(NULL);
 	
 	masterEnergySpectrum->Draw();
 	OM.printCanvas("MasterEnergy");
@@ -1,5 +1,11 @@
 #include "RunAccumulator.hh"
+#include "PathUtils.hh"
+#include "CalDBSQL.hh"
 #include <TRandom3.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <signal.h>
 
 void fgbgPair::bgSubtract(BlindTime tFG, BlindTime tBG) {
 	assert(!isSubtracted); // don't BG subtract twice!
@@ -62,7 +68,10 @@ fgbgPair RunAccumulator::cloneFGBGPair(const fgbgPair& p, const std::string& new
 }
 
 RunAccumulator::RunAccumulator(OutputManager* pnt, const std::string& nm, const std::string& inflName):
-SegmentSaver(pnt,nm,inflName), needsSubtraction(false) {
+SegmentSaver(pnt,nm,inflName), needsSubtraction(false), dataSkim(NULL),
+fillJobs(atoi(getEnvSafe("UCNA_FILL_JOBS","1").c_str())),
+recalBlock(atoi(getEnvSafe("UCNA_RECAL_BLOCK","0").c_str())), recalTol(atof(getEnvSafe("UCNA_RECAL_TOL","0").c_str())) {
+	if(!fillJobs) fillJobs = 1;
 	
 	// initialize blind time to 0
 	zeroCounters();
@@ -123,6 +132,7 @@ void RunAccumulator::addSegment(const SegmentSaver& S) {
 }
 
 fgbgPair& RunAccumulator::getFGBGPair(const std::string& qname) {
+	flushArena();
 	std::map<std::string,fgbgPair>::iterator it = fgbgHists.find(qname);
 	assert(it != fgbgHists.end());
 	return it->second;
@@ -161,6 +171,7 @@ void errorbarsFromMasterHisto(TH1* lowrate, const TH1* master) {
 }
 
 void RunAccumulator::bgSubtractAll() {
+	flushArena();
 	for(std::map<std::string,fgbgPair>::iterator it = fgbgHists.begin(); it != fgbgHists.end(); it++) {
 		if(getErrorEstimator())
 			errorbarsFromMasterHisto(it->second.h[0],getErrorEstimator()->getFGBGPair(it->second.getName()).h[0]);
@@ -171,6 +182,7 @@ void RunAccumulator::bgSubtractAll() {
 
 void RunAccumulator::simBgFlucts(const RunAccumulator& RefOA, double simfactor) {
 	assert(isEquivalent(RefOA));
+	flushArena();
 	printf("Adding background fluctuations to simulation...\n");
 	static TRandom3* OA_sim_rnd_source = NULL;
 	if(!OA_sim_rnd_source) {
@@ -196,6 +208,7 @@ void RunAccumulator::simBgFlucts(const RunAccumulator& RefOA, double simfactor)
 }
 
 void RunAccumulator::makeRatesSummary() {
+	flushArena();
 	for(std::map<std::string,fgbgPair>::const_iterator it = fgbgHists.begin(); it != fgbgHists.end(); it++) {
 		for(unsigned int fg = 0; fg <= 1; fg++) {
 			Stringmap rt;
@@ -212,6 +225,7 @@ void RunAccumulator::makeRatesSummary() {
 }
 
 void RunAccumulator::write(std::string outName) {
+	flushArena();
 	// record total times, counts
 	for(unsigned int afp = AFP_OFF; afp <= AFP_OTHER; afp++) {
 		for(unsigned int fg = 0; fg <= 1; fg++) {
@@ -241,27 +255,45 @@ void RunAccumulator::loadProcessedData(AFPState afp, GVState gv, ProcessedDataSc
 	currentAFP = afp;
 	if(!PDS.getnFiles())
 		return;
+	PDS.setSelection(dataSkim);
+	if(recalBlock && PDS.hasCalibrators())
+		PDS.setRecalibrationBlock(recalBlock,recalTol);
+	unsigned int nScanned = fillJobs > 1 ? (unsigned int)forkFill(PDS) : scanData(PDS);
+	PDS.setSelection(NULL);
+	printf("\tFG=%i: scanned %i points\n",gv,nScanned);
+	if(gv==GV_CLOSED)
+		needsSubtraction = true;
+	runTimes += PDS.runTimes;
+	totalTime[afp][gv] += PDS.totalTime;
+}
+
+unsigned int RunAccumulator::scanData(ProcessedDataScanner& PDS) {
 	PDS.startScan();
 	unsigned int nScanned = 0;
+	const bool recal = recalBlock && PDS.hasCalibrators();
 	while(PDS.nextPoint()) {
 		nScanned++;
+		if(recal)
+			PDS.recalibrateEnergy();
 		if(PDS.fPID==PID_BETA && PDS.fType==TYPE_0_EVENT) {
 			runCounts.add(PDS.getRun(),1.0);
-			totalCounts[afp][gv]++;
+			totalCounts[currentAFP][currentGV]++;
 		}
 		fillCoreHists(PDS,1.0);
 	}
-	printf("\tFG=%i: scanned %i points\n",gv,nScanned);
-	if(gv==GV_CLOSED)
-		needsSubtraction = true;
-	runTimes += PDS.runTimes;
-	totalTime[afp][gv] += PDS.totalTime;
+	return nScanned;
 }
 
 void RunAccumulator::loadSimData(Sim2PMT& simData, unsigned int nToSim) {
 	AFPState afp = simData.getAFP();
 	currentGV = GV_OPEN;
 	currentAFP = afp;
+	// sub-simulation mixtures have no input files of their own for a simulation sequence
+	double nSimmed = simData.getnFiles() && simData.nEvents ? simSequence(simData,nToSim,fillJobs) : scanSim(simData,nToSim);
+	totalCounts[afp][1] += nSimmed;
+}
+
+double RunAccumulator::scanSim(Sim2PMT& simData, unsigned int nToSim) {
 	simData.startScan(nToSim);
 	float nSimmed = 0;
 	while(nSimmed<=nToSim) {
@@ -271,8 +303,255 @@ void RunAccumulator::loadSimData(Sim2PMT& simData, unsigned int nToSim) {
 			nSimmed+=simData.physicsWeight;
 			runCounts.add(simData.getRun(),simData.physicsWeight);
 		}
-		if(!(int(nSimmed)%(nToSim/20))) { printf("*"); fflush(stdout); }
+		if(nToSim >= 20 && !(int(nSimmed)%(nToSim/20))) { printf("*"); fflush(stdout); }
 	}
 	printf("\n--Scan complete.--\n");
-	totalCounts[afp][1] += nSimmed;
+	return nSimmed;
+}
+
+bool RunAccumulator::simBlock(Sim2PMT& simData, unsigned long long b, std::vector<SimCount>& counted, unsigned int& nEvts, bool stop, float nSimmed, unsigned int nToSim) {
+	counted.clear();
+	for(unsigned int i=0; i<simBlockSize; i++) {
+		simData.simulateEvent(b*simBlockSize+i);
+		fillCoreHists(simData,simData.physicsWeight);
+		if(simData.fPID==PID_BETA && simData.fType==TYPE_0_EVENT) {
+			SimCount c;
+			c.i = i;
+			c.rn = simData.getRun();
+			c.w = simData.physicsWeight;
+			counted.push_back(c);
+			// same stopping criterion as simStopPoint
+			nSimmed += c.w;
+			if(stop && nSimmed > nToSim) {
+				nEvts = i+1;
+				return true;
+			}
+		}
+	}
+	nEvts = simBlockSize;
+	return false;
+}
+
+bool RunAccumulator::simStopPoint(const std::vector<SimCount>& counted, float nSimmed, unsigned int nToSim, unsigned int& nEvts) {
+	for(std::vector<SimCount>::const_iterator it = counted.begin(); it != counted.end(); it++) {
+		nSimmed += it->w;
+		if(nSimmed > nToSim) {
+			nEvts = it->i+1;
+			return true;
+		}
+	}
+	nEvts = simBlockSize;
+	return false;
+}
+
+void RunAccumulator::addSimCounts(const std::vector<SimCount>& counted, unsigned int nEvts, float& nSimmed) {
+	for(std::vector<SimCount>::const_iterator it = counted.begin(); it != counted.end() && it->i < nEvts; it++) {
+		nSimmed += it->w;
+		runCounts.add(it->rn,it->w);
+	}
+}
+
+double RunAccumulator::simSequence(Sim2PMT& simData, unsigned int nToSim, unsigned int nJobs) {
+	// Each block of the sequence is filled into emptied histograms, then summed into the arena in block order,
+	// so the result is identical whichever process filled each block.
+	simData.startSimSequence();
+	flushArena();
+	stashToArena();
+	if(nJobs > 1)
+		printf("Simulating in %i worker processes...\n",nJobs);
+	
+	// worker k fills complete blocks k, k+nJobs, ..., sending each one's counts and histograms until stopped
+	std::vector<pid_t> pids(nJobs,-1);
+	std::vector<int> fds(nJobs,-1);
+	for(unsigned int k=0; nJobs > 1 && k<nJobs; k++) {
+		int fd[2];
+		if(pipe(fd))
+			continue;
+		fflush(stdout);
+		fflush(stderr);
+		pid_t pid = fork();
+		if(pid < 0) {
+			close(fd[0]);
+			close(fd[1]);
+			continue;
+		}
+		if(!pid) {
+			close(fd[0]);
+			for(unsigned int j=0; j<k; j++)
+				if(fds[j] >= 0) close(fds[j]);
+			signal(SIGPIPE,SIG_IGN);
+			CalDBSQL::forgetCDB();
+			simData.reopenAfterFork();
+			FILE* f = fdopen(fd[1],"wb");
+			std::vector<SimCount> counted;
+			unsigned int nEvts;
+			for(unsigned long long b = k; f; b += nJobs) {
+				simBlock(simData,b,counted,nEvts);
+				unsigned int nc = counted.size();
+				bool ok = fwrite(&nc,sizeof(nc),1,f)==1 && (!nc || fwrite(&counted[0],sizeof(SimCount),nc,f)==nc);
+				ok = ok && arena.writeHists(f) && !fflush(f);
+				for(std::map<std::string,TH1*>::iterator it = saveHists.begin(); it != saveHists.end(); it++)
+					zero(it->second);
+				if(!ok) break;
+			}
+			_exit(0);
+		}
+		close(fd[1]);
+		pids[k] = pid;
+		fds[k] = fd[0];
+	}
+	std::vector<FILE*> fins(nJobs,(FILE*)NULL);
+	for(unsigned int k=0; k<nJobs; k++)
+		if(fds[k] >= 0 && (fins[k] = fdopen(fds[k],"rb")))
+			fds[k] = -1;
+	
+	// reduce blocks in order, filling here any block without worker results
+	float nSimmed = 0;
+	std::vector<SimCount> counted;
+	for(unsigned long long b = 0; true; b++) {
+		const unsigned int k = b%nJobs;
+		bool local = !fins[k];
+		if(!local) {
+			unsigned int nc = 0;
+			local = !(fread(&nc,sizeof(nc),1,fins[k])==1 && nc <= simBlockSize);
+			if(!local) {
+				counted.resize(nc);
+				local = nc && fread(&counted[0],sizeof(SimCount),nc,fins[k]) != nc;
+			}
+		}
+		if(local && fins[k]) {
+			printf("*** Simulation worker %i failed; simulating its blocks here.\n",k);
+			fclose(fins[k]);
+			fins[k] = NULL;
+		}
+		unsigned int nEvts = simBlockSize;
+		if(!local) {
+			if(simStopPoint(counted,nSimmed,nToSim,nEvts)) {
+				// final block: worker filled it past the stopping point; re-fill here only up to the stop
+				local = true;
+			} else if(!arena.readAccumulate(fins[k])) {
+				printf("*** Simulation worker %i failed; simulating its blocks here.\n",k);
+				fclose(fins[k]);
+				fins[k] = NULL;
+				local = true;
+			}
+		}
+		
+		// blocks filled here stop at the stopping point directly (which may be the block's last event)
+		bool stopped = false;
+		if(local) {
+			stopped = simBlock(simData,b,counted,nEvts,true,nSimmed,nToSim);
+			stashToArena();
+		}
+		addSimCounts(counted,nEvts,nSimmed);
+		if(stopped)
+			break;
+		printf("*");
+		fflush(stdout);
+	}
+	
+	// stop workers still filling blocks past the end
+	for(unsigned int k=0; k<nJobs; k++) {
+		if(fins[k]) fclose(fins[k]);
+		if(fds[k] >= 0) close(fds[k]);
+		if(pids[k] > 0) {
+			kill(pids[k],SIGKILL);
+			waitpid(pids[k],NULL,0);
+		}
+	}
+	flushArena();
+	printf("\n--Simulation complete.--\n");
+	return nSimmed;
+}
+
+double RunAccumulator::forkFill(ProcessedDataScanner& PDS) {
+	const unsigned int nJobs = fillJobs < PDS.nEvents ? fillJobs : PDS.nEvents;
+	if(nJobs < 2)
+		return scanData(PDS);
+	printf("Filling histograms in %i worker processes...\n",nJobs);
+	if(dataSkim)
+		PDS.updateSelection();	// build skim indices once, before workers share them
+	
+	// each worker fills its own (copy-on-write) histograms from one slice of the events
+	std::vector<pid_t> pids(nJobs,-1);
+	std::vector<int> fds(nJobs,-1);
+	for(unsigned int k=0; k<nJobs; k++) {
+		int fd[2];
+		if(pipe(fd))
+			continue;
+		fflush(stdout);
+		fflush(stderr);
+		pid_t pid = fork();
+		if(pid < 0) {
+			close(fd[0]);
+			close(fd[1]);
+			continue;
+		}
+		if(!pid) {
+			close(fd[0]);
+			CalDBSQL::forgetCDB();
+			PDS.reopenAfterFork();
+			PDS.setScanRange((unsigned long long)PDS.nEvents*k/nJobs,(unsigned long long)PDS.nEvents*(k+1)/nJobs);
+			zeroSavedHists();
+			runCounts = TagCounter<RunNum>();
+			const float c0 = totalCounts[currentAFP][currentGV];
+			double n = scanData(PDS);
+			// results: scanned points, type-0 counts, run counts, histograms
+			FILE* f = fdopen(fd[1],"wb");
+			double dc = totalCounts[currentAFP][currentGV]-c0;
+			unsigned int nr = runCounts.counts.size();
+			bool ok = f && fwrite(&n,sizeof(n),1,f)==1 && fwrite(&dc,sizeof(dc),1,f)==1 && fwrite(&nr,sizeof(nr),1,f)==1;
+			for(std::map<RunNum,double>::const_iterator it = runCounts.counts.begin(); ok && it != runCounts.counts.end(); it++)
+				ok = fwrite(&it->first,sizeof(it->first),1,f)==1 && fwrite(&it->second,sizeof(it->second),1,f)==1;
+			ok = ok && arena.writeHists(f);
+			ok = f && !fclose(f) && ok;
+			fflush(stdout);
+			_exit(ok?0:1);
+		}
+		close(fd[1]);
+		pids[k] = pid;
+		fds[k] = fd[0];
+	}
+	
+	// reduce worker results in order; re-scan any failed slice here
+	// (histograms are read into a scratch arena, merged only once the worker has exited cleanly)
+	HistArena part(arena);
+	part.clear();
+	double nScanned = 0;
+	for(unsigned int k=0; k<nJobs; k++) {
+		bool ok = pids[k] > 0;
+		if(ok) {
+			FILE* f = fdopen(fds[k],"rb");
+			double n = 0, dc = 0;
+			unsigned int nr = 0;
+			TagCounter<RunNum> rc;
+			ok = f && fread(&n,sizeof(n),1,f)==1 && fread(&dc,sizeof(dc),1,f)==1 && fread(&nr,sizeof(nr),1,f)==1;
+			for(unsigned int i=0; ok && i<nr; i++) {
+				RunNum rn;
+				double c;
+				ok = fread(&rn,sizeof(rn),1,f)==1 && fread(&c,sizeof(c),1,f)==1;
+				if(ok) rc.add(rn,c);
+			}
+			part.clear();
+			ok = ok && part.readAccumulate(f);
+			if(f) fclose(f);
+			else close(fds[k]);
+			int status = 0;
+			ok = waitpid(pids[k],&status,0)==pids[k] && WIFEXITED(status) && !WEXITSTATUS(status) && ok;
+			if(ok) {
+				nScanned += n;
+				totalCounts[currentAFP][currentGV] += dc;
+				runCounts += rc;
+				arena.accumulate(part);
+			}
+		}
+		if(!ok) {
+			printf("*** Fill worker %i failed; re-scanning its events here.\n",k);
+			PDS.setScanRange((unsigned long long)PDS.nEvents*k/nJobs,(unsigned long long)PDS.nEvents*(k+1)/nJobs);
+			nScanned += scanData(PDS);
+		}
+	}
+	PDS.setScanRange(0,0);
+	flushArena();
+	return nScanned;
 }
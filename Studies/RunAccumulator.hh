@@ -32,6 +32,13 @@ public:
 	bool isSubtracted;		//< whether this pair is already background-subtracted
 };
 
+/// simulated type-0 event count, kept per simulation block for reducing blocks in sequence order
+struct SimCount {
+	unsigned int i;		//< event number in block
+	RunNum rn;			//< run number
+	double w;			//< event weight
+};
+
 class RunAccumulator: public SegmentSaver {
 public:
 	/// constructor
@@ -77,6 +84,10 @@ public:
 	AFPState currentAFP;			//< current state of AFP during data scanning
 	GVState currentGV;				//< current foreground/background status during data scanning
 	bool needsSubtraction;			//< whether background subtraction is pending
+	const ScanSelector* dataSkim;	//< skim selection for loading processed data, for subclasses using only some events (NULL for all)
+	unsigned int fillJobs;			//< number of forked worker processes filling histograms from slices of the event range (default $UCNA_FILL_JOBS, 1 for serial)
+	unsigned int recalBlock;		//< events re-calibrated together when re-calibrating processed data with current calibrations (default $UCNA_RECAL_BLOCK; 0 to use replay energies)
+	float recalTol;					//< lookup-table calibrator tolerance for re-calibration (default $UCNA_RECAL_TOL; 0 for exact PMTCalibrator)
 	
 	TagCounter<RunNum> runCounts;	//< type-0 event counts by run, for re-simulation
 	
@@ -92,7 +103,24 @@ public:
 protected:
 	
 	/// get matching RunAccumulator with "master" histograms for estimating error bars on low-counts bins
-	RunAccumulator* getErrorEstimator();	
+	RunAccumulator* getErrorEstimator();
+	/// fill core histograms from all events in current scan range; return number of scanned points
+	unsigned int scanData(ProcessedDataScanner& PDS);
+	/// fill core histograms with nToSim simulated type-0 counts by sequential scan (for mixtures without input files of their own); return simulated counts
+	double scanSim(Sim2PMT& simData, unsigned int nToSim);
+	/// scan data in fillJobs worker processes, reducing their histograms into this; return scanned points
+	double forkFill(ProcessedDataScanner& PDS);
+	/// simulate nToSim counts from reproducible simulation sequence, with blocks spread over nJobs worker processes; result independent of nJobs
+	double simSequence(Sim2PMT& simData, unsigned int nToSim, unsigned int nJobs);
+	/// fill sequence block b into (emptied) histograms, recording type-0 counts and number of events filled nEvts;
+	/// if stop, end at the event passing nToSim counts starting from nSimmed; return whether stopped
+	bool simBlock(Sim2PMT& simData, unsigned long long b, std::vector<SimCount>& counted, unsigned int& nEvts, bool stop = false, float nSimmed = 0, unsigned int nToSim = 0);
+	/// whether block passes nToSim counts starting from nSimmed, setting nEvts to events needed (simBlockSize if not reached)
+	static bool simStopPoint(const std::vector<SimCount>& counted, float nSimmed, unsigned int nToSim, unsigned int& nEvts);
+	/// add counts for the first nEvts block events
+	void addSimCounts(const std::vector<SimCount>& counted, unsigned int nEvts, float& nSimmed);
+	
+	static const unsigned int simBlockSize = 1<<16;	//< events per simulation sequence block (partial sums reduced in block order)
 	
 	std::map<std::string,fgbgPair> fgbgHists;	//< background-subtractable quantities
 	float totalCounts[AFP_OTHER+1][2];			//< total type-0 event counts by [flipper][fg/bg], for re-simulation
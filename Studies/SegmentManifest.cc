@@ -0,0 +1,121 @@
+#include "SegmentManifest.hh"
+#include "SegmentSaver.hh"
+#include "CalDBSnapshot.hh"
+#include "CalDBSQL.hh"
+#include "PostOfficialAnalyzer.hh"
+#include "CodeVersion.hh"
+#include "strutils.hh"
+#include "PathUtils.hh"
+#include <algorithm>
+#include <stdio.h>
+#include <sys/stat.h>
+
+/// full-precision number formatting for fingerprints
+static std::string ntos(double x) {
+	char c[32];
+	sprintf(c,"%.10g",x);
+	return std::string(c);
+}
+
+/// fingerprint of graph points (deleting graph)
+static std::string gtos(TGraph* g) {
+	std::string s;
+	for(int i=0; g && i<g->GetN(); i++)
+		s += ntos(g->GetX()[i])+":"+ntos(g->GetY()[i])+",";
+	if(g) delete(g);
+	return s+";";
+}
+
+SegmentManifest::SegmentManifest(const SegmentSaver& S, const std::vector<RunNum>& runs) {
+	std::vector<RunNum> rs = runs;
+	std::sort(rs.begin(),rs.end());
+	rs.erase(std::unique(rs.begin(),rs.end()),rs.end());
+	std::string rstr, cstr, fstr;
+	for(std::vector<RunNum>::const_iterator it = rs.begin(); it != rs.end(); it++) {
+		rstr += itos(*it)+",";
+		cstr += calHash(*it);
+		fstr += fileStamp(PostOfficialAnalyzer::locateRun(*it));
+	}
+	inputs["runs"] = hashString(rstr);
+	inputs["calibration"] = hashString(cstr);
+	inputs["replay"] = hashString(fstr);
+	inputs["config"] = hashString(S.getConfig());
+	inputs["code"] = codeVersion();
+}
+
+void SegmentManifest::addInput(const std::string& nm, const std::string& v) {
+	inputs[nm] = hashString(v);
+}
+
+Stringmap SegmentManifest::toStringmap() const {
+	Stringmap m;
+	for(std::map<std::string,std::string>::const_iterator it = inputs.begin(); it != inputs.end(); it++)
+		m.insert(it->first,it->second);
+	return m;
+}
+
+bool SegmentManifest::matches(const std::string& inflname) const {
+	if(!fileExists(inflname+".root") || !fileExists(inflname+".txt"))
+		return false;
+	Stringmap m = QFile(inflname+".txt").getFirst("manifest");
+	for(std::map<std::string,std::string>::const_iterator it = inputs.begin(); it != inputs.end(); it++) {
+		if(m.getDefault(it->first,"") != it->second) {
+			printf("Segment '%s' input '%s' changed.\n",inflname.c_str(),it->first.c_str());
+			return false;
+		}
+	}
+	return true;
+}
+
+std::string SegmentManifest::fileStamp(const std::string& fname) {
+	struct stat attrib;
+	if(stat(fname.c_str(), &attrib))
+		return fname+":missing;";
+	return fname+":"+ntos(attrib.st_size)+":"+ntos(attrib.st_mtime)+";";
+}
+
+std::string SegmentManifest::codeVersion() {
+	return UCNA_CODE_VERSION;
+}
+
+const std::string& SegmentManifest::calHash(RunNum rn) {
+	static std::map<RunNum,std::string> cache;
+	std::map<RunNum,std::string>::iterator it = cache.find(rn);
+	if(it != cache.end())
+		return it->second;
+	
+	CalDB* CDB = CalDBSnapshot::getActiveCDB();
+	std::string s;
+	if(CDB->isValid(rn)) {
+		const RunNum rGMS = CDB->getGMSRun(rn);
+		s += itos(rGMS)+",";
+		BlindTime bt = CDB->fiducialTime(rn);
+		s += ntos(bt.t[EAST])+","+ntos(bt.t[WEST])+","+ntos(bt.t[BOTH])+",";
+		if(CalDBSQL* SQL = dynamic_cast<CalDBSQL*>(CDB))
+			s += itos(SQL->getPosmapID(rn))+","+itos(SQL->getAnodePosmapID(rn))+",";
+		for(Side sd = EAST; sd <= WEST; ++sd) {
+			s += ntos(CDB->getAnodeGain(rn,sd))+","+ntos(CDB->getEcalX(rn,sd))+","+ntos(CDB->getEcalY(rn,sd))+",";
+			const std::string anodeName = sideSubst("MWPC%cAnode",sd);
+			s += gtos(CDB->getPedestals(rn,anodeName))+gtos(CDB->getPedwidths(rn,anodeName));
+			for(unsigned int tp = TYPE_0_EVENT; tp <= TYPE_II_EVENT; tp++)
+				s += gtos(CDB->getEvisConversion(rn,sd,EventType(tp)));
+			for(unsigned int t=0; t<nBetaTubes; t++) {
+				// same sensor naming as LinearityCorrector
+				const std::string sensorName = std::string("ADC")+ctos(sideNames(sd))+itos(pmtHardwareNum(sd,t))+"Beta";
+				s += ntos(CDB->getEcalADC(rn,sd,t))+","+ntos(CDB->getEcalEvis(rn,sd,t))+",";
+				s += ntos(CDB->getNoiseWidth(rn,sd,t))+","+ntos(CDB->getNoiseADC(rn,sd,t))+",";
+				s += gtos(CDB->getLinearity(rn,sd,t));
+				s += gtos(CDB->getPedestals(rn,sensorName))+gtos(CDB->getPedwidths(rn,sensorName));
+				s += gtos(CDB->getRunMonitor(rn,sensorName,"Chris_peak"));
+				s += ntos(CDB->getRunMonitorStart(rGMS,sensorName,"Chris_peak"))+",";
+				if(EfficCurve* E = CDB->getTrigeff(rn,sd,t)) {
+					for(unsigned int i=0; i<4; i++)
+						s += ntos(E->params[i])+",";
+					delete(E);
+				}
+				s += ";";
+			}
+		}
+	}
+	return cache[rn] = hashString(s);
+}
@@ -0,0 +1,36 @@
+#ifndef SEGMENTMANIFEST_HH
+#define SEGMENTMANIFEST_HH 1
+
+#include "QFile.hh"
+#include "Types.hh"
+#include <map>
+#include <string>
+#include <vector>
+
+class SegmentSaver;
+class CalDB;
+
+/// record of the inputs a saved analysis segment was computed from, for deciding whether cached output can be re-used
+class SegmentManifest {
+public:
+	/// constructor, for analyzer configuration and list of runs processed
+	SegmentManifest(const SegmentSaver& S, const std::vector<RunNum>& runs);
+	
+	/// add additional named input (hashed)
+	void addInput(const std::string& nm, const std::string& v);
+	/// convert to Stringmap for output
+	Stringmap toStringmap() const;
+	/// check whether saved segment (file name without suffix) was produced from the same inputs
+	bool matches(const std::string& inflname) const;
+	
+	/// calibration fingerprint for one run (cached)
+	static const std::string& calHash(RunNum rn);
+	/// file name, size, and modification time, for identifying input file contents
+	static std::string fileStamp(const std::string& fname);
+	/// code version compiled in
+	static std::string codeVersion();
+	
+	std::map<std::string,std::string> inputs;	//< hash of each named input
+};
+
+#endif
@@ -1,5 +1,23 @@
 #include "SegmentSaver.hh"
 #include "Types.hh"
+#include "strutils.hh"
+
+const SegmentLayout* SegmentLayout::getLayout(const std::vector<std::string>& nms, const std::vector<unsigned int>& nb) {
+	static std::map< std::pair< std::vector<std::string>, std::vector<unsigned int> >, SegmentLayout* > layouts;
+	std::pair< std::vector<std::string>, std::vector<unsigned int> > k(nms,nb);
+	std::map< std::pair< std::vector<std::string>, std::vector<unsigned int> >, SegmentLayout* >::iterator it = layouts.find(k);
+	if(it != layouts.end())
+		return it->second;
+	SegmentLayout* L = new SegmentLayout();
+	L->names = nms;
+	L->nBins = nb;
+	for(unsigned int i=0; i<nms.size(); i++)
+		L->slots.insert(std::make_pair(nms[i],i));
+	layouts.insert(std::make_pair(k,L));
+	return L;
+}
+
+//-----------------------------------------------------
 
 TH1* SegmentSaver::registerSavedHist(const std::string& hname, const std::string& title,unsigned int nbins, float xmin, float xmax) {
 	assert(saveHists.find(hname)==saveHists.end());	// don't duplicate names!
@@ -8,7 +26,7 @@ TH1* SegmentSaver::registerSavedHist(const std::string& hname, const std::string
 		h = (TH1*)addObject(fIn->Get(hname.c_str())->Clone(hname.c_str()));
 	else
 		h = registeredTH1F(hname,title,nbins,xmin,xmax);
-	saveHists.insert(std::make_pair(hname,h));
+	addSavedHist(hname,h);
 	return h;
 }
 
@@ -21,12 +39,38 @@ TH1* SegmentSaver::registerSavedHist(const std::string& hname, const TH1& hTempl
 		h = (TH1*)addObject(hTemplate.Clone(hname.c_str()));
 		zero(h);
 	}
-	saveHists.insert(std::make_pair(hname,h));
+	addSavedHist(hname,h);
 	return h;
 }
 
+void SegmentSaver::addSavedHist(const std::string& hname, TH1* h) {
+	saveHists.insert(std::make_pair(hname,h));
+	slotNames.push_back(hname);
+	slotHists.push_back(h);
+	arena.addSlot(h);
+	layout = NULL;
+}
+
+const SegmentLayout* SegmentSaver::getLayout() const {
+	if(!layout) {
+		std::vector<unsigned int> nb;
+		for(std::vector<TH1*>::const_iterator it = slotHists.begin(); it != slotHists.end(); it++)
+			nb.push_back(totalBins(*it));
+		layout = SegmentLayout::getLayout(slotNames,nb);
+	}
+	return layout;
+}
+
+std::string SegmentSaver::getConfig() const {
+	const SegmentLayout* L = getLayout();
+	std::string s;
+	for(unsigned int i=0; i<L->names.size(); i++)
+		s += L->names[i]+":"+itos(L->nBins[i])+";";
+	return s;
+}
+
 SegmentSaver::SegmentSaver(OutputManager* pnt, const std::string& nm, const std::string& inflName):
-OutputManager(nm,pnt), inflname(inflName) {		
+OutputManager(nm,pnt), layout(NULL), inflname(inflName) {		
 	// open file to load existing data
 	fIn = (inflname.size())?(new TFile((inflname+".root").c_str(),"READ")):NULL;
 	assert(!fIn || !fIn->IsZombie());
@@ -42,23 +86,34 @@ SegmentSaver::~SegmentSaver() {
 }
 
 TH1* SegmentSaver::getSavedHist(const std::string& hname) {
+	flushArena();
 	std::map<std::string,TH1*>::iterator it = saveHists.find(hname);
 	assert(it != saveHists.end());
 	return it->second;
 }
 
 const TH1* SegmentSaver::getSavedHist(const std::string& hname) const {
+	flushArena();
 	std::map<std::string,TH1*>::const_iterator it = saveHists.find(hname);
 	assert(it != saveHists.end());
 	return it->second;
 }
 
 void SegmentSaver::zeroSavedHists() {
+	arena.clear();
 	for(std::map<std::string,TH1*>::iterator it = saveHists.begin(); it != saveHists.end(); it++)
 		zero(it->second);
 }
 
+void SegmentSaver::stashToArena() {
+	for(unsigned int i=0; i<slotHists.size(); i++) {
+		arena.accumulate(i,slotHists[i]);
+		zero(slotHists[i]);
+	}
+}
+
 bool SegmentSaver::isEquivalent(const SegmentSaver& S) const {
+	if(getLayout() == S.getLayout()) return true;
 	if(saveHists.size() != S.saveHists.size()) return false;
 	for(std::map<std::string,TH1*>::const_iterator it = saveHists.begin(); it != saveHists.end(); it++) {
 		std::map<std::string,TH1*>::const_iterator otherit = S.saveHists.find(it->first);
@@ -69,8 +124,18 @@ bool SegmentSaver::isEquivalent(const SegmentSaver& S) const {
 }
 
 void SegmentSaver::addSegment(const SegmentSaver& S) {
+	if(getLayout() == S.getLayout()) {
+		// aligned slots: single pass, plus any data S has not yet flushed from its own arena
+		for(unsigned int i=0; i<slotHists.size(); i++)
+			arena.accumulate(i,S.slotHists[i]);
+		arena.accumulate(S.arena);
+		return;
+	}
+	// same histograms in different order: match slots by name
 	assert(isEquivalent(S));
-	// add histograms
-	for(std::map<std::string,TH1*>::const_iterator it = saveHists.begin(); it != saveHists.end(); it++)
-		it->second->Add(S.getSavedHist(it->first));
+	for(unsigned int i=0; i<S.slotHists.size(); i++) {
+		const unsigned int j = getLayout()->slots.find(S.slotNames[i])->second;
+		arena.accumulate(j,S.slotHists[i]);
+		arena.accumulate(j,S.arena,i);
+	}
 }
@@ -2,10 +2,23 @@
 #define SEGMENTSAVER_HH 1
 
 #include "OutputManager.hh"
+#include "HistArena.hh"
 #include <TH1.h>
 #include <TFile.h>
 #include <map>
 #include <string>
+#include <vector>
+
+/// saved histogram names and binning by slot number, shared by all analyzers with the same histograms registered in the same order
+class SegmentLayout {
+public:
+	/// get shared layout for given histogram names and bin counts
+	static const SegmentLayout* getLayout(const std::vector<std::string>& nms, const std::vector<unsigned int>& nb);
+	
+	std::vector<std::string> names;				//< histogram name for each slot
+	std::vector<unsigned int> nBins;			//< total number of bins for each slot
+	std::map<std::string,unsigned int> slots;	//< slot number for each name
+};
 
 /// class for saving, retrieving, and summing histograms from file
 class SegmentSaver: public OutputManager {
@@ -29,10 +42,18 @@ public:
 	/// zero out all saved histograms
 	virtual void zeroSavedHists();
 	
-	/// add histograms from another SegmentSaver of the same type
+	/// add histograms from another SegmentSaver of the same type (accumulated in arena until flushArena)
 	virtual void addSegment(const SegmentSaver& S);
+	/// get shared slot layout of saved histograms
+	const SegmentLayout* getLayout() const;
+	/// add data accumulated by addSegment into histograms; needed before using histograms directly after merging
+	void flushArena() const { arena.flush(); }
+	/// move histogram contents into arena (until flushArena), leaving histograms empty for filling a separate partial sum
+	void stashToArena();
 	/// check if this is equivalent layout to another SegmentSaver
 	virtual bool isEquivalent(const SegmentSaver& S) const;
+	/// description of analyzer settings affecting saved histograms, for segment manifests (default: histogram layout)
+	virtual std::string getConfig() const;
 	
 	// ----- Subclass me! ----- //
 	
@@ -45,7 +66,14 @@ public:
 	
 protected:
 	
+	/// add histogram to saved histograms list
+	void addSavedHist(const std::string& hname, TH1* h);
+	
 	std::map<std::string,TH1*> saveHists;		//< saved histograms
+	std::vector<std::string> slotNames;			//< saved histogram names in registration (slot) order
+	std::vector<TH1*> slotHists;				//< saved histograms in slot order
+	mutable const SegmentLayout* layout;		//< shared slot layout, determined on first use
+	mutable HistArena arena;					//< merged segment contents not yet added into histograms
 	TFile* fIn;									//< input file to read in histograms from
 	std::string inflname;						//< where to look for input file
 };